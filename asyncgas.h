@@ -0,0 +1,546 @@
+/******************************************************************************
+Copyright 2013 Royal Caliber LLC. (http://www.royal-caliber.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************************/
+
+#ifndef ASYNCGAS_H__
+#define ASYNCGAS_H__
+
+/*
+Asynchronous (non bulk synchronous) multithreaded CPU engine.
+
+Takes the same Program as the other engines, but there are no iterations:
+a vertex is gathered, applied and scattered as soon as it is scheduled, and
+sees whatever its neighbors hold at that moment (Gauss-Seidel rather than
+Jacobi updates).  For monotone programs like SSSP and connected components
+this converges with far fewer edge visits than the BSP engines.  Because of
+that the interface is only setGraph / setActive / run / getResults; there is
+no gather/apply/scatterActivate/nextIter to step through.
+
+Implementation Notes:
+-  threading is done with OpenMP.  Each thread owns a work queue, pops from
+   its front and when it runs dry steals a batch from the back of another
+   thread's queue.
+
+-  each vertex has a small state (idle / queued / running / running and
+   activated again).  A vertex is in at most one queue at a time and is
+   never processed by two threads at once, so apply and scatter have
+   exclusive access to the vertex and its out-edges.  Reads of neighbors in
+   gatherMap are not synchronized with their applies, which is fine for
+   word sized, monotonically changing vertex data.  Programs that need more
+   than that should use GASEngineCPU.
+
+-  if the Program has a priority() hook (see gastraits.h) each queue is
+   split into buckets of width setPriorityDelta() as in delta stepping, and
+   threads always work on their lowest non-empty bucket.  An activated
+   vertex goes in the bucket of the vertex that activated it, which for
+   SSSP is a lower bound on its new distance, and moves down if it is
+   activated again with a lower one.  Ordering is per thread, so it is only
+   approximate across threads.
+
+-  gather and scatter are left out for programs that declare they have
+   none, and no edge index is kept without edge data (gastraits.h).
+*/
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <stdio.h>
+#include <stdint.h>
+#include <sched.h>
+#include <omp.h>
+
+#include "util.cuh"
+#include "gastraits.h"
+
+
+template<typename Program
+  , typename Int = int32_t>
+class GASEngineAsync
+{
+public:
+  typedef typename Program::VertexData   VertexData;
+  typedef typename Program::EdgeData     EdgeData;
+  typedef typename Program::GatherResult GatherResult;
+
+private:
+  typedef GASTraits::ActivateFilter<Program> ActivateFilter;
+  typedef GASTraits::Priority<Program>       Priority;
+  typedef GASTraits::Phases<Program>         Phases;
+
+  enum
+  {
+    IDLE,
+    QUEUED,
+    RUNNING,
+    RUNNING_ACTIVATED //activated again while running, requeue when done
+  };
+
+  //per-thread work queue, padded so queues don't share cache lines
+  struct WorkQueue
+  {
+    omp_lock_t                     lock;
+    std::vector< std::deque<Int> > buckets;
+    int                            minBucket; //no lower bucket has work
+    volatile int64_t               size;
+    int64_t                        nUpdates;
+    int64_t                        nEdges;
+    char                           pad[64];
+  };
+
+  Int         m_nVertices;
+  Int         m_nEdges;
+  VertexData *m_vertexData;
+  EdgeData   *m_edgeData;
+
+  //CSC representation for gather; the edge indexes are empty for programs
+  //without edge data
+  std::vector<Int> m_srcs;
+  std::vector<Int> m_srcOffsets;
+  std::vector<Int> m_edgeIndexCSC;
+
+  //CSR representation for scatter and activation
+  std::vector<Int> m_dsts;
+  std::vector<Int> m_dstOffsets;
+  std::vector<Int> m_edgeIndexCSR;
+
+  //scheduling
+  int                m_nThreads;
+  WorkQueue         *m_queues;
+  std::vector<char>  m_state;
+  std::vector<int>   m_bucket;  //bucket v is queued in
+  volatile int64_t   m_pending; //vertices queued or running
+  int                m_nBuckets;
+  double             m_delta;
+  int                m_stealSize;
+
+  int64_t m_nUpdates;
+  int64_t m_nEdgeVisits;
+
+
+  void releaseQueues()
+  {
+    if( !m_queues )
+      return;
+    for( int t = 0; t < m_nThreads; ++t )
+      omp_destroy_lock(&m_queues[t].lock);
+    delete [] m_queues;
+    m_queues = 0;
+  }
+
+
+  int bucketOf(double priority) const
+  {
+    if( m_nBuckets == 1 )
+      return 0;
+    double b = priority / m_delta;
+    if( b <= 0 )
+      return 0;
+    if( b >= m_nBuckets - 1 )
+      return m_nBuckets - 1;
+    return (int) b;
+  }
+
+
+  void push(int tid, Int v, int bucket)
+  {
+    WorkQueue &q = m_queues[tid];
+    omp_set_lock(&q.lock);
+    q.buckets[bucket].push_back(v);
+    if( bucket < q.minBucket )
+      q.minBucket = bucket;
+    ++q.size;
+    omp_unset_lock(&q.lock);
+  }
+
+
+  bool pop(int tid, Int &v, int &bucket)
+  {
+    WorkQueue &q = m_queues[tid];
+    if( q.size == 0 )
+      return false;
+    omp_set_lock(&q.lock);
+    bool found = false;
+    while( q.minBucket < m_nBuckets )
+    {
+      std::deque<Int> &b = q.buckets[q.minBucket];
+      if( !b.empty() )
+      {
+        v = b.front();
+        b.pop_front();
+        --q.size;
+        bucket = q.minBucket;
+        found = true;
+        break;
+      }
+      ++q.minBucket;
+    }
+    omp_unset_lock(&q.lock);
+    return found;
+  }
+
+
+  //move up to half of the lowest bucket of some other thread's queue to our
+  //own, then pop from it
+  bool steal(int tid, Int &v, int &bucket, std::vector<Int> &batch)
+  {
+    for( int k = 1; k < m_nThreads; ++k )
+    {
+      WorkQueue &victim = m_queues[(tid + k) % m_nThreads];
+      if( victim.size == 0 || !omp_test_lock(&victim.lock) )
+        continue;
+
+      bucket = victim.minBucket;
+      while( bucket < m_nBuckets && victim.buckets[bucket].empty() )
+        ++bucket;
+      victim.minBucket = bucket;
+      if( bucket < m_nBuckets )
+      {
+        std::deque<Int> &b = victim.buckets[bucket];
+        size_t n = std::min((b.size() + 1) / 2, (size_t) m_stealSize);
+        batch.assign(b.end() - n, b.end());
+        b.erase(b.end() - n, b.end());
+        victim.size -= n;
+      }
+      omp_unset_lock(&victim.lock);
+
+      if( !batch.empty() )
+      {
+        v = batch.back();
+        batch.pop_back();
+        if( !batch.empty() )
+        {
+          WorkQueue &q = m_queues[tid];
+          omp_set_lock(&q.lock);
+          q.buckets[bucket].insert(q.buckets[bucket].end(), batch.begin(), batch.end());
+          if( bucket < q.minBucket )
+            q.minBucket = bucket;
+          q.size += batch.size();
+          omp_unset_lock(&q.lock);
+          batch.clear();
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+
+  //make sure v will be processed (again) after this point
+  //A queued vertex that is activated with a lower bucket is pushed again
+  //rather than searched for, m_bucket tells which of its queue entries is
+  //current and the others are dropped when popped.
+  void activate(Int v, int bucket, int tid)
+  {
+    for(;;)
+    {
+      char s = m_state[v];
+      if( s == RUNNING_ACTIVATED )
+        return;
+      if( s == QUEUED )
+      {
+        int old = m_bucket[v];
+        if( bucket >= old )
+          return;
+        if( __sync_bool_compare_and_swap(&m_bucket[v], old, bucket) )
+        {
+          push(tid, v, bucket);
+          return;
+        }
+      }
+      else if( s == IDLE )
+      {
+        if( __sync_bool_compare_and_swap(&m_state[v], (char) IDLE, (char) QUEUED) )
+        {
+          __sync_fetch_and_add(&m_pending, 1);
+          m_bucket[v] = bucket;
+          push(tid, v, bucket);
+          return;
+        }
+      }
+      else if( __sync_bool_compare_and_swap(&m_state[v], (char) RUNNING, (char) RUNNING_ACTIVATED) )
+        return;
+    }
+  }
+
+
+  //true if the queue entry (v, bucket) is current, v is then RUNNING
+  bool accept(Int v, int bucket)
+  {
+    return m_bucket[v] == bucket
+      && __sync_bool_compare_and_swap(&m_state[v], (char) QUEUED, (char) RUNNING);
+  }
+
+
+  void process(Int v, int tid)
+  {
+    WorkQueue &q = m_queues[tid];
+
+    GatherResult gatherResult = Program::gatherZero;
+    Int edgeStart = m_srcOffsets[v];
+    Int edgeEnd   = Phases::hasGather ? m_srcOffsets[v + 1] : edgeStart;
+    for( Int ie = edgeStart; ie < edgeEnd; ++ie )
+    {
+      gatherResult = Program::gatherReduce(gatherResult
+        , Program::gatherMap(m_vertexData + v
+          , m_vertexData + m_srcs[ie]
+          , Phases::hasEdgeData ? m_edgeData + m_edgeIndexCSC[ie] : m_edgeData));
+    }
+    q.nEdges += edgeEnd - edgeStart;
+    ++q.nUpdates;
+
+    if( Program::apply(m_vertexData + v, gatherResult) )
+    {
+      int bucket = bucketOf(Priority::priority(m_vertexData + v));
+      //publish the new value before looking at neighbor states, a neighbor
+      //found QUEUED must gather after it
+      __sync_synchronize();
+      edgeEnd = m_dstOffsets[v + 1];
+      for( Int ie = m_dstOffsets[v]; ie < edgeEnd; ++ie )
+      {
+        Int dst = m_dsts[ie];
+        if( Phases::hasScatter )
+        {
+          Program::scatter(m_vertexData + v, m_vertexData + dst
+            , Phases::hasEdgeData ? m_edgeData + m_edgeIndexCSR[ie] : m_edgeData);
+        }
+        if( ActivateFilter::canActivate(m_vertexData + dst) )
+          activate(dst, bucket, tid);
+      }
+    }
+
+    if( __sync_bool_compare_and_swap(&m_state[v], (char) RUNNING, (char) IDLE) )
+      __sync_fetch_and_sub(&m_pending, 1);
+    else
+    {
+      //somebody activated us while we were running
+      int bucket = bucketOf(Priority::priority(m_vertexData + v));
+      m_bucket[v] = bucket;
+      m_state[v] = QUEUED;
+      push(tid, v, bucket);
+    }
+  }
+
+
+  void initQueues()
+  {
+    releaseQueues();
+    m_nBuckets = Priority::enabled ? m_nBuckets : 1;
+    m_queues = new WorkQueue[m_nThreads];
+    for( int t = 0; t < m_nThreads; ++t )
+    {
+      WorkQueue &q = m_queues[t];
+      omp_init_lock(&q.lock);
+      q.buckets.resize(m_nBuckets);
+      q.minBucket = m_nBuckets;
+      q.size      = 0;
+      q.nUpdates  = 0;
+      q.nEdges    = 0;
+    }
+  }
+
+  public:
+    GASEngineAsync()
+      : m_nVertices(0)
+      , m_nEdges(0)
+      , m_vertexData(0)
+      , m_edgeData(0)
+      , m_nThreads(omp_get_max_threads())
+      , m_queues(0)
+      , m_pending(0)
+      , m_nBuckets(1024)
+      , m_delta(1.0)
+      , m_stealSize(64)
+      , m_nUpdates(0)
+      , m_nEdgeVisits(0)
+    {}
+
+
+    ~GASEngineAsync()
+    {
+      releaseQueues();
+    }
+
+
+    //Same contract as GASEngineRef::setGraph, the vertex and edge data are
+    //updated in place.
+    void setGraph(Int nVertices
+      , VertexData* vertexData
+      , Int nEdges
+      , EdgeData* edgeData
+      , const Int *edgeListSrcs
+      , const Int *edgeListDsts)
+    {
+      m_nVertices  = nVertices;
+      m_nEdges     = nEdges;
+      m_vertexData = vertexData;
+      m_edgeData   = edgeData;
+
+      m_dstOffsets.resize(m_nVertices + 1);
+      m_dsts.resize(m_nEdges);
+      m_srcOffsets.resize(m_nVertices + 1);
+      m_srcs.resize(m_nEdges);
+      m_edgeIndexCSR.resize(Phases::hasEdgeData ? m_nEdges : 0);
+      m_edgeIndexCSC.resize(Phases::hasEdgeData ? m_nEdges : 0);
+      edgeListToCSRAndCSC(m_nVertices, m_nEdges
+        , edgeListSrcs, edgeListDsts
+        , &m_dstOffsets[0], &m_dsts[0]
+        , m_edgeIndexCSR.empty() ? 0 : &m_edgeIndexCSR[0]
+        , &m_srcOffsets[0], &m_srcs[0]
+        , m_edgeIndexCSC.empty() ? 0 : &m_edgeIndexCSC[0]);
+
+      m_state.assign(m_nVertices, (char) IDLE);
+      m_bucket.assign(m_nVertices, 0);
+      m_pending = 0;
+      initQueues();
+    }
+
+
+    //Like setGraph, for a graph given as CSR: offsets has nVertices + 1
+    //entries, the out-edges of v are dsts[offsets[v]] ..
+    //dsts[offsets[v + 1] - 1] and edgeData is in the same order as dsts.
+    //The CSC representation is built by transposition.
+    void setGraphCSR(Int nVertices
+      , VertexData* vertexData
+      , Int nEdges
+      , EdgeData* edgeData
+      , const Int *offsets
+      , const Int *dsts)
+    {
+      m_nVertices  = nVertices;
+      m_nEdges     = nEdges;
+      m_vertexData = vertexData;
+      m_edgeData   = edgeData;
+
+      m_dstOffsets.assign(offsets, offsets + m_nVertices + 1);
+      m_dsts.assign(dsts, dsts + m_nEdges);
+      m_edgeIndexCSR.resize(Phases::hasEdgeData ? m_nEdges : 0);
+      for( Int i = 0; i < (Int)m_edgeIndexCSR.size(); ++i )
+        m_edgeIndexCSR[i] = i;
+      m_srcOffsets.resize(m_nVertices + 1);
+      m_srcs.resize(m_nEdges);
+      m_edgeIndexCSC.resize(Phases::hasEdgeData ? m_nEdges : 0);
+      transposeCSR(m_nVertices, m_nEdges, offsets, dsts
+        , &m_srcOffsets[0], m_nEdges ? &m_srcs[0] : 0
+        , m_edgeIndexCSC.empty() ? 0 : &m_edgeIndexCSC[0]);
+
+      m_state.assign(m_nVertices, (char) IDLE);
+      m_bucket.assign(m_nVertices, 0);
+      m_pending = 0;
+      initQueues();
+    }
+
+
+    void getResults()
+    {
+      //do nothing.
+    }
+
+
+    //bucket width for programs with a priority() hook, and the number of
+    //buckets; priorities past the last bucket all share it.  Call before
+    //setGraph.
+    void setPriorityDelta(double delta, int nBuckets = 1024)
+    {
+      m_delta    = delta > 0 ? delta : 1.0;
+      m_nBuckets = nBuckets > 0 ? nBuckets : 1;
+    }
+
+
+    //most vertices moved from another thread's queue in one steal
+    void setStealSize(int n)
+    {
+      m_stealSize = n > 0 ? n : 1;
+    }
+
+
+    //schedule [vertexStart, vertexEnd), split evenly over the threads
+    void setActive(Int vertexStart, Int vertexEnd)
+    {
+      Int n = vertexEnd - vertexStart;
+      for( int t = 0; t < m_nThreads; ++t )
+      {
+        Int begin = vertexStart + (Int)((int64_t)n * t / m_nThreads);
+        Int end   = vertexStart + (Int)((int64_t)n * (t + 1) / m_nThreads);
+        for( Int v = begin; v < end; ++v )
+        {
+          if( m_state[v] != IDLE )
+            continue;
+          int bucket = bucketOf(Priority::priority(m_vertexData + v));
+          m_state[v]  = QUEUED;
+          m_bucket[v] = bucket;
+          ++m_pending;
+          push(t, v, bucket);
+        }
+      }
+    }
+
+
+    //number of vertices waiting to be processed
+    Int countActive()
+    {
+      return (Int) m_pending;
+    }
+
+
+    //process scheduled vertices until no vertex is active anymore
+    void run()
+    {
+      for( int t = 0; t < m_nThreads; ++t )
+        m_queues[t].nUpdates = m_queues[t].nEdges = 0;
+
+      #pragma omp parallel num_threads(m_nThreads)
+      {
+        int tid = omp_get_thread_num();
+        std::vector<Int> batch;
+        batch.reserve(m_stealSize);
+        Int v;
+        int bucket;
+        for(;;)
+        {
+          if( pop(tid, v, bucket) || steal(tid, v, bucket, batch) )
+          {
+            if( accept(v, bucket) )
+              process(v, tid);
+          }
+          else if( m_pending == 0 )
+            break;
+          else
+            sched_yield();
+        }
+      }
+
+      m_nUpdates = m_nEdgeVisits = 0;
+      for( int t = 0; t < m_nThreads; ++t )
+      {
+        m_nUpdates    += m_queues[t].nUpdates;
+        m_nEdgeVisits += m_queues[t].nEdges;
+      }
+    }
+
+
+    //number of vertex applies and gathered edges in the last run()
+    int64_t numUpdates() const
+    {
+      return m_nUpdates;
+    }
+
+    int64_t numEdgeVisits() const
+    {
+      return m_nEdgeVisits;
+    }
+};
+
+
+#endif
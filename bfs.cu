@@ -20,6 +20,7 @@ limitations under the License.
 #include "graphio.h"
 #include "refgas.h"
 #include "gpugas.h"
+#include "cpugas.h"
 
 
 //nvcc doesn't like the __device__ variable to be a static member inside BFS
@@ -37,6 +38,11 @@ struct BFS
 
   struct EdgeData {}; //nothing
 
+  //the engines leave out gather, scatter and the edge index, see gastraits.h
+  static const bool hasGather   = false;
+  static const bool hasScatter  = false;
+  static const bool hasEdgeData = false;
+
   typedef int GatherResult;
   static const int gatherZero = INT_MAX - 1;
 
@@ -77,9 +83,36 @@ struct BFS
   {
     //nothing
   }
+
+
+  //visited vertices never change again, so don't bother activating them
+  __host__ __device__
+  static bool canActivate(const VertexData* vert)
+  {
+    return vert->depth == -1;
+  }
 };
 
 
+//Direction optimizing traversal is always on in the CPU engine.  The
+//reference engine stays on the plain top-down path for checking unless
+//pull is set (-p), so that -t compares its bottom-up path with top-down.
+template<typename Engine>
+void setDirectionOptimizing(Engine &engine, bool pull)
+{
+}
+
+void setDirectionOptimizing(GASEngineCPU<BFS> &engine, bool pull)
+{
+  engine.setDirectionOptimizing(true);
+}
+
+void setDirectionOptimizing(GASEngineRef<BFS> &engine, bool pull)
+{
+  engine.setDirectionOptimizing(pull);
+}
+
+
 template<bool GPU>
 void setIterationCount(int v)
 {
@@ -92,7 +125,7 @@ void setIterationCount(int v)
 
 template<typename Engine, bool GPU>
 float run(int nVertices, BFS::VertexData* vertexData, int nEdges
-  , const int *srcs, const int *dsts, int sourceVertex)
+  , const int *offsets, const int *dsts, int sourceVertex, bool pull = false)
 {
   Engine engine;
   int iteration;
@@ -105,7 +138,8 @@ float run(int nVertices, BFS::VertexData* vertexData, int nEdges
   {
     // reset the graph
     for(int i = 0; i < nVertices; ++i) vertexData[i].depth = -1;
-    engine.setGraph(nVertices, vertexData, nEdges, 0, &srcs[0], &dsts[0]);
+    engine.setGraphCSR(nVertices, vertexData, nEdges, 0, offsets, dsts);
+    setDirectionOptimizing(engine, pull);
     engine.setActive(sourceVertex, sourceVertex+1);
     iteration = 0;
     setIterationCount<GPU>(iteration);
@@ -149,18 +183,23 @@ int main(int argc, char** argv)
   bool runTest;
   bool dumpResults;
   bool useMaxOutDegreeStart;
-  if(!parseCmdLineSimple(argc, argv, "si-t-d-m|s", &inputFilename, &sourceVertex
-    , &runTest, &dumpResults, &useMaxOutDegreeStart, &outputFilename) )
+  bool useCPU;
+  bool refPull;
+  if(!parseCmdLineSimple(argc, argv, "si-t-d-m-c-p|s", &inputFilename, &sourceVertex
+    , &runTest, &dumpResults, &useMaxOutDegreeStart, &useCPU, &refPull
+    , &outputFilename) )
   {
-    printf("Usage: bfs [-t] [-d] [-m] inputfile source [outputFilename]\n");
+    printf("Usage: bfs [-t] [-d] [-m] [-c] [-p] inputfile source [outputFilename]\n");
     exit(1);
   }
 
-  //load the graph
-  int nVertices;
-  std::vector<int> srcs;
-  std::vector<int> dsts;
-  loadGraph(inputFilename, nVertices, srcs, dsts);
+  //load the graph as CSR, which text files come as from their cache (see
+  //loadGraph_cached), so the engines need not sort the edges again
+  CachedGraph graph;
+  loadGraph_cached(inputFilename, graph);
+  int nVertices = graph.nVertices;
+  int nEdges = graph.nEdges;
+  const int *srcOffsets = graph.csrOffsets;
 
   //initialize vertex data
   std::vector<BFS::VertexData> vertexData(nVertices);
@@ -174,11 +213,6 @@ int main(int argc, char** argv)
 */
   if( useMaxOutDegreeStart )
   {
-    //convert to CSR layout to find source vertex
-    std::vector<int> srcOffsets(nVertices + 1);
-    std::vector<int> csrSrcs(srcs.size());
-    edgeListToCSR<int>(
-      nVertices, srcs.size(), &srcs[0], &dsts[0], &srcOffsets[0], 0, 0);
     int maxDegree = -1;
     sourceVertex = -1;
     for(int i = 0; i < nVertices; ++i)
@@ -197,9 +231,11 @@ int main(int argc, char** argv)
   std::vector<BFS::VertexData> refVertexData;
   if( runTest )
   {
+    //-p runs the reference direction optimizing, to check the bottom-up
+    //path against the top-down GPU engine
     refVertexData = vertexData;
     float elapsed = run<GASEngineRef<BFS>, false>(nVertices
-      , &refVertexData[0], (int)srcs.size(), &srcs[0], &dsts[0], sourceVertex);
+      , &refVertexData[0], nEdges, srcOffsets, graph.csrDsts, sourceVertex, refPull);
     if( dumpResults )
     {
       printf("Reference:\n");
@@ -212,24 +248,25 @@ int main(int argc, char** argv)
   function that executes the graph algorithm.
   true indicates that the code is to be run on GPU.
   false indicates that the code is to be run on CPU.
+  -c selects the multithreaded CPU engine.
 */
-  float elapsed = run<GASEngineGPU<BFS>, true>(nVertices, &vertexData[0]
-    , (int) srcs.size(), &srcs[0], &dsts[0], sourceVertex);
+  float elapsed;
+  if( useCPU )
+    elapsed = run<GASEngineCPU<BFS>, false>(nVertices, &vertexData[0]
+      , nEdges, srcOffsets, graph.csrDsts, sourceVertex);
+  else
+    elapsed = run<GASEngineGPU<BFS>, true>(nVertices, &vertexData[0]
+      , nEdges, srcOffsets, graph.csrDsts, sourceVertex);
 
   // compute stats
   int nodes_visited = 0;
   int edges_visited = 0;
-  std::vector<int> srcOffsets(nVertices + 1);
-  std::vector<int> csrSrcs(srcs.size());
-  edgeListToCSR<int>(
-    nVertices, srcs.size(), &srcs[0], &dsts[0], &srcOffsets[0], 0, 0);
-
   for (int itr = 0; itr < nVertices; ++itr)
   {
     if (vertexData[itr].depth > -1)
     {
       nodes_visited += 1;
-      edges_visited += srcOffsets.at(itr+1) - srcOffsets.at(itr);
+      edges_visited += srcOffsets[itr+1] - srcOffsets[itr];
     }
   }
 
@@ -239,7 +276,7 @@ int main(int argc, char** argv)
 
   if( dumpResults )
   {
-    printf("GPU:\n");
+    printf(useCPU ? "CPU:\n" : "GPU:\n");
     outputDepths(nVertices, &vertexData[0]);
   }
 
@@ -268,6 +305,7 @@ int main(int argc, char** argv)
     fclose(f);
   }
 
+  unmapGraph(graph);
   free(inputFilename);
   free(outputFilename);
 
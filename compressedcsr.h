@@ -0,0 +1,337 @@
+/******************************************************************************
+Copyright 2013 Royal Caliber LLC. (http://www.royal-caliber.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************************/
+
+#ifndef COMPRESSEDCSR_H__
+#define COMPRESSEDCSR_H__
+
+//CSR (or CSC) graphs with compressed neighbor lists.
+//
+//The neighbors of every vertex are sorted and stored as gaps, each gap a
+//little endian base 128 varint: 7 bits per byte, high bit set on all but
+//the last byte.  The first neighbor of a vertex is stored relative to the
+//vertex itself (zigzag coded, so small negative differences stay small),
+//which suits graphs with locality in their numbering such as web crawls.
+//
+//The encoding also restarts every blockSize edges, counted over the whole
+//edge array, and blockOffsets has the byte position of every restart.  A
+//reader can then start at any edge after decoding fewer than blockSize
+//varints, while reading consecutive vertices is a single pass over the
+//bytes.  The offsets are kept uncompressed: they give degrees and edge
+//positions (for edge data) without decoding anything.
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#include "csr.h"
+
+
+//varint coding, values up to 2^32 - 1 take at most 5 bytes
+inline int vbyteSize(uint32_t x)
+{
+  int n = 1;
+  while( x >= 0x80 )
+  {
+    x >>= 7;
+    ++n;
+  }
+  return n;
+}
+
+
+inline void vbyteEncode(uint32_t x, unsigned char *&p)
+{
+  while( x >= 0x80 )
+  {
+    *p++ = (unsigned char)(x | 0x80);
+    x >>= 7;
+  }
+  *p++ = (unsigned char)x;
+}
+
+
+inline uint32_t vbyteDecode(const unsigned char *&p)
+{
+  uint32_t b = *p++;
+  uint32_t x = b & 0x7f;
+  int shift = 7;
+  while( b & 0x80 )
+  {
+    b = *p++;
+    x |= (b & 0x7f) << shift;
+    shift += 7;
+  }
+  return x;
+}
+
+
+inline void vbyteSkip(const unsigned char *&p)
+{
+  while( *p++ & 0x80 )
+    ;
+}
+
+
+//a difference of two vertex ids as an unsigned value, 0, -1, 1, -2, ...
+//map to 0, 1, 2, 3, ...
+inline uint32_t zigzagEncode(int64_t d)
+{
+  return (uint32_t)(d < 0 ? -2 * d - 1 : 2 * d);
+}
+
+
+inline int64_t zigzagDecode(uint32_t z)
+{
+  return (z & 1) ? -(int64_t)(z >> 1) - 1 : (int64_t)(z >> 1);
+}
+
+
+template<typename Int, typename EdgeInt>
+class CompressedCSRReader;
+
+
+//The neighbors of v are edges offsets[v] .. offsets[v+1] - 1 like in a
+//plain CSR, but can only be read through a CompressedCSRReader.
+template<typename Int, typename EdgeInt = Int>
+struct CompressedCSR
+{
+  typedef CompressedCSRReader<Int, EdgeInt> Reader;
+
+  enum { blockShift = 6, blockSize = 1 << blockShift };
+
+  Int                        nVertices;
+  EdgeInt                    nEdges;
+  std::vector<EdgeInt>       offsets;      //nVertices + 1
+  std::vector<int64_t>       blockOffsets; //byte position of edge k * blockSize, and the end
+  std::vector<unsigned char> bytes;
+
+  CompressedCSR() : nVertices(0), nEdges(0) {}
+
+  EdgeInt nBlocks() const
+  {
+    return (nEdges + blockSize - 1) >> blockShift;
+  }
+
+  //memory used by the graph, for comparison with a plain CSR
+  size_t memoryBytes() const
+  {
+    return offsets.size() * sizeof(EdgeInt)
+      + blockOffsets.size() * sizeof(int64_t) + bytes.size();
+  }
+
+  void clear()
+  {
+    nVertices = 0;
+    nEdges = 0;
+    std::vector<EdgeInt>().swap(offsets);
+    std::vector<int64_t>().swap(blockOffsets);
+    std::vector<unsigned char>().swap(bytes);
+  }
+};
+
+
+//Streams the neighbors of a CompressedCSR.  seek() positions the reader at
+//an edge of a vertex and next() returns one neighbor after the other.  A
+//seek to the edge where the previous reads stopped costs nothing, so a
+//loop over consecutive vertices decodes the bytes in a single pass.
+//
+//The interface is shared with the plain CSC reader of the CPU engine's
+//gather kernels (CPUGASKernels::CSCInEdges).
+template<typename Int, typename EdgeInt>
+class CompressedCSRReader
+{
+public:
+  explicit CompressedCSRReader(const CompressedCSR<Int, EdgeInt> &graph)
+    : m_graph(graph)
+    , m_p(0)
+    , m_e(-1)
+    , m_begin(0)
+    , m_v(0)
+    , m_prev(0)
+  {
+  }
+
+  //the next call to next() returns the neighbor at edge e of vertex v,
+  //offsets[v] <= e <= offsets[v + 1]
+  void seek(Int v, EdgeInt e)
+  {
+    m_v = v;
+    m_begin = m_graph.offsets[v];
+    if( e == m_e || e == m_graph.offsets[v + 1] )
+      return;
+
+    //decode from the restart point at or before e, which is either the
+    //start of its block or the first edge of v
+    EdgeInt block = e >> CompressedCSR<Int, EdgeInt>::blockShift;
+    EdgeInt pos = block << CompressedCSR<Int, EdgeInt>::blockShift;
+    m_p = &m_graph.bytes[0] + m_graph.blockOffsets[block];
+    for( ; pos < m_begin; ++pos )
+      vbyteSkip(m_p);
+    m_e = pos;
+    while( m_e < e )
+      next();
+  }
+
+  Int next()
+  {
+    uint32_t x = vbyteDecode(m_p);
+    if( m_e == m_begin || (m_e & (CompressedCSR<Int, EdgeInt>::blockSize - 1)) == 0 )
+      m_prev = (Int)(m_v + zigzagDecode(x));
+    else
+      m_prev += (Int)x;
+    ++m_e;
+    return m_prev;
+  }
+
+private:
+  const CompressedCSR<Int, EdgeInt> &m_graph;
+  const unsigned char *m_p;    //encoding of edge m_e
+  EdgeInt              m_e;
+  EdgeInt              m_begin; //first edge of m_v
+  Int                  m_v;
+  Int                  m_prev;  //neighbor at edge m_e - 1
+};
+
+
+//Helpers for compressCSR() and decompressCSR()
+//Encode the edges of one block, or only count its bytes if out is null.
+//neighbors are the sorted neighbor lists.
+template<typename Int, typename EdgeInt>
+int64_t encodeCSRBlock(Int nVertices, EdgeInt nEdges, const EdgeInt *offsets
+  , const Int *neighbors, EdgeInt block, unsigned char *out)
+{
+  EdgeInt e0 = block << CompressedCSR<Int, EdgeInt>::blockShift;
+  EdgeInt e1 = std::min(nEdges, e0 + (EdgeInt)CompressedCSR<Int, EdgeInt>::blockSize);
+  Int v = (Int)(std::upper_bound(offsets, offsets + nVertices + 1, e0) - offsets) - 1;
+
+  int64_t nBytes = 0;
+  for( EdgeInt e = e0; e < e1; ++e )
+  {
+    while( offsets[v + 1] <= e )
+      ++v;
+    uint32_t x;
+    if( e == e0 || e == offsets[v] )
+      x = zigzagEncode((int64_t)neighbors[e] - v);
+    else
+      x = (uint32_t)(neighbors[e] - neighbors[e - 1]);
+    if( out )
+      vbyteEncode(x, out);
+    else
+      nBytes += vbyteSize(x);
+  }
+  return nBytes;
+}
+
+
+//orders edge positions by neighbor, ties by position
+template<typename Int, typename EdgeInt>
+struct NeighborLess
+{
+  const Int *neighbors;
+
+  NeighborLess(const Int *neighbors) : neighbors(neighbors) {}
+
+  bool operator()(EdgeInt a, EdgeInt b) const
+  {
+    return neighbors[a] < neighbors[b] || (neighbors[a] == neighbors[b] && a < b);
+  }
+};
+
+
+//Compress a CSR (or CSC) graph.  Neighbor lists are sorted, so edges move
+//within their vertex: if order is given it receives the input position of
+//every compressed edge, to put edge data in the same order with
+//data[i] = inputData[order[i]].
+template<typename Int, typename EdgeInt>
+void compressCSR(Int nVertices, typename CSRNoDeduce<EdgeInt>::type nEdges
+  , const EdgeInt *offsets, const Int *neighbors
+  , CompressedCSR<Int, EdgeInt> &out
+  , std::vector<EdgeInt> *order = 0)
+{
+  out.nVertices = nVertices;
+  out.nEdges = nEdges;
+  out.offsets.assign(offsets, offsets + nVertices + 1);
+
+  //sorted neighbor lists
+  std::vector<Int> sorted(nEdges);
+  if( order )
+  {
+    order->resize(nEdges);
+    #pragma omp parallel for schedule(static)
+    for( EdgeInt i = 0; i < nEdges; ++i )
+      (*order)[i] = i;
+    NeighborLess<Int, EdgeInt> less(neighbors);
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for( Int v = 0; v < nVertices; ++v )
+      std::sort(order->begin() + offsets[v], order->begin() + offsets[v + 1], less);
+    #pragma omp parallel for schedule(static)
+    for( EdgeInt i = 0; i < nEdges; ++i )
+      sorted[i] = neighbors[(*order)[i]];
+  }
+  else if( nEdges )
+  {
+    std::copy(neighbors, neighbors + nEdges, sorted.begin());
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for( Int v = 0; v < nVertices; ++v )
+      std::sort(sorted.begin() + offsets[v], sorted.begin() + offsets[v + 1]);
+  }
+
+  //size every block, scan, then encode the blocks in place
+  EdgeInt nBlocks = out.nBlocks();
+  out.blockOffsets.resize(nBlocks + 1);
+  #pragma omp parallel for schedule(static)
+  for( EdgeInt k = 0; k < nBlocks; ++k )
+    out.blockOffsets[k + 1] = encodeCSRBlock(nVertices, (EdgeInt)nEdges, offsets
+      , &sorted[0], k, (unsigned char *)0);
+  out.blockOffsets[0] = 0;
+  for( EdgeInt k = 0; k < nBlocks; ++k )
+    out.blockOffsets[k + 1] += out.blockOffsets[k];
+
+  std::vector<unsigned char>(out.blockOffsets[nBlocks]).swap(out.bytes);
+  #pragma omp parallel for schedule(static)
+  for( EdgeInt k = 0; k < nBlocks; ++k )
+    encodeCSRBlock(nVertices, (EdgeInt)nEdges, offsets, &sorted[0], k
+      , &out.bytes[0] + out.blockOffsets[k]);
+}
+
+
+//Expand the neighbor lists of a compressed graph into neighbors (nEdges
+//entries), giving the plain CSR that goes with graph.offsets.
+template<typename Int, typename EdgeInt>
+void decompressCSR(const CompressedCSR<Int, EdgeInt> &graph, Int *neighbors)
+{
+  EdgeInt nBlocks = graph.nBlocks();
+  #pragma omp parallel for schedule(static)
+  for( EdgeInt k = 0; k < nBlocks; ++k )
+  {
+    EdgeInt e0 = k << CompressedCSR<Int, EdgeInt>::blockShift;
+    EdgeInt e1 = std::min(graph.nEdges, e0 + (EdgeInt)CompressedCSR<Int, EdgeInt>::blockSize);
+    const EdgeInt *offsets = &graph.offsets[0];
+    Int v = (Int)(std::upper_bound(offsets, offsets + graph.nVertices + 1, e0) - offsets) - 1;
+
+    CompressedCSRReader<Int, EdgeInt> reader(graph);
+    for( EdgeInt e = e0; e < e1; ++e )
+    {
+      while( offsets[v + 1] <= e )
+        ++v;
+      reader.seek(v, e);
+      neighbors[e] = reader.next();
+    }
+  }
+}
+
+
+#endif
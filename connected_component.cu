@@ -20,6 +20,8 @@ limitations under the License.
 #include "graphio.h"
 #include "refgas.h"
 #include "gpugas.h"
+#include "cpugas.h"
+#include "asyncgas.h"
 #include <climits>
 
 struct CC
@@ -28,6 +30,10 @@ struct CC
   typedef int VertexData;
   struct EdgeData {};
 
+  //the engines leave out scatter and the edge index, see gastraits.h
+  static const bool hasScatter  = false;
+  static const bool hasEdgeData = false;
+
   typedef int GatherResult;
   static const int gatherZero = INT_MAX;
 
@@ -63,12 +69,25 @@ struct CC
 };
 
 
+//CC has no scatter, so it can use the fused pass of the CPU engine
+template<typename Engine>
+void setFused(Engine &engine)
+{
+}
+
+void setFused(GASEngineCPU<CC> &engine)
+{
+  engine.setFused(true);
+}
+
+
 template<typename Engine>
 void run(int nVertices, CC::VertexData* vertexData, int nEdges
-       , const int* srcs, const int* dsts)
+       , const int* offsets, const int* dsts)
 {
   Engine engine;
-  engine.setGraph(nVertices, vertexData, nEdges, 0, srcs, dsts);
+  engine.setGraphCSR(nVertices, vertexData, nEdges, 0, offsets, dsts);
+  setFused(engine);
 
   //TODO, setting all vertices to active for first step works, but it would
   //be faster to instead set to neighbors of starting vertex
@@ -94,19 +113,23 @@ int main(int argc, char** argv)
   char *outputFilename = 0;
   bool runTest;
   bool dumpResults;
-  if( !parseCmdLineSimple(argc, argv, "s-t-d|s", &inputFilename
-                        , &runTest, &dumpResults, &outputFilename) )
+  bool useCPU;
+  bool useAsync;
+  if( !parseCmdLineSimple(argc, argv, "s-t-d-c-a|s", &inputFilename
+                        , &runTest, &dumpResults, &useCPU, &useAsync
+                        , &outputFilename) )
   {
-    printf("Usage: cc [-t] [-d] inputfile source [outputfile]\n");
+    printf("Usage: cc [-t] [-d] [-c] [-a] inputfile source [outputfile]\n");
     exit(1);
   }
 
-  //load the graph
-  int nVertices;
-  std::vector<int> srcs;
-  std::vector<int> dsts;
-  loadGraph(inputFilename, nVertices, srcs, dsts);
-  printf("loaded %s with %d vertices and %zd edges\n", inputFilename, nVertices, srcs.size());
+  //load the graph as CSR, which text files come as from their cache (see
+  //loadGraph_cached), so the engines need not sort the edges again
+  CachedGraph graph;
+  loadGraph_cached(inputFilename, graph);
+  int nVertices = graph.nVertices;
+  int nEdges = graph.nEdges;
+  printf("loaded %s with %d vertices and %d edges\n", inputFilename, nVertices, nEdges);
 
   //initialize vertex data
   std::vector<int> vertexData(nVertices);
@@ -119,8 +142,8 @@ int main(int argc, char** argv)
   {
     printf("Running reference calculation\n");
     refVertexData = vertexData;
-    run< GASEngineRef<CC> >(nVertices, &refVertexData[0], (int)srcs.size()
-                          , &srcs[0], &dsts[0]);
+    run< GASEngineRef<CC> >(nVertices, &refVertexData[0], nEdges
+                          , graph.csrOffsets, graph.csrDsts);
     if( dumpResults )
     {
       printf("Reference:\n");
@@ -128,11 +151,20 @@ int main(int argc, char** argv)
     }
   }
 
-  run< GASEngineGPU<CC> >(nVertices, &vertexData[0], (int)srcs.size()
-                          , &srcs[0], &dsts[0]);
+  //-c runs the multithreaded CPU engine in place of the GPU one,
+  //-a the asynchronous CPU engine
+  if( useAsync )
+    run< GASEngineAsync<CC> >(nVertices, &vertexData[0], nEdges
+                            , graph.csrOffsets, graph.csrDsts);
+  else if( useCPU )
+    run< GASEngineCPU<CC> >(nVertices, &vertexData[0], nEdges
+                          , graph.csrOffsets, graph.csrDsts);
+  else
+    run< GASEngineGPU<CC> >(nVertices, &vertexData[0], nEdges
+                          , graph.csrOffsets, graph.csrDsts);
   if( dumpResults )
   {
-    printf("GPU:\n");
+    printf(useAsync ? "Async:\n" : useCPU ? "CPU:\n" : "GPU:\n");
     outputLabels(nVertices, &vertexData[0]);
   }
 
@@ -161,6 +193,7 @@ int main(int argc, char** argv)
     fclose(f);
   }
 
+  unmapGraph(graph);
   free(inputFilename);
   free(outputFilename);
 
@@ -0,0 +1,1841 @@
+/******************************************************************************
+Copyright 2013 Royal Caliber LLC. (http://www.royal-caliber.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************************/
+
+#ifndef CPUGAS_H__
+#define CPUGAS_H__
+
+/*
+Multithreaded CPU implementation of the GAS API.
+
+This has the same interface as GASEngineRef and GASEngineGPU, so the example
+programs can switch between engines by changing a template argument.  Unlike
+GASEngineRef, this is meant for production use on many-core hosts without GPUs.
+
+Implementation Notes:
+-  threading is done with OpenMP.  All phases run on every core.
+
+-  gather and scatter are load balanced by edge count rather than by vertex
+   count.  We scan the degrees of the active vertices and then split the
+   vertices + edges work sequence into equal chunks per thread with a host
+   version of the merge path / load balancing search that the GPU gets from
+   mgpu (see cpugas_kernels.h).  Chunks can split a vertex, so a single hub
+   is shared by several threads instead of stalling one of them.  Partial
+   gather results at chunk boundaries are combined with gatherReduce in a
+   short serial fixup (segmented reduction).
+
+-  the next frontier is a Frontier (frontier.h) rather than an O(V) flag
+   array.  Small frontiers are kept as per-thread queues, large ones as a
+   bitmap, so the per-iteration cost of building the next active list tracks
+   the frontier size rather than the graph size.  The switch-over point is
+   set with setFrontierThreshold().
+
+-  with setDirectionOptimizing(), activation without a scatter switches
+   between top-down push from the frontier and bottom-up pull into vertices
+   that can still be activated (Program::canActivate, see gastraits.h).
+
+-  setFused() turns on a fused execution mode where gather, apply and
+   activation happen in a single pass per chunk, so the O(active)
+   gather result and apply return arrays are never written or read back.
+   Bulk synchronous semantics are kept by double buffering: apply writes to
+   a shadow copy of the vertex data, which is committed at the end of the
+   pass.  Only programs that tolerate it should use this: scatter sees the
+   source after apply but the destination before its own apply, and
+   activation is not load balanced by out-degree.
+
+-  setDeltaStepping() replaces the activation step with delta stepping for
+   programs like SSSP.  Vertices changed by apply are binned by
+   Program::priority / delta, and only the lowest bucket relaxes its
+   out-edges: first light edges (Program::edgeWeight <= delta) until the
+   bucket stops changing, then heavy edges once.  gather and apply are
+   unchanged; the next active list is just the targets of the relaxed edges.
+
+-  setNuma() places the graph for multi-socket hosts (see numa.h).  Vertices
+   are split into one contiguous range per node, balanced by in-edges, and
+   each node's threads are pinned to its cpus and first-touch that range's
+   CSC and CSR slices and vertex data, which is copied from the caller's
+   array and copied back by getResults().  The calling thread gets its own
+   affinity mask back once the pages are placed.  Active lists are split at node
+   boundaries before load balancing, so a vertex is always gathered and
+   applied by a thread of the node that owns it.  With counting on, gather
+   also tallies local and remote reads of source vertex data.
+
+-  setGraphCSR() and setGraphCSC() take a graph that is already in CSR or
+   CSC form without copying it.  The given arrays and edge data are used in
+   place, so that side has no edge data index.  A .gr file mapped with
+   mapGraph_binaryCSR (graphio.h) only needs its offsets converted first.  The other side is built by
+   transposition the first time a phase needs it.
+
+-  setCompressed() keeps the in-edges that gather reads as delta + varint
+   coded neighbor lists (compressedcsr.h) instead of a plain CSC, and
+   setGraphCompressedCSC() takes a graph that is compressed already.  The
+   gather kernels decode the lists as they go; a partition of consecutive
+   active vertices is one pass over the bytes.  Bottom-up activation needs
+   plain in-edges, which are decoded once when first needed.
+
+-  setVertexOrder() renumbers the vertices inside the engine (reorder.h) so
+   that gathers read nearby vertex data.  The graph is copied in the new
+   numbering, also by setGraphCSR() and setGraphCSC(), and the vertex data
+   into an engine copy; vertex ids in setActive() and the vertex data from
+   getResults() stay in the caller's numbering.
+
+-  setGatherCache() keeps the gather result of every vertex for programs
+   with Program::postDelta (gastraits.h), like GASEngineRef.  Every thread
+   owns a range of vertices; scatter reduces deltas for its own vertices
+   into their cached results and buffers the others by owner, which
+   reduces them after a barrier.  Active vertices with a cached result get
+   zero edges in the gather partitioning.  Not combined with the fused pass
+   or delta stepping.
+
+-  programs can declare that they have no gather, scatter or edge data
+   (hasGather, hasScatter, hasEdgeData in gastraits.h).  Those phases are
+   then skipped whatever gather() or scatterActivate() are told, and
+   without edge data no edge index is built on either side, as if the edge
+   data were in CSC and CSR order at once.
+
+-  setSortedEdgeData() keeps the edge data in a copy sorted into CSC order,
+   so gather reads it next to the in-edges rather than through the CSC
+   edge index, which is dropped.  The CSR edge index is mapped to the copy
+   for scatter, delta stepping and posted deltas.  For programs with a
+   scatter the caller's order of the copy is kept too, and getResults()
+   writes the edge data back; without one the copy never changes.
+
+-  setGatherBlocking() is the cache blocked gather of GASEngineRef: the
+   in-edges are split by source segment, and gather makes one parallel
+   pass per segment, each thread adding to the results of whole runs of a
+   destination.  It is used when at least a quarter of the vertices are
+   active and the gather cache, compression and NUMA placement are off,
+   in place of the fused pass too.
+
+-  programs that declare a GatherReduction (gastraits.h) are gathered from
+   dense arrays of gatherSource per vertex and gatherEdge per CSC edge
+   with the kernels of gathersimd.h, in gather() and in the fused pass.
+   The source terms are rebuilt from the vertex data at every gather, so
+   this is done when at least a quarter of the vertices are active and
+   compression and NUMA placement are off.  The edge terms are kept until
+   the next setGraph* or scatter, so edge data the caller changes in
+   between iterations is not seen.  setVectorGather(false) turns it off.
+*/
+
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "util.cuh"
+#include "compressedcsr.h"
+#include "reorder.h"
+#include "cpugas_kernels.h"
+#include "frontier.h"
+#include "numa.h"
+
+
+template<typename Program
+  , typename Int = int32_t>
+class GASEngineCPU
+{
+public:
+  typedef typename Program::VertexData   VertexData;
+  typedef typename Program::EdgeData     EdgeData;
+  typedef typename Program::GatherResult GatherResult;
+
+private:
+  typedef GASTraits::Phases<Program>       Phases;
+  typedef GASTraits::VectorGather<Program> VectorGather;
+  typedef GASTraits::GatherEdge<Program>   GatherEdge;
+
+  Int         m_nVertices;
+  Int         m_nEdges;
+  VertexData *m_vertexData;
+  EdgeData   *m_edgeData;
+
+  //CSC representation for gather phase
+  Int *m_srcs;
+  Int *m_srcOffsets;
+  Int *m_edgeIndexCSC;
+  bool m_borrowedCSC; //m_srcs and m_srcOffsets belong to the caller
+
+  //compressed CSC for gather, m_srcOffsets then points at its offsets and
+  //m_srcs is only allocated if something needs plain in-edges
+  bool                      m_compress;
+  const CompressedCSR<Int> *m_compressedCSC;
+  CompressedCSR<Int>        m_ownCompressedCSC;
+
+  //CSR representation for scatter phase
+  Int *m_dsts;
+  Int *m_dstOffsets;
+  Int *m_edgeIndexCSR;
+  bool m_borrowedCSR; //m_dsts and m_dstOffsets belong to the caller
+
+  //Active vertex list and per-active-vertex temporaries
+  Int          *m_active;
+  Int           m_nActive;
+  Int          *m_applyRet;
+  GatherResult *m_gatherResults;
+  Frontier<Int> m_frontier;
+
+  //direction optimizing traversal
+  bool               m_directionOptimizing;
+  DirectionHeuristic m_direction;
+  char              *m_pullSources; //O(V) flags of vertices activating their nbd
+
+  //fused gather/apply/scatter
+  bool          m_fused;
+  VertexData   *m_vertexDataNext; //O(V) shadow written by apply in fused mode
+  GatherResult *m_tail;           //partial result of a vertex running past
+  Int          *m_tailVertex;     //the end of a chunk, one per thread
+
+  //load balancing
+  int  m_nThreads;
+  Int *m_edgeCountScan;    //O(V) exclusive scan of active vertex degrees
+  Int *m_vertexPartitions; //m_nThreads + 1 merge path splits, vertex part
+  Int *m_edgePartitions;   //m_nThreads + 1 merge path splits, edge part
+  Int *m_threadCounts;     //m_nThreads + 1 scratch for scans and compaction
+
+  //carry-out of partitions that begin in the middle of a vertex
+  GatherResult *m_carry;
+  Int          *m_carryVertex;
+
+  //delta stepping
+  bool              m_deltaStepping;
+  double            m_delta;
+  DeltaBuckets<Int> m_buckets;
+  std::vector<Int>  m_relaxSources; //light phase sources of one step
+  std::vector<Int>  m_settled;      //all light sources of the bucket
+
+  //NUMA placement
+  bool                 m_numa;
+  bool                 m_numaCount;
+  bool                 m_numaPlaced;      //current graph was placed by numaAlloc
+  int                  m_nNodes;
+  std::vector<Int>     m_nodeVertexBegin; //m_nNodes + 1 vertex range splits
+  std::vector<int>     m_nodeThreadBegin; //m_nNodes + 1 thread range splits
+  std::vector<int>     m_threadNode;
+  VertexData          *m_userVertexData;  //caller's array in NUMA mode
+  std::vector<int64_t> m_localReads;      //per thread
+  std::vector<int64_t> m_remoteReads;
+
+  //gather cache
+  typedef CPUGASKernels::DeltaPost<Int, GatherResult> DeltaPost;
+  bool                  m_gatherCache;
+  GatherResult         *m_cachedResults; //O(V)
+  char                 *m_cacheValid;    //O(V)
+  Int                  *m_cacheMiss;     //per active vertex, gather predicate
+  std::vector< std::vector<DeltaPost> > m_deltaPosts; //by poster * m_nThreads + owner
+
+  //vertex order, caller's vertex v is m_newId[v] in the engine
+  std::vector<Int>     m_newId;
+  VertexData          *m_unorderedVertexData; //caller's array, if renumbered
+
+  //cache blocked gather, as in GASEngineRef: segment s has the runs
+  //m_blockSegments[s] .. m_blockSegments[s+1] - 1, run r the in-edges of
+  //m_blockDsts[r] from that segment, edges m_blockOffsets[r] ..
+  //m_blockOffsets[r+1] - 1, edge data at m_blockEdgeIndex if there is any
+  Int                  m_blockVertices; //0 if off
+  std::vector<Int>     m_blockSegments;
+  std::vector<Int>     m_blockDsts;
+  std::vector<Int>     m_blockOffsets;
+  std::vector<Int>     m_blockSrcs;
+  std::vector<Int>     m_blockEdgeIndex;
+  std::vector<Int>     m_activeSlot; //position in m_active, or -1
+
+  //dense gather terms for the kernels of gathersimd.h, see setVectorGather
+  bool                 m_vectorGather;
+  GatherResult        *m_gatherSource; //O(V), rebuilt by every gather
+  GatherResult        *m_gatherEdge;   //O(E) in CSC order, null until needed
+
+  //edge data sorted into CSC order
+  bool                 m_sortEdgeData;
+  EdgeData            *m_userEdgeData;  //caller's array, if sorted
+  Int                 *m_userEdgeIndex; //caller's position of every CSC edge,
+                                        //for getResults, if scatter can write
+
+
+  //n elements of T, aborts if they cannot be allocated
+  template<typename T>
+  void cpuAlloc(T* &p, size_t n)
+  {
+    p = n <= (size_t)-1 / sizeof(T) ? (T *) malloc(sizeof(T) * n) : 0;
+    if( n && !p )
+    {
+      printf("GASEngineCPU: unable to allocate %lu elements of %lu bytes\n"
+        , (unsigned long)n, (unsigned long)sizeof(T));
+      abort();
+    }
+  }
+
+  void cpuFree(void *ptr)
+  {
+    if( ptr )
+      free(ptr);
+  }
+
+  void release()
+  {
+    if( m_compressedCSC )
+      cpuFree(m_srcs);
+    else if( !m_borrowedCSC )
+    {
+      cpuFree(m_srcs);
+      cpuFree(m_srcOffsets);
+    }
+    m_compressedCSC = 0;
+    m_ownCompressedCSC.clear();
+    cpuFree(m_edgeIndexCSC);
+    if( !m_borrowedCSR )
+    {
+      cpuFree(m_dsts);
+      cpuFree(m_dstOffsets);
+    }
+    cpuFree(m_edgeIndexCSR);
+    cpuFree(m_active);
+    cpuFree(m_applyRet);
+    cpuFree(m_gatherResults);
+    cpuFree(m_pullSources);
+    cpuFree(m_vertexDataNext);
+    cpuFree(m_tail);
+    cpuFree(m_tailVertex);
+    cpuFree(m_edgeCountScan);
+    cpuFree(m_vertexPartitions);
+    cpuFree(m_edgePartitions);
+    cpuFree(m_threadCounts);
+    cpuFree(m_carry);
+    cpuFree(m_carryVertex);
+    cpuFree(m_cachedResults);
+    cpuFree(m_cacheValid);
+    cpuFree(m_cacheMiss);
+    cpuFree(m_gatherSource);
+    cpuFree(m_gatherEdge);
+    m_gatherSource = 0;
+    m_gatherEdge = 0;
+    m_cachedResults = 0;
+    m_cacheValid = 0;
+    m_cacheMiss = 0;
+    m_srcs = m_srcOffsets = m_edgeIndexCSC = 0;
+    m_dsts = m_dstOffsets = m_edgeIndexCSR = 0;
+    m_active = m_applyRet = m_edgeCountScan = 0;
+    m_vertexPartitions = m_edgePartitions = m_threadCounts = 0;
+    m_carryVertex = 0;
+    m_gatherResults = m_carry = 0;
+    m_pullSources = 0;
+    m_vertexDataNext = 0;
+    m_tail = 0;
+    m_tailVertex = 0;
+    m_borrowedCSR = false;
+    m_borrowedCSC = false;
+    m_numaPlaced  = false;
+    if( m_userVertexData )
+    {
+      cpuFree(m_vertexData);
+      m_vertexData = m_userVertexData;
+      m_userVertexData = 0;
+    }
+    if( m_unorderedVertexData )
+    {
+      cpuFree(m_vertexData);
+      m_vertexData = m_unorderedVertexData;
+      m_unorderedVertexData = 0;
+    }
+    if( m_userEdgeData )
+    {
+      cpuFree(m_edgeData);
+      m_edgeData = m_userEdgeData;
+      m_userEdgeData = 0;
+    }
+    cpuFree(m_userEdgeIndex);
+    m_userEdgeIndex = 0;
+    clearBlockedCSC();
+  }
+
+
+  //With a vertex order set, the engine works on a renumbered copy of the
+  //vertex data, which NUMA placement then copies again.
+  void orderVertexData()
+  {
+    if( m_newId.empty() )
+      return;
+    if( (Int)m_newId.size() != m_nVertices )
+    {
+      printf("GASEngineCPU: vertex order for %ld vertices, graph has %ld\n"
+        , (long)m_newId.size(), (long)m_nVertices);
+      exit(1);
+    }
+    VertexData *ordered;
+    cpuAlloc(ordered, m_nVertices);
+    #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+    for( Int v = 0; v < m_nVertices; ++v )
+      ordered[m_newId[v]] = m_vertexData[v];
+    m_unorderedVertexData = m_vertexData;
+    m_vertexData = ordered;
+  }
+
+
+  //a CSR or CSC given to setGraphCSR or setGraphCSC, copied in the
+  //engine's numbering with an edge index to the caller's edge data order
+  void orderCSR(const Int *offsets, const Int *verts
+    , Int *&outOffsets, Int *&outVerts, Int *&outEdgeIndex)
+  {
+    cpuAlloc(outOffsets, m_nVertices + 1);
+    cpuAlloc(outVerts, m_nEdges);
+    allocEdgeIndex(outEdgeIndex);
+    permuteCSR(m_nVertices, m_nEdges, offsets, verts, &m_newId[0]
+      , outOffsets, outVerts, outEdgeIndex);
+  }
+
+
+  bool useGatherCache() const
+  {
+    return m_gatherCache && !m_fused && !m_deltaStepping;
+  }
+
+
+  bool useBlockedGather() const
+  {
+    return m_blockVertices && !useGatherCache() && !m_compressedCSC
+      && !m_numaPlaced && (int64_t)m_nActive * 4 >= (int64_t)m_nVertices;
+  }
+
+
+  //The gather terms are rebuilt for every gather, so like blocking this only
+  //pays off when a good part of the vertices are active.
+  bool useVectorGather() const
+  {
+    return VectorGather::enabled && m_vectorGather && !m_compressedCSC
+      && !m_numaPlaced && (int64_t)m_nActive * 4 >= (int64_t)m_nVertices;
+  }
+
+
+  //gatherSource of every vertex, and gatherEdge of every in-edge unless it
+  //is still there from an earlier gather
+  void needGatherTerms()
+  {
+    if( !m_gatherSource )
+      cpuAlloc(m_gatherSource, m_nVertices);
+    #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+    for( Int v = 0; v < m_nVertices; ++v )
+      m_gatherSource[v] = VectorGather::gatherSource(m_vertexData + v);
+
+    if( GatherEdge::enabled && !m_gatherEdge )
+    {
+      cpuAlloc(m_gatherEdge, m_nEdges);
+      #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+      for( Int ie = 0; ie < m_nEdges; ++ie )
+        m_gatherEdge[ie] = GatherEdge::gatherEdge(m_edgeData
+          + (m_edgeIndexCSC ? m_edgeIndexCSC[ie] : ie));
+    }
+  }
+
+
+  //scatter may change the edge data the edge terms were made from
+  void clearGatherEdge()
+  {
+    cpuFree(m_gatherEdge);
+    m_gatherEdge = 0;
+  }
+
+
+  //the gather terms for the gather kernels, null if not used
+  const CPUGASKernels::GatherTerms<GatherResult> *gatherTerms(
+    CPUGASKernels::GatherTerms<GatherResult> &terms)
+  {
+    if( !useVectorGather() )
+      return 0;
+    needGatherTerms();
+    terms.source = m_gatherSource;
+    terms.edge   = m_gatherEdge;
+    return &terms;
+  }
+
+
+  void clearBlockedCSC()
+  {
+    std::vector<Int>().swap(m_blockSegments);
+    std::vector<Int>().swap(m_blockDsts);
+    std::vector<Int>().swap(m_blockOffsets);
+    std::vector<Int>().swap(m_blockSrcs);
+    std::vector<Int>().swap(m_blockEdgeIndex);
+  }
+
+
+  //Split the CSC by source segment.  Transposing the CSC with the segment
+  //of every edge's source as its key keeps the edges of a segment in
+  //destination order, and runs are cut where the destination changes.
+  void needBlockedCSC()
+  {
+    if( !m_blockSegments.empty() )
+      return;
+    needCSC();
+    Int nSegments = (m_nVertices + m_blockVertices - 1) / m_blockVertices;
+    std::vector<Int> segment(m_nEdges);
+    #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+    for( Int ie = 0; ie < m_nEdges; ++ie )
+      segment[ie] = m_srcs[ie] / m_blockVertices;
+
+    std::vector<Int> segmentStart(m_nVertices + 1);
+    std::vector<Int> edgeDsts(m_nEdges);
+    std::vector<Int> cscPosition(m_nEdges);
+    transposeCSR<Int, Int>(m_nVertices, m_nEdges, m_srcOffsets
+      , m_nEdges ? &segment[0] : 0, &segmentStart[0]
+      , m_nEdges ? &edgeDsts[0] : 0, m_nEdges ? &cscPosition[0] : 0);
+
+    bool edgeData = m_edgeData && Phases::hasEdgeData;
+    m_blockSrcs.resize(m_nEdges);
+    m_blockEdgeIndex.resize(edgeData ? m_nEdges : 0);
+    #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+    for( Int pos = 0; pos < m_nEdges; ++pos )
+    {
+      Int ie = cscPosition[pos];
+      m_blockSrcs[pos] = m_srcs[ie];
+      if( edgeData )
+        m_blockEdgeIndex[pos] = m_edgeIndexCSC ? m_edgeIndexCSC[ie] : ie;
+    }
+
+    m_blockSegments.assign(1, 0);
+    m_blockDsts.clear();
+    m_blockOffsets.clear();
+    for( Int s = 0; s < nSegments; ++s )
+    {
+      for( Int ie = segmentStart[s]; ie < segmentStart[s + 1]; ++ie )
+      {
+        if( ie == segmentStart[s] || edgeDsts[ie] != edgeDsts[ie - 1] )
+        {
+          m_blockDsts.push_back(edgeDsts[ie]);
+          m_blockOffsets.push_back(ie);
+        }
+      }
+      m_blockSegments.push_back((Int)m_blockDsts.size());
+    }
+    m_blockOffsets.push_back(m_nEdges);
+  }
+
+
+  //gather a segment at a time, see setGatherBlocking.  The runs of a
+  //segment have distinct destinations, so threads never share a result.
+  void blockedGather()
+  {
+    needBlockedCSC();
+    //with every vertex active, vertex v is in slot v
+    bool allActive = m_nActive == m_nVertices;
+    if( !allActive )
+      m_activeSlot.assign(m_nVertices, -1);
+    #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+    for( Int i = 0; i < m_nActive; ++i )
+    {
+      if( !allActive )
+        m_activeSlot[m_active[i]] = i;
+      m_gatherResults[i] = Program::gatherZero;
+    }
+
+    bool edgeData = !m_blockEdgeIndex.empty();
+    for( size_t s = 0; s + 1 < m_blockSegments.size(); ++s )
+    {
+      #pragma omp parallel for num_threads(m_nThreads) schedule(dynamic, 256)
+      for( Int r = m_blockSegments[s]; r < m_blockSegments[s + 1]; ++r )
+      {
+        Int dv = m_blockDsts[r];
+        Int i  = allActive ? dv : m_activeSlot[dv];
+        if( i < 0 )
+          continue;
+        GatherResult sum = m_gatherResults[i];
+        for( Int ie = m_blockOffsets[r]; ie < m_blockOffsets[r + 1]; ++ie )
+        {
+          GatherResult tmp = Program::gatherMap(m_vertexData + dv
+            , m_vertexData + m_blockSrcs[ie]
+            , edgeData ? m_edgeData + m_blockEdgeIndex[ie] : m_edgeData);
+          sum = Program::gatherReduce(sum, tmp);
+        }
+        m_gatherResults[i] = sum;
+      }
+    }
+  }
+
+
+  void needGatherCache()
+  {
+    if( m_cacheValid )
+      return;
+    cpuAlloc(m_cachedResults, m_nVertices);
+    cpuAlloc(m_cacheValid, m_nVertices);
+    cpuAlloc(m_cacheMiss, m_nVertices);
+    clearGatherCache();
+  }
+
+
+  void clearGatherCache()
+  {
+    if( !m_cacheValid )
+      return;
+    #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+    for( Int v = 0; v < m_nVertices; ++v )
+      m_cacheValid[v] = 0;
+  }
+
+
+  //reduce the deltas other threads posted to thread tid's vertices, in
+  //poster order
+  void reduceDeltas(int tid)
+  {
+    for( int t = 0; t < m_nThreads; ++t )
+    {
+      std::vector<DeltaPost> &posts = m_deltaPosts[t * m_nThreads + tid];
+      for( size_t k = 0; k < posts.size(); ++k )
+        CPUGASKernels::reduceDelta<Program>(posts[k], m_cachedResults, m_cacheValid);
+      posts.clear();
+    }
+  }
+
+
+  //an edge index of m_nEdges entries, or none for programs without edge
+  //data
+  void allocEdgeIndex(Int *&edgeIndex)
+  {
+    edgeIndex = 0;
+    if( Phases::hasEdgeData )
+      cpuAlloc(edgeIndex, m_nEdges);
+  }
+
+
+  //An edge index built by transposition holds positions on the other side,
+  //which go to edge data through that side's index, if it has one.
+  void composeEdgeIndex(Int *edgeIndex, const Int *otherIndex)
+  {
+    if( !edgeIndex || !otherIndex )
+      return;
+    #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+    for( Int i = 0; i < m_nEdges; ++i )
+      edgeIndex[i] = otherIndex[edgeIndex[i]];
+  }
+
+
+  //Allocate the CSR and CSC arrays and a copy of the vertex data, with
+  //every node's share first touched by that node's threads so the pages end
+  //up there.  The arrays are filled in afterwards as usual.
+  void numaAlloc(const Int *edgeListSrcs, const Int *edgeListDsts)
+  {
+    NumaTopology topology;
+    m_nNodes = std::min(topology.nNodes(), m_nThreads);
+
+    //degrees, to know where every vertex's edges will be, counted in
+    //parallel as the CSR builders do
+    std::vector<Int> inOffsets(m_nVertices + 1);
+    std::vector<Int> outOffsets(m_nVertices + 1);
+    {
+      CSRBins<Int, Int> bins(m_nVertices, m_nEdges);
+      countCSRBins(edgeListDsts, &inOffsets[0], bins);
+    }
+    {
+      CSRBins<Int, Int> bins(m_nVertices, m_nEdges);
+      countCSRBins(edgeListSrcs, &outOffsets[0], bins);
+    }
+
+    //node ranges of equal gather work, vertices + in-edges
+    m_nodeVertexBegin.resize(m_nNodes + 1);
+    m_nodeThreadBegin.resize(m_nNodes + 1);
+    m_threadNode.resize(m_nThreads);
+    int64_t total = (int64_t)m_nVertices + m_nEdges;
+    for( int n = 0; n <= m_nNodes; ++n )
+    {
+      int64_t target = total * n / m_nNodes;
+      Int begin = 0;
+      Int end   = m_nVertices;
+      while( begin < end )
+      {
+        Int mid = begin + (end - begin) / 2;
+        if( (int64_t)inOffsets[mid] + mid < target )
+          begin = mid + 1;
+        else
+          end = mid;
+      }
+      m_nodeVertexBegin[n] = begin;
+      m_nodeThreadBegin[n] = (int)(((int64_t)n * m_nThreads + m_nNodes - 1) / m_nNodes);
+    }
+    for( int t = 0; t < m_nThreads; ++t )
+      m_threadNode[t] = topology.threadNode(t, m_nThreads);
+    m_localReads.assign(m_nThreads, 0);
+    m_remoteReads.assign(m_nThreads, 0);
+
+    cpuAlloc(m_dstOffsets, m_nVertices + 1);
+    cpuAlloc(m_dsts, m_nEdges);
+    allocEdgeIndex(m_edgeIndexCSR);
+    cpuAlloc(m_srcOffsets, m_nVertices + 1);
+    cpuAlloc(m_srcs, m_nEdges);
+    allocEdgeIndex(m_edgeIndexCSC);
+    VertexData *localVertexData;
+    cpuAlloc(localVertexData, m_nVertices);
+
+    //thread 0 is the caller's own thread, which gets its mask back below so
+    //that the rest of the program is not left on one cpu
+    SavedAffinity callerAffinity;
+    #pragma omp parallel num_threads(m_nThreads)
+    {
+      int tid = omp_get_thread_num();
+      pinThreadToCpu(topology.threadCpu(tid, m_nThreads));
+
+      //this thread's share of its node's vertices
+      int node = m_threadNode[tid];
+      int nNodeThreads = m_nodeThreadBegin[node + 1] - m_nodeThreadBegin[node];
+      int rank = tid - m_nodeThreadBegin[node];
+      Int nodeBegin = m_nodeVertexBegin[node];
+      Int nodeSize  = m_nodeVertexBegin[node + 1] - nodeBegin;
+      Int vb = nodeBegin + (Int)((int64_t)nodeSize * rank / nNodeThreads);
+      Int ve = nodeBegin + (Int)((int64_t)nodeSize * (rank + 1) / nNodeThreads);
+      Int offsetsEnd = ve == m_nVertices ? ve + 1 : ve;
+
+      memset(m_srcOffsets + vb, 0, sizeof(Int) * (offsetsEnd - vb));
+      memset(m_dstOffsets + vb, 0, sizeof(Int) * (offsetsEnd - vb));
+      memset(m_srcs + inOffsets[vb], 0, sizeof(Int) * (inOffsets[ve] - inOffsets[vb]));
+      memset(m_dsts + outOffsets[vb], 0, sizeof(Int) * (outOffsets[ve] - outOffsets[vb]));
+      if( Phases::hasEdgeData )
+      {
+        memset(m_edgeIndexCSC + inOffsets[vb], 0, sizeof(Int) * (inOffsets[ve] - inOffsets[vb]));
+        memset(m_edgeIndexCSR + outOffsets[vb], 0, sizeof(Int) * (outOffsets[ve] - outOffsets[vb]));
+      }
+      for( Int v = vb; v < ve; ++v )
+        localVertexData[v] = m_vertexData[v];
+    }
+    callerAffinity.restore();
+
+    m_userVertexData = m_vertexData;
+    m_vertexData     = localVertexData;
+    m_numaPlaced     = true;
+  }
+
+
+  //Per-vertex and per-thread work arrays, once the graph is in place
+  void allocWorkspace()
+  {
+    cpuAlloc(m_active, m_nVertices);
+    cpuAlloc(m_applyRet, m_nVertices);
+    cpuAlloc(m_gatherResults, m_nVertices);
+    cpuAlloc(m_edgeCountScan, m_nVertices + 1);
+    cpuAlloc(m_vertexPartitions, m_nThreads + 1);
+    cpuAlloc(m_edgePartitions, m_nThreads + 1);
+    cpuAlloc(m_threadCounts, m_nThreads + 1);
+    cpuAlloc(m_carry, m_nThreads);
+    cpuAlloc(m_carryVertex, m_nThreads);
+    cpuAlloc(m_tail, m_nThreads);
+    cpuAlloc(m_tailVertex, m_nThreads);
+    m_nActive = 0;
+
+    m_frontier.init(m_nVertices, m_nThreads);
+
+    cpuAlloc(m_pullSources, m_nVertices);
+    #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+    for( Int i = 0; i < m_nVertices; ++i )
+      m_pullSources[i] = 0;
+  }
+
+
+  //A graph given to setGraphCSR or setGraphCSC has only that side until a
+  //phase needs the other one, which is then built by transposition.  The
+  //given side is in edge data order unless the vertices were renumbered,
+  //so the new edge index is usually just the position on that side.
+  void needCSC()
+  {
+    if( m_compressedCSC )
+    {
+      if( !m_srcs )
+      {
+        cpuAlloc(m_srcs, m_nEdges);
+        decompressCSR(*m_compressedCSC, m_srcs);
+      }
+      return;
+    }
+    if( m_srcOffsets )
+      return;
+    cpuAlloc(m_srcOffsets, m_nVertices + 1);
+    cpuAlloc(m_srcs, m_nEdges);
+    allocEdgeIndex(m_edgeIndexCSC);
+    transposeCSR(m_nVertices, m_nEdges, m_dstOffsets, m_dsts
+      , m_srcOffsets, m_srcs, m_edgeIndexCSC);
+    composeEdgeIndex(m_edgeIndexCSC, m_edgeIndexCSR);
+  }
+
+
+  void needCSR()
+  {
+    if( m_dstOffsets )
+      return;
+    cpuAlloc(m_dstOffsets, m_nVertices + 1);
+    cpuAlloc(m_dsts, m_nEdges);
+    allocEdgeIndex(m_edgeIndexCSR);
+    if( m_compressedCSC && !m_srcs )
+    {
+      //transpose from a temporary plain copy
+      std::vector<Int> srcs(m_nEdges);
+      if( m_nEdges )
+        decompressCSR(*m_compressedCSC, &srcs[0]);
+      transposeCSR(m_nVertices, m_nEdges, m_srcOffsets, m_nEdges ? &srcs[0] : 0
+        , m_dstOffsets, m_dsts, m_edgeIndexCSR);
+    }
+    else
+      transposeCSR(m_nVertices, m_nEdges, m_srcOffsets, m_srcs
+        , m_dstOffsets, m_dsts, m_edgeIndexCSR);
+    composeEdgeIndex(m_edgeIndexCSR, m_edgeIndexCSC);
+  }
+
+
+  //The in-edges gather reads, compressed in setCompressed mode.  Sorting
+  //the neighbor lists moves edges within their vertex, which the edge
+  //data index follows; without edge data the index is dropped.
+  void needGatherCSC()
+  {
+    if( m_compressedCSC )
+      return;
+    needCSC();
+    if( !m_compress || m_borrowedCSC || m_numaPlaced )
+      return;
+
+    std::vector<Int> order;
+    bool edgeData = m_edgeData && Phases::hasEdgeData;
+    compressCSR(m_nVertices, m_nEdges, m_srcOffsets, m_srcs
+      , m_ownCompressedCSC, edgeData ? &order : 0);
+    if( edgeData )
+    {
+      if( !m_edgeIndexCSC )
+        cpuAlloc(m_edgeIndexCSC, m_nEdges);
+      else
+      {
+        #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+        for( Int i = 0; i < m_nEdges; ++i )
+          order[i] = m_edgeIndexCSC[order[i]];
+      }
+      std::copy(order.begin(), order.end(), m_edgeIndexCSC);
+    }
+    else
+    {
+      cpuFree(m_edgeIndexCSC);
+      m_edgeIndexCSC = 0;
+    }
+
+    cpuFree(m_srcs);
+    cpuFree(m_srcOffsets);
+    m_srcs          = 0;
+    m_srcOffsets    = &m_ownCompressedCSC.offsets[0];
+    m_compressedCSC = &m_ownCompressedCSC;
+  }
+
+
+  //Replace the edge data by a copy in CSC order, see setSortedEdgeData.
+  //Edge positions in the CSR index become CSC positions; a CSR side that
+  //is built later gets them from the transposition.
+  void sortEdgeData()
+  {
+    if( !m_sortEdgeData || !Phases::hasEdgeData || !m_edgeData )
+      return;
+    if( !m_srcOffsets )
+      needCSC();
+    if( !m_edgeIndexCSC )
+      return; //in CSC order already
+
+    EdgeData *sorted;
+    Int      *position;
+    cpuAlloc(sorted, m_nEdges);
+    cpuAlloc(position, m_nEdges);
+    #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+    for( Int ie = 0; ie < m_nEdges; ++ie )
+    {
+      sorted[ie] = m_edgeData[m_edgeIndexCSC[ie]];
+      position[m_edgeIndexCSC[ie]] = ie;
+    }
+
+    if( m_dstOffsets && !m_edgeIndexCSR )
+      m_edgeIndexCSR = position; //CSR positions are the caller's
+    else
+    {
+      if( m_edgeIndexCSR )
+      {
+        #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+        for( Int i = 0; i < m_nEdges; ++i )
+          m_edgeIndexCSR[i] = position[m_edgeIndexCSR[i]];
+      }
+      cpuFree(position);
+    }
+
+    if( Phases::hasScatter )
+      m_userEdgeIndex = m_edgeIndexCSC;
+    else
+      cpuFree(m_edgeIndexCSC);
+    m_edgeIndexCSC = 0;
+    m_userEdgeData = m_edgeData;
+    m_edgeData     = sorted;
+  }
+
+
+  //gather over every partition, see CPUGASKernels::gatherRange
+  template<typename InEdges>
+  void gatherPartitions(const InEdges &inEdges
+    , const CPUGASKernels::GatherTerms<GatherResult> *terms)
+  {
+    #pragma omp parallel num_threads(m_nThreads)
+    {
+      int tid = omp_get_thread_num();
+      CPUGASKernels::gatherRange<Program, Int>(
+          m_vertexPartitions[tid], m_vertexPartitions[tid + 1]
+        , m_edgePartitions[tid], m_edgePartitions[tid + 1]
+        , m_active, m_edgeCountScan
+        , inEdges, m_edgeIndexCSC
+        , m_vertexData, m_edgeData, terms
+        , m_gatherResults, m_carry[tid], m_carryVertex[tid]);
+
+      if( m_numaCount && m_numaPlaced )
+      {
+        int node = m_threadNode[tid];
+        CPUGASKernels::countNodeReads(m_vertexPartitions[tid]
+          , m_edgePartitions[tid], m_edgePartitions[tid + 1]
+          , m_active, m_edgeCountScan, m_srcOffsets, m_srcs
+          , m_nodeVertexBegin[node], m_nodeVertexBegin[node + 1]
+          , m_localReads[tid], m_remoteReads[tid]);
+      }
+    }
+  }
+
+
+  //the fused pass over every partition, see
+  //CPUGASKernels::gatherApplyScatterRange
+  template<typename InEdges>
+  void gatherApplyScatterPartitions(const InEdges &inEdges
+    , const CPUGASKernels::GatherTerms<GatherResult> *terms
+    , bool haveGather, bool haveScatter)
+  {
+    #pragma omp parallel num_threads(m_nThreads)
+    {
+      int tid = omp_get_thread_num();
+      CPUGASKernels::gatherApplyScatterRange<Program, Int>(
+          m_vertexPartitions[tid], m_vertexPartitions[tid + 1]
+        , m_edgePartitions[tid], m_edgePartitions[tid + 1]
+        , m_active, m_edgeCountScan
+        , inEdges, m_edgeIndexCSC
+        , m_dstOffsets, m_dsts, m_edgeIndexCSR
+        , m_vertexData, m_vertexDataNext, m_edgeData, terms
+        , m_frontier, tid, haveGather, haveScatter
+        , m_carry[tid], m_carryVertex[tid]
+        , m_tail[tid], m_tailVertex[tid]);
+
+      if( m_numaCount && m_numaPlaced && haveGather )
+      {
+        int node = m_threadNode[tid];
+        CPUGASKernels::countNodeReads(m_vertexPartitions[tid]
+          , m_edgePartitions[tid], m_edgePartitions[tid + 1]
+          , m_active, m_edgeCountScan, m_srcOffsets, m_srcs
+          , m_nodeVertexBegin[node], m_nodeVertexBegin[node + 1]
+          , m_localReads[tid], m_remoteReads[tid]);
+      }
+    }
+  }
+
+
+  //[begin, end) of the active list owned by the calling thread in NUMA
+  //mode: the active vertices of its node, split evenly among its threads
+  void nodeActiveRange(int tid, Int &begin, Int &end) const
+  {
+    int node = m_threadNode[tid];
+    Int nodeBegin = std::lower_bound(m_active, m_active + m_nActive
+      , m_nodeVertexBegin[node]) - m_active;
+    Int nodeEnd   = std::lower_bound(m_active, m_active + m_nActive
+      , m_nodeVertexBegin[node + 1]) - m_active;
+    int nNodeThreads = m_nodeThreadBegin[node + 1] - m_nodeThreadBegin[node];
+    int rank = tid - m_nodeThreadBegin[node];
+    begin = nodeBegin + (Int)((int64_t)(nodeEnd - nodeBegin) * rank / nNodeThreads);
+    end   = nodeBegin + (Int)((int64_t)(nodeEnd - nodeBegin) * (rank + 1) / nNodeThreads);
+  }
+
+
+  //Fill m_edgeCountScan with an exclusive scan of the degrees of the active
+  //list, using either the CSC or CSR offsets.  If predicates is given,
+  //vertices with a zero predicate count as having no edges.
+  //Returns the total number of edges.
+  Int scanEdgeCounts(const Int *offsets, const Int *predicates)
+  {
+    #pragma omp parallel num_threads(m_nThreads)
+    {
+      int tid = omp_get_thread_num();
+      Int begin = (Int)((int64_t)m_nActive * tid / m_nThreads);
+      Int end   = (Int)((int64_t)m_nActive * (tid + 1) / m_nThreads);
+
+      Int sum = 0;
+      for( Int i = begin; i < end; ++i )
+      {
+        Int v = m_active[i];
+        Int w = (predicates && !predicates[i]) ? 0 : offsets[v + 1] - offsets[v];
+        m_edgeCountScan[i] = sum;
+        sum += w;
+      }
+      m_threadCounts[tid + 1] = sum;
+
+      #pragma omp barrier
+      #pragma omp single
+      {
+        m_threadCounts[0] = 0;
+        for( int t = 0; t < m_nThreads; ++t )
+          m_threadCounts[t + 1] += m_threadCounts[t];
+      }
+
+      Int base = m_threadCounts[tid];
+      for( Int i = begin; i < end; ++i )
+        m_edgeCountScan[i] += base;
+    }
+    m_edgeCountScan[m_nActive] = m_threadCounts[m_nThreads];
+    return m_threadCounts[m_nThreads];
+  }
+
+
+  //split the active list into m_nThreads chunks of equal vertices + edges
+  //work according to m_edgeCountScan
+  void partitionActive()
+  {
+    if( !m_numaPlaced )
+    {
+      CPUGASKernels::mergePathPartitions(m_nActive, m_edgeCountScan, m_nThreads
+        , m_vertexPartitions, m_edgePartitions);
+      return;
+    }
+
+    //the active list is sorted, so each node's vertices are a contiguous
+    //piece of it, balanced over that node's threads
+    for( int n = 0; n < m_nNodes; ++n )
+    {
+      Int begin = std::lower_bound(m_active, m_active + m_nActive
+        , m_nodeVertexBegin[n]) - m_active;
+      Int end   = std::lower_bound(m_active, m_active + m_nActive
+        , m_nodeVertexBegin[n + 1]) - m_active;
+      CPUGASKernels::mergePathPartitions(m_nActive, m_edgeCountScan
+        , begin, end, m_nodeThreadBegin[n], m_nodeThreadBegin[n + 1]
+        , m_vertexPartitions, m_edgePartitions);
+    }
+  }
+
+
+  //bottom-up activation, see CPUGASKernels::pullActivateRange
+  void pullActivate()
+  {
+    needCSC();
+    #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+    for( Int i = 0; i < m_nActive; ++i )
+    {
+      if( m_applyRet[i] )
+        m_pullSources[m_active[i]] = 1;
+    }
+
+    //early exit makes the cost per vertex unpredictable, so hand out
+    //small blocks of vertices dynamically
+    const Int blockSize = 1024;
+    Int nBlocks = (m_nVertices + blockSize - 1) / blockSize;
+    m_frontier.begin(m_nVertices);
+    #pragma omp parallel num_threads(m_nThreads)
+    {
+      int tid = omp_get_thread_num();
+      #pragma omp for schedule(dynamic)
+      for( Int b = 0; b < nBlocks; ++b )
+      {
+        Int end = (b + 1) * blockSize < m_nVertices ? (b + 1) * blockSize : m_nVertices;
+        CPUGASKernels::pullActivateRange<Program, Int>(b * blockSize, end
+          , m_srcOffsets, m_srcs, m_vertexData, m_pullSources
+          , m_frontier, tid);
+      }
+    }
+
+    #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+    for( Int i = 0; i < m_nActive; ++i )
+      m_pullSources[m_active[i]] = 0;
+  }
+
+
+  int64_t bucketOf(Int v) const
+  {
+    return (int64_t)(GASTraits::Priority<Program>::priority(m_vertexData + v) / m_delta);
+  }
+
+
+  //activate the light or heavy out-edge targets of sources as the next
+  //active list
+  void relax(const std::vector<Int> &sources, bool light)
+  {
+    needCSR();
+    Int nSources = (Int)sources.size();
+    int64_t nRelaxEdges = 0;
+    #pragma omp parallel for num_threads(m_nThreads) schedule(static) reduction(+:nRelaxEdges)
+    for( Int i = 0; i < nSources; ++i )
+      nRelaxEdges += m_dstOffsets[sources[i] + 1] - m_dstOffsets[sources[i]];
+
+    m_frontier.begin(nRelaxEdges);
+    #pragma omp parallel num_threads(m_nThreads)
+    {
+      int tid = omp_get_thread_num();
+      #pragma omp for schedule(dynamic, 64)
+      for( Int i = 0; i < nSources; ++i )
+      {
+        CPUGASKernels::relaxVertex<Program, Int>(sources[i], light, m_delta
+          , m_dstOffsets, m_dsts, m_edgeIndexCSR, m_vertexData, m_edgeData
+          , m_frontier, tid);
+      }
+    }
+    m_nActive = m_frontier.finish(m_active);
+  }
+
+
+  //delta stepping replacement for scatterActivate: bucket the vertices
+  //whose apply returned true
+  void bucketChanged()
+  {
+    for( Int i = 0; i < m_nActive; ++i )
+    {
+      if( m_applyRet[i] )
+        m_buckets.insert(m_active[i], bucketOf(m_active[i]));
+    }
+  }
+
+
+  //delta stepping replacement for nextIter: find the next non-empty set of
+  //edges to relax, in order light edges of the current bucket, heavy edges
+  //of everything settled in it, next bucket.
+  void nextDeltaStep()
+  {
+    for(;;)
+    {
+      std::vector<Int> &bucket = m_buckets.currentBucket();
+      if( !bucket.empty() )
+      {
+        m_relaxSources.clear();
+        for( size_t i = 0; i < bucket.size(); ++i )
+        {
+          //skip copies left behind by vertices that improved further.
+          //Vertices past the last bucket all share it and stay in it until
+          //they settle.
+          if( DeltaBuckets<Int>::clamp(bucketOf(bucket[i]))
+              <= (int64_t)m_buckets.current() )
+            m_relaxSources.push_back(bucket[i]);
+        }
+        bucket.clear();
+        std::sort(m_relaxSources.begin(), m_relaxSources.end());
+        m_relaxSources.erase(
+          std::unique(m_relaxSources.begin(), m_relaxSources.end())
+          , m_relaxSources.end());
+        if( GASTraits::EdgeWeight<Program>::enabled )
+          m_settled.insert(m_settled.end(), m_relaxSources.begin(), m_relaxSources.end());
+
+        relax(m_relaxSources, true);
+        if( m_nActive )
+          return;
+      }
+      else if( !m_settled.empty() )
+      {
+        std::sort(m_settled.begin(), m_settled.end());
+        m_settled.erase(std::unique(m_settled.begin(), m_settled.end())
+          , m_settled.end());
+        relax(m_settled, false);
+        m_settled.clear();
+        if( m_nActive )
+          return;
+      }
+      else if( !m_buckets.advance() )
+      {
+        m_nActive = 0;
+        return;
+      }
+    }
+  }
+
+
+  public:
+    GASEngineCPU()
+      : m_nVertices(0)
+      , m_nEdges(0)
+      , m_vertexData(0)
+      , m_edgeData(0)
+      , m_srcs(0)
+      , m_srcOffsets(0)
+      , m_edgeIndexCSC(0)
+      , m_borrowedCSC(false)
+      , m_compress(false)
+      , m_compressedCSC(0)
+      , m_dsts(0)
+      , m_dstOffsets(0)
+      , m_edgeIndexCSR(0)
+      , m_borrowedCSR(false)
+      , m_active(0)
+      , m_nActive(0)
+      , m_applyRet(0)
+      , m_gatherResults(0)
+      , m_directionOptimizing(false)
+      , m_pullSources(0)
+      , m_fused(false)
+      , m_vertexDataNext(0)
+      , m_tail(0)
+      , m_tailVertex(0)
+      , m_nThreads(omp_get_max_threads())
+      , m_edgeCountScan(0)
+      , m_vertexPartitions(0)
+      , m_edgePartitions(0)
+      , m_threadCounts(0)
+      , m_carry(0)
+      , m_carryVertex(0)
+      , m_deltaStepping(false)
+      , m_delta(1.0)
+      , m_numa(false)
+      , m_numaCount(false)
+      , m_numaPlaced(false)
+      , m_nNodes(1)
+      , m_userVertexData(0)
+      , m_gatherCache(false)
+      , m_cachedResults(0)
+      , m_cacheValid(0)
+      , m_cacheMiss(0)
+      , m_unorderedVertexData(0)
+      , m_blockVertices(0)
+      , m_vectorGather(true)
+      , m_gatherSource(0)
+      , m_gatherEdge(0)
+      , m_sortEdgeData(false)
+      , m_userEdgeData(0)
+      , m_userEdgeIndex(0)
+    {}
+
+
+    ~GASEngineCPU()
+    {
+      release();
+    }
+
+
+    //Same contract as GASEngineRef::setGraph.  The vertex and edge data are
+    //used in place, so getResults() has nothing to copy back, except with
+    //NUMA placement or a vertex order.
+    void setGraph(Int nVertices
+      , VertexData* vertexData
+      , Int nEdges
+      , EdgeData* edgeData
+      , const Int *edgeListSrcs
+      , const Int *edgeListDsts)
+    {
+      release();
+
+      m_nVertices  = nVertices;
+      m_nEdges     = nEdges;
+      m_vertexData = vertexData;
+      m_edgeData   = edgeData;
+
+      //the edge list in the engine's numbering
+      std::vector<Int> orderedSrcs, orderedDsts;
+      orderVertexData();
+      if( m_unorderedVertexData )
+      {
+        orderedSrcs.resize(m_nEdges);
+        orderedDsts.resize(m_nEdges);
+        #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+        for( Int i = 0; i < m_nEdges; ++i )
+        {
+          orderedSrcs[i] = m_newId[edgeListSrcs[i]];
+          orderedDsts[i] = m_newId[edgeListDsts[i]];
+        }
+        edgeListSrcs = m_nEdges ? &orderedSrcs[0] : 0;
+        edgeListDsts = m_nEdges ? &orderedDsts[0] : 0;
+      }
+
+      if( m_numa )
+        numaAlloc(edgeListSrcs, edgeListDsts);
+      else
+      {
+        cpuAlloc(m_dstOffsets, m_nVertices + 1);
+        cpuAlloc(m_dsts, m_nEdges);
+        allocEdgeIndex(m_edgeIndexCSR);
+        cpuAlloc(m_srcOffsets, m_nVertices + 1);
+        cpuAlloc(m_srcs, m_nEdges);
+        allocEdgeIndex(m_edgeIndexCSC);
+      }
+
+      //get CSR representation for activate/scatter and CSC representation
+      //for gather/apply, in one pass over the edge list
+      edgeListToCSRAndCSC(m_nVertices, m_nEdges
+        , edgeListSrcs, edgeListDsts
+        , m_dstOffsets, m_dsts, m_edgeIndexCSR
+        , m_srcOffsets, m_srcs, m_edgeIndexCSC);
+      if( m_compress )
+        needGatherCSC();
+      sortEdgeData();
+
+      allocWorkspace();
+    }
+
+
+    //Alternative to setGraph for a graph that is already in CSR form, which
+    //uses the graph in place.  offsets has nVertices + 1 entries, the out-edges of v are dsts[offsets[v]] ..
+    //dsts[offsets[v+1] - 1] in any order, and edgeData is in the same order
+    //as dsts.  offsets and dsts are used in place and must stay valid and
+    //unchanged until the next setGraph or the engine is destroyed.  The CSC
+    //side is built by transposition the first time a gather needs it.  No
+    //NUMA placement is done.  With a vertex order set the graph is copied
+    //in the new numbering instead.
+    //A .gr file mapped with mapGraph_binaryCSR stores 64 bit end offsets,
+    //so mappedGraphOffsets has to convert them into offsets first, an
+    //O(nVertices) pass over the file's offsets; its dsts and edge values are
+    //used from the mapping as they are.
+    void setGraphCSR(Int nVertices
+      , VertexData* vertexData
+      , Int nEdges
+      , EdgeData* edgeData
+      , const Int *offsets
+      , const Int *dsts)
+    {
+      release();
+
+      m_nVertices  = nVertices;
+      m_nEdges     = nEdges;
+      m_vertexData = vertexData;
+      m_edgeData   = edgeData;
+
+      orderVertexData();
+      if( m_unorderedVertexData )
+        orderCSR(offsets, dsts, m_dstOffsets, m_dsts, m_edgeIndexCSR);
+      else
+      {
+        m_dstOffsets   = const_cast<Int *>(offsets);
+        m_dsts         = const_cast<Int *>(dsts);
+        m_edgeIndexCSR = 0; //edge data is in CSR order already
+        m_borrowedCSR  = true;
+      }
+      sortEdgeData();
+
+      allocWorkspace();
+    }
+
+
+    //Same as setGraphCSR for a graph in CSC form: the in-edges of v are
+    //srcs[offsets[v]] .. srcs[offsets[v+1] - 1] and edgeData is in the same
+    //order as srcs.  The CSR side is built when activation first needs it.
+    void setGraphCSC(Int nVertices
+      , VertexData* vertexData
+      , Int nEdges
+      , EdgeData* edgeData
+      , const Int *offsets
+      , const Int *srcs)
+    {
+      release();
+
+      m_nVertices  = nVertices;
+      m_nEdges     = nEdges;
+      m_vertexData = vertexData;
+      m_edgeData   = edgeData;
+
+      orderVertexData();
+      if( m_unorderedVertexData )
+        orderCSR(offsets, srcs, m_srcOffsets, m_srcs, m_edgeIndexCSC);
+      else
+      {
+        m_srcOffsets   = const_cast<Int *>(offsets);
+        m_srcs         = const_cast<Int *>(srcs);
+        m_edgeIndexCSC = 0; //edge data is in CSC order already
+        m_borrowedCSC  = true;
+      }
+      sortEdgeData();
+
+      allocWorkspace();
+    }
+
+
+    //setGraphCSC for a compressed CSC (see compressCSR and
+    //loadGraph_compressedCSR), with edgeData in the order of the compressed
+    //edges.  graph is used in place like the arrays of setGraphCSC; a vertex
+    //order is not applied, renumber the graph before compressing it.
+    void setGraphCompressedCSC(VertexData* vertexData
+      , EdgeData* edgeData
+      , const CompressedCSR<Int> &graph)
+    {
+      release();
+
+      m_nVertices  = graph.nVertices;
+      m_nEdges     = graph.nEdges;
+      m_vertexData = vertexData;
+      m_edgeData   = edgeData;
+
+      m_compressedCSC = &graph;
+      m_srcOffsets    = const_cast<Int *>(&graph.offsets[0]);
+      m_edgeIndexCSC  = 0;
+
+      allocWorkspace();
+    }
+
+
+    //Vertex and edge data are updated in place, nothing to do except in
+    //NUMA mode, where the vertex data lives in a node-local copy, with a
+    //vertex order, where it lives in a renumbered one, and with sorted edge
+    //data that scatter can change.
+    void getResults()
+    {
+      if( m_userEdgeIndex )
+      {
+        #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+        for( Int ie = 0; ie < m_nEdges; ++ie )
+          m_userEdgeData[m_userEdgeIndex[ie]] = m_edgeData[ie];
+      }
+      if( m_userVertexData )
+      {
+        #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+        for( Int i = 0; i < m_nVertices; ++i )
+          m_userVertexData[i] = m_vertexData[i];
+      }
+      if( m_unorderedVertexData )
+      {
+        const VertexData *ordered = m_userVertexData ? m_userVertexData : m_vertexData;
+        #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+        for( Int v = 0; v < m_nVertices; ++v )
+          m_unorderedVertexData[v] = ordered[m_newId[v]];
+      }
+    }
+
+
+    //Renumber the vertices inside the engine, see the notes at the top and
+    //GASEngineRef::setVertexOrder.  Takes effect at the next setGraph*.  A
+    //null newId turns renumbering off.
+    void setVertexOrder(Int nVertices, const Int *newId)
+    {
+      if( newId )
+        m_newId.assign(newId, newId + nVertices);
+      else
+        m_newId.clear();
+    }
+
+
+    //NUMA placement and thread pinning, see the notes at the top.  Takes
+    //effect at the next setGraph.  countReads makes gather tally local and
+    //remote vertex data reads, at the price of a second pass over the
+    //gathered edges.
+    void setNuma(bool enable, bool countReads = false)
+    {
+      m_numa      = enable;
+      m_numaCount = enable && countReads;
+    }
+
+
+    //Keep a copy of the edge data in CSC order, see the notes at the top.
+    //Takes effect at the next setGraph*; with setGraphCSR the CSC side is
+    //then built right away.
+    void setSortedEdgeData(bool enable)
+    {
+      m_sortEdgeData = enable;
+    }
+
+
+    //Keep the in-edges compressed for gather, see the notes at the top.
+    //Takes effect at the next setGraph or setGraphCSR; not combined with
+    //NUMA placement, or with setGraphCSC, whose arrays belong to the caller.
+    void setCompressed(bool enable)
+    {
+      m_compress = enable;
+    }
+
+
+    //bytes of the compressed in-edges, 0 if they are not compressed
+    size_t compressedBytes() const
+    {
+      return m_compressedCSC ? m_compressedCSC->memoryBytes() : 0;
+    }
+
+
+    //number of nodes the graph was placed on
+    int numaNodes() const
+    {
+      return m_numaPlaced ? m_nNodes : 1;
+    }
+
+
+    //gather reads of source vertex data that stayed on the reading thread's
+    //node and that went to another node, summed over all gathers so far
+    void numaReads(int64_t &local, int64_t &remote) const
+    {
+      local = remote = 0;
+      for( size_t t = 0; t < m_localReads.size(); ++t )
+      {
+        local  += m_localReads[t];
+        remote += m_remoteReads[t];
+      }
+    }
+
+
+    //Cache blocked gather, see the notes at the top.  cacheBytes is the
+    //vertex data per source segment, e.g. half the last level cache; 0
+    //turns blocking off.
+    void setGatherBlocking(size_t cacheBytes)
+    {
+      m_blockVertices = cacheBytes ? (Int)std::max(cacheBytes / sizeof(VertexData), (size_t)1) : 0;
+      clearBlockedCSC();
+    }
+
+
+    //Vectorized gather for programs with a GatherReduction, see the notes
+    //at the top.  On by default.
+    void setVectorGather(bool enable)
+    {
+      m_vectorGather = enable;
+    }
+
+
+    //Gather cache, see the notes at the top and GASEngineRef.  Has no
+    //effect for programs without Program::postDelta.
+    void setGatherCache(bool enable)
+    {
+      m_gatherCache = enable && GASTraits::DeltaCache<Program>::enabled;
+      clearGatherCache();
+    }
+
+
+    //The next frontier is built as a bitmap when it may hold more than this
+    //fraction of the vertices, and as a compact queue otherwise.
+    void setFrontierThreshold(float threshold)
+    {
+      m_frontier.setThreshold(threshold);
+    }
+
+
+    //When enabled, scatterActivate(false) picks top-down (push over CSR) or
+    //bottom-up (pull over CSC) activation every iteration, see
+    //DirectionHeuristic.  Activation with a scatter is always top-down.
+    void setDirectionOptimizing(bool enable, int alpha = 15, int beta = 18)
+    {
+      m_directionOptimizing = enable;
+      m_direction.alpha = alpha;
+      m_direction.beta  = beta;
+    }
+
+
+    //Opt-in fused execution, see gatherApplyScatter().  run() uses the
+    //fused pass when this is set.
+    void setFused(bool enable)
+    {
+      m_fused = enable;
+    }
+
+
+    //Delta stepping with bucket width delta in place of plain activation,
+    //see the notes at the top.  Needs Program::priority, and
+    //Program::edgeWeight for the light/heavy split.  Program::scatter is
+    //not called in this mode.  Not combined with the fused pass.
+    void setDeltaStepping(bool enable, double delta = 1.0)
+    {
+      m_deltaStepping = enable;
+      m_delta = delta > 0 ? delta : 1.0;
+    }
+
+
+    //set the active flag for a range [vertexStart, vertexEnd)
+    //affects only the next gather step
+    void setActive(Int vertexStart, Int vertexEnd)
+    {
+      m_direction.reset(m_nEdges);
+      clearGatherCache();
+      m_buckets.clear();
+      m_settled.clear();
+      m_nActive = vertexEnd - vertexStart;
+      if( m_unorderedVertexData && (vertexStart > 0 || vertexEnd < m_nVertices) )
+      {
+        //the range is in the caller's numbering
+        #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+        for( Int i = 0; i < m_nActive; ++i )
+          m_active[i] = m_newId[vertexStart + i];
+        std::sort(m_active, m_active + m_nActive);
+        return;
+      }
+      #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+      for( Int i = 0; i < m_nActive; ++i )
+        m_active[i] = vertexStart + i;
+    }
+
+
+    //Activate the out-neighbors of [vertexStart, vertexEnd) for the next
+    //gather step, as if their apply had just returned true.  Use this to
+    //start a traversal from a source whose value is already set.
+    void activateNeighbors(Int vertexStart, Int vertexEnd)
+    {
+      setActive(vertexStart, vertexEnd);
+      #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+      for( Int i = 0; i < m_nActive; ++i )
+        m_applyRet[i] = 1;
+      scatterActivate(false);
+      nextIter();
+    }
+
+
+    //Return the number of active vertices in the next gather step
+    Int countActive()
+    {
+      return m_nActive;
+    }
+
+
+    void gather(bool haveGather=true)
+    {
+      if( !haveGather || !Phases::hasGather )
+      {
+        #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+        for( Int i = 0; i < m_nActive; ++i )
+          m_gatherResults[i] = Program::gatherZero;
+        return;
+      }
+
+      //vertices with a cached result count as having no in-edges
+      bool cache = useGatherCache();
+      if( cache )
+      {
+        needGatherCache();
+        #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+        for( Int i = 0; i < m_nActive; ++i )
+          m_cacheMiss[i] = !m_cacheValid[m_active[i]];
+      }
+
+      if( useBlockedGather() )
+      {
+        blockedGather();
+        return;
+      }
+
+      needGatherCSC();
+      scanEdgeCounts(m_srcOffsets, cache ? m_cacheMiss : 0);
+      partitionActive();
+
+      if( m_compressedCSC )
+        gatherPartitions(*m_compressedCSC, 0);
+      else
+      {
+        CPUGASKernels::GatherTerms<GatherResult> terms;
+        gatherPartitions(CPUGASKernels::CSCInEdges<Int>(m_srcOffsets, m_srcs)
+          , gatherTerms(terms));
+      }
+
+      //finish the segmented reduction for vertices split across chunks,
+      //in chunk order so that gatherReduce sees edges in CSC order
+      for( int t = 0; t < m_nThreads; ++t )
+      {
+        Int i = m_carryVertex[t];
+        if( i >= 0 )
+          m_gatherResults[i] = Program::gatherReduce(m_gatherResults[i], m_carry[t]);
+      }
+
+      if( cache )
+      {
+        #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+        for( Int i = 0; i < m_nActive; ++i )
+        {
+          Int dv = m_active[i];
+          if( m_cacheMiss[i] )
+          {
+            m_cachedResults[dv] = m_gatherResults[i];
+            m_cacheValid[dv] = 1;
+          }
+          else
+            m_gatherResults[i] = m_cachedResults[dv];
+        }
+      }
+    }
+
+
+    void apply()
+    {
+      if( m_numaPlaced )
+      {
+        #pragma omp parallel num_threads(m_nThreads)
+        {
+          Int begin, end;
+          nodeActiveRange(omp_get_thread_num(), begin, end);
+          for( Int i = begin; i < end; ++i )
+          {
+            Int dv = m_active[i];
+            m_applyRet[i] = Program::apply(m_vertexData + dv, m_gatherResults[i]);
+          }
+        }
+        return;
+      }
+
+      #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+      for( Int i = 0; i < m_nActive; ++i )
+      {
+        Int dv = m_active[i];
+        m_applyRet[i] = Program::apply(m_vertexData + dv, m_gatherResults[i]);
+      }
+    }
+
+
+    //do the scatter operation
+    void scatterActivate(bool haveScatter=true)
+    {
+      haveScatter = haveScatter && Phases::hasScatter;
+      if( haveScatter )
+        clearGatherEdge();
+      if( m_deltaStepping )
+      {
+        bucketChanged();
+        return;
+      }
+
+      //only vertices that requested their nbd activated for the next
+      //step contribute edges.  The edge count bounds the frontier size.
+      //without scatter there are no deltas to keep the cache up to date
+      bool postDeltas = useGatherCache() && m_cacheValid;
+      if( postDeltas && !haveScatter )
+      {
+        clearGatherCache();
+        postDeltas = false;
+      }
+      if( postDeltas )
+        m_deltaPosts.resize(m_nThreads * m_nThreads);
+
+      needCSR();
+      Int nScatterEdges = scanEdgeCounts(m_dstOffsets, m_applyRet);
+
+      if( m_directionOptimizing && !haveScatter )
+      {
+        Int frontierSize = 0;
+        #pragma omp parallel for num_threads(m_nThreads) schedule(static) reduction(+:frontierSize)
+        for( Int i = 0; i < m_nActive; ++i )
+          frontierSize += m_applyRet[i] ? 1 : 0;
+
+        if( m_direction.choose(frontierSize, nScatterEdges, m_nVertices) )
+        {
+          pullActivate();
+          return;
+        }
+      }
+
+      partitionActive();
+      m_frontier.begin(nScatterEdges);
+
+      #pragma omp parallel num_threads(m_nThreads)
+      {
+        int tid = omp_get_thread_num();
+        CPUGASKernels::scatterActivateRange<Program, Int>(
+            m_vertexPartitions[tid], m_vertexPartitions[tid + 1]
+          , m_edgePartitions[tid], m_edgePartitions[tid + 1]
+          , m_active, m_edgeCountScan
+          , m_dstOffsets, m_dsts, m_edgeIndexCSR
+          , m_vertexData, m_edgeData
+          , m_frontier, tid, haveScatter);
+        if( postDeltas )
+        {
+          CPUGASKernels::postDeltaRange<Program, Int>(
+              m_vertexPartitions[tid], m_vertexPartitions[tid + 1]
+            , m_edgePartitions[tid], m_edgePartitions[tid + 1]
+            , m_active, m_edgeCountScan
+            , m_dstOffsets, m_dsts, m_edgeIndexCSR
+            , m_vertexData, m_edgeData, m_cachedResults, m_cacheValid
+            , m_nVertices, m_nThreads, tid, &m_deltaPosts[tid * m_nThreads]);
+          #pragma omp barrier
+          reduceDeltas(tid);
+        }
+      }
+    }
+
+
+    //gather(), apply() and scatterActivate() in a single pass, followed by
+    //nextIter() as usual.  See the notes at the top of this file for how
+    //the semantics differ.
+    void gatherApplyScatter(bool haveGather=true, bool haveScatter=true)
+    {
+      haveGather  = haveGather && Phases::hasGather;
+      haveScatter = haveScatter && Phases::hasScatter;
+      if( haveScatter )
+        clearGatherEdge();
+      if( !m_vertexDataNext )
+        cpuAlloc(m_vertexDataNext, m_nVertices);
+
+      //partition on the gather edges, or on the activation edges if there
+      //is no gather
+      needCSR();
+      if( haveGather )
+        needGatherCSC();
+      scanEdgeCounts(haveGather ? m_srcOffsets : m_dstOffsets, 0);
+      partitionActive();
+
+      //the out-edges of the active list bound the next frontier
+      int64_t nOutEdges = 0;
+      #pragma omp parallel for num_threads(m_nThreads) schedule(static) reduction(+:nOutEdges)
+      for( Int i = 0; i < m_nActive; ++i )
+        nOutEdges += m_dstOffsets[m_active[i] + 1] - m_dstOffsets[m_active[i]];
+      m_frontier.begin(nOutEdges);
+
+      if( m_compressedCSC )
+        gatherApplyScatterPartitions(*m_compressedCSC, 0, haveGather, haveScatter);
+      else
+      {
+        CPUGASKernels::GatherTerms<GatherResult> terms;
+        gatherApplyScatterPartitions(CPUGASKernels::CSCInEdges<Int>(m_srcOffsets, m_srcs)
+          , haveGather ? gatherTerms(terms) : 0, haveGather, haveScatter);
+      }
+
+      //finish the vertices that were split across chunks: reduce the carries
+      //of the following chunks into the tail in chunk order
+      Int nSplit = 0;
+      for( int t = 0; t < m_nThreads; ++t )
+      {
+        Int i = m_tailVertex[t];
+        if( i < 0 )
+          continue;
+        GatherResult sum = m_tail[t];
+        for( int u = t + 1; u < m_nThreads && m_carryVertex[u] == i; ++u )
+          sum = Program::gatherReduce(sum, m_carry[u]);
+        m_tail[nSplit] = sum;
+        m_tailVertex[nSplit] = i;
+        ++nSplit;
+      }
+
+      #pragma omp parallel for num_threads(m_nThreads) schedule(dynamic)
+      for( Int k = 0; k < nSplit; ++k )
+      {
+        CPUGASKernels::applyScatterVertex<Program, Int>(m_active[m_tailVertex[k]]
+          , m_tail[k], m_dstOffsets, m_dsts, m_edgeIndexCSR
+          , m_vertexData, m_vertexDataNext, m_edgeData
+          , m_frontier, omp_get_thread_num(), haveScatter);
+      }
+
+      //commit the new vertex states
+      #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+      for( Int i = 0; i < m_nActive; ++i )
+        m_vertexData[m_active[i]] = m_vertexDataNext[m_active[i]];
+    }
+
+
+    //sets up the engine for the next iteration
+    //returns the number of active vertices
+    Int nextIter()
+    {
+      if( m_deltaStepping )
+        nextDeltaStep();
+      else
+        m_nActive = m_frontier.finish(m_active);
+      return countActive();
+    }
+
+
+    //single entry point for the whole affair, like before.
+    void run()
+    {
+      while( countActive() )
+      {
+        if( m_fused && !m_deltaStepping && !useBlockedGather() )
+        {
+          gatherApplyScatter();
+          nextIter();
+          continue;
+        }
+        gather();
+        apply();
+        scatterActivate();
+        nextIter();
+      }
+    }
+};
+
+
+#endif
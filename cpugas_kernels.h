@@ -0,0 +1,596 @@
+/******************************************************************************
+Copyright 2013 Royal Caliber LLC. (http://www.royal-caliber.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************************/
+
+#ifndef CPUGAS_KERNELS_H__
+#define CPUGAS_KERNELS_H__
+
+#include <stdint.h>
+#include <vector>
+#include "frontier.h"
+#include "gastraits.h"
+#include "gathersimd.h"
+
+//Host code for GASEngineCPU
+//
+//These are the per-thread "kernels" of the CPU engine, kept as free functions
+//to mirror GPUGASKernels.  Each one is handed a slice of the work computed by
+//mergePathPartitions() and is called from inside an OpenMP parallel region.
+//A null edgeIndexCSR (edgeIndexCSC) means the edge data is already stored
+//in CSR (CSC) order.
+//
+//The gather kernels read in-edges through an InEdges type: CSCInEdges for
+//plain CSC arrays or CompressedCSR (compressedcsr.h).  Either has the
+//offsets and a Reader with seek(v, e), to position it at edge e of vertex
+//v, and next(), to return the source of the current edge and move on.
+//Over plain CSC arrays they can also be given dense GatherTerms, which
+//they reduce with the kernels of gathersimd.h instead of gatherMap.
+
+
+namespace CPUGASKernels
+{
+
+
+//In-edges in plain CSC arrays
+template<typename Int>
+struct CSCInEdges
+{
+  const Int *offsets;
+  const Int *srcs;
+
+  CSCInEdges(const Int *offsets, const Int *srcs)
+    : offsets(offsets), srcs(srcs) {}
+
+  class Reader
+  {
+  public:
+    explicit Reader(const CSCInEdges &inEdges) : m_srcs(inEdges.srcs), m_e(0) {}
+
+    void seek(Int v, Int e)
+    {
+      m_e = e;
+    }
+
+    Int next()
+    {
+      return m_srcs[m_e++];
+    }
+
+  private:
+    const Int *m_srcs;
+    Int        m_e;
+  };
+};
+
+
+//Dense gather terms of a program with a GatherReduction (gastraits.h):
+//source[v] is gatherSource of vertex v, edge[ie] gatherEdge of CSC edge ie,
+//null if the program has no gatherEdge.
+template<typename GatherResult>
+struct GatherTerms
+{
+  const GatherResult *source;
+  const GatherResult *edge;
+};
+
+
+//Reduce sum with the in-edges ie .. ieEnd - 1 of dv using gatherMap and
+//gatherReduce
+template<typename Program, typename Int, typename InEdges>
+struct MapGather
+{
+  typedef typename Program::GatherResult GatherResult;
+
+  static GatherResult reduce(GatherResult sum, Int dv, Int ie, Int ieEnd
+    , typename InEdges::Reader &reader
+    , const Int *edgeIndexCSC
+    , const typename Program::VertexData *vertexData
+    , const typename Program::EdgeData   *edgeData)
+  {
+    reader.seek(dv, ie);
+    for( ; ie < ieEnd; ++ie )
+    {
+      Int src = reader.next();
+      GatherResult tmp = Program::gatherMap(vertexData + dv
+        , vertexData + src, edgeData + (edgeIndexCSC ? edgeIndexCSC[ie] : ie));
+      sum = Program::gatherReduce(sum, tmp);
+    }
+    return sum;
+  }
+};
+
+
+//The same, or from the gather terms if there are any.  Those are only
+//used over plain CSC arrays.
+template<typename Program, typename Int, typename InEdges>
+struct EdgeGather
+{
+  typedef typename Program::GatherResult GatherResult;
+
+  static GatherResult reduce(GatherResult sum, Int dv, Int ie, Int ieEnd
+    , typename InEdges::Reader &reader
+    , const InEdges & /*inEdges*/
+    , const Int *edgeIndexCSC
+    , const typename Program::VertexData *vertexData
+    , const typename Program::EdgeData   *edgeData
+    , const GatherTerms<GatherResult>    * /*terms*/)
+  {
+    return MapGather<Program, Int, InEdges>::reduce(sum, dv, ie, ieEnd
+      , reader, edgeIndexCSC, vertexData, edgeData);
+  }
+};
+
+
+template<typename Program, typename Int>
+struct EdgeGather<Program, Int, CSCInEdges<Int> >
+{
+  typedef typename Program::GatherResult GatherResult;
+  typedef CSCInEdges<Int>                InEdges;
+
+  static GatherResult reduce(GatherResult sum, Int dv, Int ie, Int ieEnd
+    , typename InEdges::Reader &reader
+    , const InEdges &inEdges
+    , const Int *edgeIndexCSC
+    , const typename Program::VertexData *vertexData
+    , const typename Program::EdgeData   *edgeData
+    , const GatherTerms<GatherResult>    *terms)
+  {
+    if( terms )
+    {
+      return GatherSIMD::gather<typename GASTraits::VectorGather<Program>::Reduction>(
+        sum, terms->source, inEdges.srcs, terms->edge, ie, ieEnd);
+    }
+    return MapGather<Program, Int, InEdges>::reduce(sum, dv, ie, ieEnd
+      , reader, edgeIndexCSC, vertexData, edgeData);
+  }
+};
+
+
+//Host version of the load balancing search used by kGatherMap.
+//
+//The work for an active list is the sequence: vertex 0, its edges, vertex 1,
+//its edges, ...  Vertex i sits at position edgeCountScan[i] + i in this
+//sequence, where edgeCountScan is the exclusive scan of the active degrees.
+//For a diagonal (position) diag we find how many vertices and how many edges
+//precede it.  Counting the vertices as work too means long runs of isolated
+//vertices are still split up, like the degree-1 kludge in the GPU gather.
+template<typename Int>
+void mergePathSearch(Int diag, const Int *edgeCountScan, Int nActive
+  , Int &vertex, Int &edge)
+{
+  //find the number of vertices i with edgeCountScan[i] + i < diag
+  Int begin = 0;
+  Int end   = nActive;
+  while( begin < end )
+  {
+    Int mid = begin + (end - begin) / 2;
+    if( edgeCountScan[mid] + mid < diag )
+      begin = mid + 1;
+    else
+      end = mid;
+  }
+  vertex = begin;
+  edge   = diag - begin;
+}
+
+
+//Split the active vertices [activeBegin, activeEnd) into parts
+//[partBegin, partEnd) of equal work, where work is vertices + edges.  Unlike
+//a split at vertex boundaries, a part may start or end in the middle of a
+//vertex's edges.  Part t covers vertices [vertexParts[t], vertexParts[t+1])
+//and active edges [edgeParts[t], edgeParts[t+1]), numbered as in
+//edgeCountScan.  The first and last part start and end exactly at
+//activeBegin and activeEnd.  edgeCountScan must have nActive + 1 entries.
+template<typename Int>
+void mergePathPartitions(Int nActive, const Int *edgeCountScan
+  , Int activeBegin, Int activeEnd, int partBegin, int partEnd
+  , Int *vertexParts, Int *edgeParts)
+{
+  int64_t begin = (int64_t)activeBegin + edgeCountScan[activeBegin];
+  int64_t end   = (int64_t)activeEnd + edgeCountScan[activeEnd];
+  int nParts = partEnd - partBegin;
+  for( int t = 0; t <= nParts; ++t )
+  {
+    Int diag = (Int)(begin + (end - begin) * t / nParts);
+    mergePathSearch(diag, edgeCountScan, nActive
+      , vertexParts[partBegin + t], edgeParts[partBegin + t]);
+  }
+}
+
+
+//Split the whole active list into nParts parts, see above.
+template<typename Int>
+void mergePathPartitions(Int nActive, const Int *edgeCountScan, int nParts
+  , Int *vertexParts, Int *edgeParts)
+{
+  mergePathPartitions(nActive, edgeCountScan, (Int)0, nActive, 0, nParts
+    , vertexParts, edgeParts);
+}
+
+
+//Gather over one partition.
+//Vertices starting in this partition have their (possibly partial) result
+//written to gatherResults.  If the partition starts in the middle of a
+//vertex, the reduction of those leading edges is returned in carryOut with
+//carryVertex set to the index of that vertex in the active list, otherwise
+//carryVertex is set to -1.  The caller finishes the segmented reduction by
+//reducing the carries into gatherResults in partition order.  terms may be
+//null, see GatherTerms.
+template<typename Program, typename Int, typename InEdges>
+void gatherRange(Int vertexBegin, Int vertexEnd
+  , Int edgeBegin, Int edgeEnd
+  , const Int *active
+  , const Int *edgeCountScan
+  , const InEdges &inEdges
+  , const Int *edgeIndexCSC
+  , const typename Program::VertexData *vertexData
+  , const typename Program::EdgeData   *edgeData
+  , const GatherTerms<typename Program::GatherResult> *terms
+  , typename Program::GatherResult     *gatherResults
+  , typename Program::GatherResult     &carryOut
+  , Int                                &carryVertex)
+{
+  typedef EdgeGather<Program, Int, InEdges> Gather;
+
+  carryVertex = -1;
+  carryOut    = Program::gatherZero;
+  typename InEdges::Reader reader(inEdges);
+
+  //leading edges belonging to a vertex started by an earlier partition
+  Int leadEnd = vertexBegin < vertexEnd ? edgeCountScan[vertexBegin] : edgeEnd;
+  if( edgeBegin < leadEnd )
+  {
+    Int i  = vertexBegin - 1;
+    Int dv = active[i];
+    Int base = inEdges.offsets[dv] - edgeCountScan[i];
+    carryOut = Gather::reduce(Program::gatherZero, dv, base + edgeBegin
+      , base + leadEnd, reader, inEdges, edgeIndexCSC, vertexData, edgeData
+      , terms);
+    carryVertex = i;
+  }
+
+  for( Int i = vertexBegin; i < vertexEnd; ++i )
+  {
+    Int dv = active[i];
+    Int base = inEdges.offsets[dv] - edgeCountScan[i];
+    Int e1 = edgeCountScan[i + 1] < edgeEnd ? edgeCountScan[i + 1] : edgeEnd;
+    gatherResults[i] = Gather::reduce(Program::gatherZero, dv
+      , base + edgeCountScan[i], base + e1, reader, inEdges, edgeIndexCSC
+      , vertexData, edgeData, terms);
+  }
+}
+
+
+//Apply, then activate and optionally scatter for one vertex of the fused
+//pass.  The new vertex state is written to vertexDataNext, everything else
+//reads the current state in vertexData.
+template<typename Program, typename Int>
+void applyScatterVertex(Int dv
+  , const typename Program::GatherResult &sum
+  , const Int *dstOffsets
+  , const Int *dsts
+  , const Int *edgeIndexCSR
+  , const typename Program::VertexData *vertexData
+  , typename Program::VertexData *vertexDataNext
+  , typename Program::EdgeData   *edgeData
+  , Frontier<Int> &frontier
+  , int tid
+  , bool haveScatter)
+{
+  vertexDataNext[dv] = vertexData[dv];
+  if( !Program::apply(vertexDataNext + dv, sum) )
+    return;
+
+  Int edgeEnd = dstOffsets[dv + 1];
+  for( Int ie = dstOffsets[dv]; ie < edgeEnd; ++ie )
+  {
+    Int nv = dsts[ie];
+    if( GASTraits::ActivateFilter<Program>::canActivate(vertexData + nv) )
+      frontier.insert(nv, tid);
+    if( haveScatter )
+    {
+      Program::scatter(vertexDataNext + dv, vertexData + nv
+        , edgeData + (edgeIndexCSR ? edgeIndexCSR[ie] : ie));
+    }
+  }
+}
+
+
+//Fused gather, apply and scatterActivate over one partition.
+//Vertices whose in-edges lie entirely in this partition are finished here.
+//Leading edges of a vertex started earlier are returned in carryOut and
+//carryVertex as for gatherRange().  A trailing vertex whose in-edges run
+//past the end of the partition cannot be applied yet; its partial result is
+//returned in tailOut with tailVertex set to its index in the active list
+//(-1 if there is none).
+template<typename Program, typename Int, typename InEdges>
+void gatherApplyScatterRange(Int vertexBegin, Int vertexEnd
+  , Int edgeBegin, Int edgeEnd
+  , const Int *active
+  , const Int *edgeCountScan
+  , const InEdges &inEdges
+  , const Int *edgeIndexCSC
+  , const Int *dstOffsets
+  , const Int *dsts
+  , const Int *edgeIndexCSR
+  , const typename Program::VertexData *vertexData
+  , typename Program::VertexData *vertexDataNext
+  , typename Program::EdgeData   *edgeData
+  , const GatherTerms<typename Program::GatherResult> *terms
+  , Frontier<Int> &frontier
+  , int tid
+  , bool haveGather
+  , bool haveScatter
+  , typename Program::GatherResult &carryOut
+  , Int                            &carryVertex
+  , typename Program::GatherResult &tailOut
+  , Int                            &tailVertex)
+{
+  typedef typename Program::GatherResult    GatherResult;
+  typedef EdgeGather<Program, Int, InEdges> Gather;
+
+  carryVertex = -1;
+  carryOut    = Program::gatherZero;
+  tailVertex  = -1;
+  tailOut     = Program::gatherZero;
+  typename InEdges::Reader reader(inEdges);
+
+  //leading edges belonging to a vertex started by an earlier partition
+  Int leadEnd = vertexBegin < vertexEnd ? edgeCountScan[vertexBegin] : edgeEnd;
+  if( haveGather && edgeBegin < leadEnd )
+  {
+    Int i  = vertexBegin - 1;
+    Int dv = active[i];
+    Int base = inEdges.offsets[dv] - edgeCountScan[i];
+    carryOut = Gather::reduce(Program::gatherZero, dv, base + edgeBegin
+      , base + leadEnd, reader, inEdges, edgeIndexCSC, vertexData, edgeData
+      , terms);
+    carryVertex = i;
+  }
+
+  for( Int i = vertexBegin; i < vertexEnd; ++i )
+  {
+    Int dv = active[i];
+    GatherResult sum = Program::gatherZero;
+    bool complete = true;
+    if( haveGather )
+    {
+      Int base = inEdges.offsets[dv] - edgeCountScan[i];
+      Int e1 = edgeCountScan[i + 1];
+      if( e1 > edgeEnd )
+      {
+        e1 = edgeEnd;
+        complete = false;
+      }
+      sum = Gather::reduce(sum, dv, base + edgeCountScan[i], base + e1
+        , reader, inEdges, edgeIndexCSC, vertexData, edgeData, terms);
+    }
+
+    if( complete )
+    {
+      applyScatterVertex<Program, Int>(dv, sum, dstOffsets, dsts, edgeIndexCSR
+        , vertexData, vertexDataNext, edgeData, frontier, tid, haveScatter);
+    }
+    else
+    {
+      tailOut    = sum;
+      tailVertex = i;
+    }
+  }
+}
+
+
+//Activate (and optionally scatter to) the out-neighbors of the vertices in
+//one partition whose applyRet is set.  edgeCountScan must have been computed
+//with zero degree for vertices that do not activate.  No reduction is
+//involved, so a vertex split across partitions needs no fixup.
+template<typename Program, typename Int>
+void scatterActivateRange(Int vertexBegin, Int vertexEnd
+  , Int edgeBegin, Int edgeEnd
+  , const Int *active
+  , const Int *edgeCountScan
+  , const Int *dstOffsets
+  , const Int *dsts
+  , const Int *edgeIndexCSR
+  , typename Program::VertexData *vertexData
+  , typename Program::EdgeData   *edgeData
+  , Frontier<Int> &frontier
+  , int tid
+  , bool haveScatter)
+{
+  //the edges of this partition belong to vertexBegin - 1 (if the partition
+  //starts mid-vertex) through vertexEnd - 1
+  for( Int i = vertexBegin > 0 ? vertexBegin - 1 : 0; i < vertexEnd; ++i )
+  {
+    Int e0 = edgeCountScan[i] > edgeBegin ? edgeCountScan[i] : edgeBegin;
+    Int e1 = edgeCountScan[i + 1] < edgeEnd ? edgeCountScan[i + 1] : edgeEnd;
+    if( e0 >= e1 )
+      continue;
+
+    Int sv = active[i];
+    Int base = dstOffsets[sv] - edgeCountScan[i];
+    for( Int e = e0; e < e1; ++e )
+    {
+      Int ie = base + e;
+      Int dv = dsts[ie];
+      if( GASTraits::ActivateFilter<Program>::canActivate(vertexData + dv) )
+        frontier.insert(dv, tid);
+      if( haveScatter )
+      {
+        Program::scatter(vertexData + sv, vertexData + dv
+          , edgeData + (edgeIndexCSR ? edgeIndexCSR[ie] : ie));
+      }
+    }
+  }
+}
+
+
+//A delta for the cached gather result of dst, or with keep false the
+//request to drop it (see GASTraits::DeltaCache)
+template<typename Int, typename GatherResult>
+struct DeltaPost
+{
+  Int          dst;
+  GatherResult delta;
+  bool         keep;
+};
+
+
+//Reduce one posted delta into the cached gather result of its vertex
+template<typename Program, typename Int>
+void reduceDelta(const DeltaPost<Int, typename Program::GatherResult> &post
+  , typename Program::GatherResult *cachedResults, char *cacheValid)
+{
+  if( !post.keep )
+    cacheValid[post.dst] = 0;
+  else if( cacheValid[post.dst] )
+    cachedResults[post.dst] = Program::gatherReduce(cachedResults[post.dst], post.delta);
+}
+
+
+//Post the deltas of one scatter partition, after scatterActivateRange on
+//the same partition.  Vertex dst is owned by thread dst * nThreads /
+//nVertices.  Deltas for the calling thread's own vertices are reduced
+//right away, the others go to posts[owner] for their owner to reduce after
+//a barrier, so no vertex is updated by two threads.
+template<typename Program, typename Int>
+void postDeltaRange(Int vertexBegin, Int vertexEnd
+  , Int edgeBegin, Int edgeEnd
+  , const Int *active
+  , const Int *edgeCountScan
+  , const Int *dstOffsets
+  , const Int *dsts
+  , const Int *edgeIndexCSR
+  , const typename Program::VertexData *vertexData
+  , const typename Program::EdgeData   *edgeData
+  , typename Program::GatherResult     *cachedResults
+  , char *cacheValid
+  , Int nVertices
+  , int nThreads
+  , int tid
+  , std::vector< DeltaPost<Int, typename Program::GatherResult> > *posts)
+{
+  Int ownBegin = (Int)((int64_t)nVertices * tid / nThreads);
+  Int ownEnd   = (Int)((int64_t)nVertices * (tid + 1) / nThreads);
+  DeltaPost<Int, typename Program::GatherResult> post;
+  for( Int i = vertexBegin > 0 ? vertexBegin - 1 : 0; i < vertexEnd; ++i )
+  {
+    Int e0 = edgeCountScan[i] > edgeBegin ? edgeCountScan[i] : edgeBegin;
+    Int e1 = edgeCountScan[i + 1] < edgeEnd ? edgeCountScan[i + 1] : edgeEnd;
+    if( e0 >= e1 )
+      continue;
+
+    Int sv = active[i];
+    Int base = dstOffsets[sv] - edgeCountScan[i];
+    for( Int e = e0; e < e1; ++e )
+    {
+      Int ie = base + e;
+      post.dst = dsts[ie];
+      post.keep = GASTraits::DeltaCache<Program>::postDelta(vertexData + sv
+        , vertexData + post.dst, edgeData + (edgeIndexCSR ? edgeIndexCSR[ie] : ie)
+        , &post.delta);
+      if( post.dst >= ownBegin && post.dst < ownEnd )
+        reduceDelta<Program>(post, cachedResults, cacheValid);
+      else
+        posts[(int64_t)post.dst * nThreads / nVertices].push_back(post);
+    }
+  }
+}
+
+
+//Bottom-up activation for the vertices [vertexBegin, vertexEnd): each vertex
+//that can still be activated scans its in-edges for a source flagged in
+//sources and stops at the first hit.
+template<typename Program, typename Int>
+void pullActivateRange(Int vertexBegin, Int vertexEnd
+  , const Int *srcOffsets
+  , const Int *srcs
+  , const typename Program::VertexData *vertexData
+  , const char *sources
+  , Frontier<Int> &frontier
+  , int tid)
+{
+  for( Int dv = vertexBegin; dv < vertexEnd; ++dv )
+  {
+    if( !GASTraits::ActivateFilter<Program>::canActivate(vertexData + dv) )
+      continue;
+    Int edgeEnd = srcOffsets[dv + 1];
+    for( Int ie = srcOffsets[dv]; ie < edgeEnd; ++ie )
+    {
+      if( sources[srcs[ie]] )
+      {
+        frontier.insert(dv, tid);
+        break;
+      }
+    }
+  }
+}
+
+
+//Delta stepping relaxation of sv: activate the targets of its light
+//(weight <= delta) or heavy out-edges.
+template<typename Program, typename Int>
+void relaxVertex(Int sv, bool light, double delta
+  , const Int *dstOffsets
+  , const Int *dsts
+  , const Int *edgeIndexCSR
+  , const typename Program::VertexData *vertexData
+  , const typename Program::EdgeData *edgeData
+  , Frontier<Int> &frontier
+  , int tid)
+{
+  Int edgeEnd = dstOffsets[sv + 1];
+  for( Int ie = dstOffsets[sv]; ie < edgeEnd; ++ie )
+  {
+    double w = GASTraits::EdgeWeight<Program>::edgeWeight(edgeData
+      + (edgeIndexCSR ? edgeIndexCSR[ie] : ie));
+    Int dv = dsts[ie];
+    if( (w <= delta) == light
+      && GASTraits::ActivateFilter<Program>::canActivate(vertexData + dv) )
+      frontier.insert(dv, tid);
+  }
+}
+
+
+//NUMA diagnostics: count the gather reads of source vertex data in one
+//partition that hit the node owning [localBegin, localEnd) and those that
+//go to another node.
+template<typename Int>
+void countNodeReads(Int vertexBegin, Int edgeBegin, Int edgeEnd
+  , const Int *active
+  , const Int *edgeCountScan
+  , const Int *srcOffsets
+  , const Int *srcs
+  , Int localBegin, Int localEnd
+  , int64_t &local, int64_t &remote)
+{
+  int64_t nLocal = 0;
+  Int i = vertexBegin > 0 ? vertexBegin - 1 : 0;
+  for( Int e = edgeBegin; e < edgeEnd; ++e )
+  {
+    while( edgeCountScan[i + 1] <= e )
+      ++i;
+    Int src = srcs[srcOffsets[active[i]] + e - edgeCountScan[i]];
+    nLocal += (src >= localBegin && src < localEnd) ? 1 : 0;
+  }
+  local  += nLocal;
+  remote += (edgeEnd - edgeBegin) - nLocal;
+}
+
+
+} //end namespace CPUGASKernels
+
+
+#endif
@@ -4,6 +4,43 @@
 #include <stdio.h>
 #include <iostream>
 
+//counts the edges of a graph
+class CountSink : public EdgeSink
+{
+public:
+  long nEdges;
+
+  CountSink() : nEdges(0) {}
+
+  void edges(const int *, const int *, const int *, size_t n) {
+    nEdges += n;
+  }
+};
+
+//writes every edge numReps times, each copy shifted to its own vertex range
+class WriteSink : public EdgeSink
+{
+public:
+  WriteSink(FILE *f, long firstVertex, long nVertices, int numReps)
+    : f(f), firstVertex(firstVertex), nVertices(nVertices), numReps(numReps) {}
+
+  void edges(const int *srcs, const int *dsts, const int *, size_t n) {
+    for (int r = 0; r < numReps; ++r) {
+      long offset = firstVertex + r * nVertices;
+      for (size_t e = 0; e < n; ++e) {
+        //+1 is because the loading routine shifted down by 1, so need to shift back up
+        fprintf(f, "%ld %ld\n", srcs[e] + offset + 1, dsts[e] + offset + 1);
+      }
+    }
+  }
+
+private:
+  FILE *f;
+  long firstVertex;
+  long nVertices;
+  int numReps;
+};
+
 int main(int argc, char **argv) {
   if (argc % 2 != 0) {
     std::cerr << "Usage: ./createCCGraph graph repetitions [graph] [repetitions] [graph] [repetitions] outputfile" << std::endl;
@@ -12,36 +49,34 @@ int main(int argc, char **argv) {
 
   int numGraphs = (argc - 2) / 2;
 
-  std::vector<std::vector<int> > srcs(numGraphs);
-  std::vector<std::vector<int> > dsts(numGraphs);
   std::vector<int> nVertices(numGraphs);
   std::vector<int> numReps(numGraphs);
 
-  //for now we load all graphs into memory at once - could be changed to be less
-  //memory intensive at the cost of loading the graphs twice
+  //the graphs are streamed twice, once to count and once to write, so only
+  //one chunk of edges is in memory at a time
   long totalVertices = 0;
   long totalEdges = 0;
   for (int i = 0; i < numGraphs; ++i) {
-    loadGraph_MatrixMarket(argv[2 * i + 1], nVertices[i], srcs[i], dsts[i], NULL);
+    CountSink count;
+    streamGraph(argv[2 * i + 1], count, nVertices[i]);
     numReps[i] = atoi(argv[2 * i + 2]);
-    totalVertices += nVertices[i] * numReps[i];
-    totalEdges += srcs[i].size() * numReps[i];
+    totalVertices += (long)nVertices[i] * numReps[i];
+    totalEdges += count.nEdges * numReps[i];
   }
 
   FILE *f = fopen(argv[argc - 1], "w");
 
   fprintf(f, "%%%%MatrixMarket matrix coordinate Pattern symmetric\n");
-  fprintf(f, "%zd %zd %zd\n", totalVertices, totalVertices, totalEdges);
+  fprintf(f, "%ld %ld %ld\n", totalVertices, totalVertices, totalEdges);
 
   long previousVertices = 0;
   for (int g = 0; g < numGraphs; ++g) {
-    for (int r = 0; r < numReps[g]; ++r) {
-      for (int e = 0; e < srcs[g].size(); ++e) {
-        //+1 is because the loading routine shifted down by 1, so need to shift back up
-        fprintf(f, "%zd %zd\n", srcs[g][e] + previousVertices + 1, dsts[g][e] + previousVertices + 1);
-      }
-      previousVertices += nVertices[g];
-    }
+    //copies of a chunk are written together, so the edges come out grouped
+    //by chunk rather than by copy; the graph is the same
+    WriteSink write(f, previousVertices, nVertices[g], numReps[g]);
+    int n;
+    streamGraph(argv[2 * g + 1], write, n);
+    previousVertices += (long)nVertices[g] * numReps[g];
   }
 
   fclose(f);
@@ -0,0 +1,280 @@
+/******************************************************************************
+Copyright 2013 Royal Caliber LLC. (http://www.royal-caliber.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************************/
+
+#ifndef CSR_H__
+#define CSR_H__
+
+//Host routines for building CSR and CSC graphs from edge lists and from each
+//other.  These need no CUDA, so the graph loaders use them as well.
+//
+//Int is the vertex type and EdgeInt the type of edge offsets and edge
+//indices, which is deduced from the offsets array.  A 64-bit EdgeInt with
+//32-bit vertices gives graphs of more than 2^31 edges without doubling the
+//size of the vertex arrays.
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+//Keeps the enclosing argument out of template argument deduction, so that
+//nEdges and index arguments (which may be a literal 0) take EdgeInt from the
+//offsets
+template<typename T>
+struct CSRNoDeduce
+{
+  typedef T type;
+};
+
+
+//in place exclusive scan of a histogram shifted by one: on entry
+//offsets[v + 1] is the count of v and offsets[0] is 0
+template<typename Int, typename EdgeInt>
+void scanCSROffsets(Int nVertices, EdgeInt *offsets)
+{
+  for( Int v = 0; v < nVertices; ++v )
+    offsets[v + 1] += offsets[v];
+}
+
+
+//Helpers for edgeListToCS*() and transposeCSR()
+//The builders are stable counting sorts of the edges by a key vertex.
+//Each thread counts the keys of its own static chunk of edges, the counts
+//are scanned in (vertex, thread) order, and each thread then places its
+//chunk from its own cursors, so no atomics are needed and the edges of a
+//vertex keep their input order for any number of threads.
+template<typename Int, typename EdgeInt>
+struct CSRBins
+{
+  int                  nThreads;
+  Int                  nVertices;
+  EdgeInt              nEdges;
+  std::vector<EdgeInt> next; //next[t * nVertices + v], see bin()
+
+  //The cursors take nThreads * nVertices entries, so fewer threads are used
+  //on sparse graphs to keep them no larger than the edge arrays.
+  CSRBins(Int nVertices_, EdgeInt nEdges_)
+    : nThreads(1)
+    , nVertices(nVertices_)
+    , nEdges(nEdges_)
+  {
+#ifdef _OPENMP
+    int64_t limit = nVertices ? (int64_t)nEdges / nVertices + 1 : 1;
+    nThreads = (int)std::max((int64_t)1
+      , std::min((int64_t)omp_get_max_threads(), limit));
+#endif
+    next.resize((size_t)nThreads * nVertices);
+  }
+
+  //thread t's chunk of edges is begin(t) .. begin(t + 1) - 1
+  EdgeInt begin(int t) const
+  {
+    return nEdges / nThreads * t + std::min((EdgeInt)t, nEdges % nThreads);
+  }
+
+  //count of key v in thread t's chunk, after countCSRBins the position of
+  //its next edge with key v
+  EdgeInt& bin(int t, Int v)
+  {
+    return next[(size_t)t * nVertices + v];
+  }
+};
+
+
+//count the keys of every chunk into bins and the degrees into offsets,
+//then turn the counts into each thread's first position per vertex
+template<typename Int, typename EdgeInt>
+void countCSRBins(const Int *keys, EdgeInt *offsets
+  , CSRBins<Int, EdgeInt> &bins)
+{
+  Int nVertices = bins.nVertices;
+  #pragma omp parallel for schedule(static, 1) num_threads(bins.nThreads)
+  for( int t = 0; t < bins.nThreads; ++t )
+  {
+    EdgeInt end = bins.begin(t + 1);
+    for( EdgeInt i = bins.begin(t); i < end; ++i )
+      ++bins.bin(t, keys[i]);
+  }
+
+  //exclusive scan over the threads of each vertex, the totals shifted by
+  //one into offsets
+  offsets[0] = 0;
+  #pragma omp parallel for schedule(static) num_threads(bins.nThreads)
+  for( Int v = 0; v < nVertices; ++v )
+  {
+    EdgeInt sum = 0;
+    for( int t = 0; t < bins.nThreads; ++t )
+    {
+      EdgeInt count = bins.bin(t, v);
+      bins.bin(t, v) = sum;
+      sum += count;
+    }
+    offsets[v + 1] = sum;
+  }
+  scanCSROffsets(nVertices, offsets);
+
+  #pragma omp parallel for schedule(static) num_threads(bins.nThreads)
+  for( Int v = 0; v < nVertices; ++v )
+  {
+    for( int t = 0; t < bins.nThreads; ++t )
+      bins.bin(t, v) += offsets[v];
+  }
+}
+
+
+//convert a list of edges into a CSR representation of the adjacency matrix
+//This is a counting sort on the sources, O(nVertices + nEdges), and runs in
+//parallel when built with OpenMP.  Edges of a vertex keep their order in the
+//edge list, so the result is the same for any number of threads.
+//offsets should have nVertices + 1 elements.  outDsts and sortIndices may
+//be null: sortIndices[i] is the edge list position of CSR edge i, with only
+//offsets requested this just counts degrees.  Scratch is O(nVertices + nEdges)
+//at most, see CSRBins.
+template<typename Int, typename EdgeInt>
+void edgeListToCSR(Int nVertices, typename CSRNoDeduce<EdgeInt>::type nEdges
+  , const Int *srcs, const Int *dsts
+  , EdgeInt *offsets, Int *outDsts
+  , typename CSRNoDeduce<EdgeInt>::type *sortIndices)
+{
+  CSRBins<Int, EdgeInt> bins(nVertices, nEdges);
+  countCSRBins(srcs, offsets, bins);
+
+  if( !outDsts && !sortIndices )
+    return;
+
+  //every thread places its chunk behind the earlier threads' edges
+  #pragma omp parallel for schedule(static, 1) num_threads(bins.nThreads)
+  for( int t = 0; t < bins.nThreads; ++t )
+  {
+    EdgeInt end = bins.begin(t + 1);
+    for( EdgeInt i = bins.begin(t); i < end; ++i )
+    {
+      EdgeInt pos = bins.bin(t, srcs[i])++;
+      if( sortIndices )
+        sortIndices[pos] = i;
+      if( outDsts )
+        outDsts[pos] = dsts[i];
+    }
+  }
+}
+
+
+//Build the CSR (out-edges) and CSC (in-edges) layouts together, reading the
+//edge list once to count both degrees and once to scatter into both.
+//Output is identical to edgeListToCSR + edgeListToCSC with the same
+//arguments, and the same arrays may be null.
+template<typename Int, typename EdgeInt>
+void edgeListToCSRAndCSC(Int nVertices, typename CSRNoDeduce<EdgeInt>::type nEdges
+  , const Int *srcs, const Int *dsts
+  , EdgeInt *dstOffsets, Int *outDsts
+  , typename CSRNoDeduce<EdgeInt>::type *csrIndices
+  , typename CSRNoDeduce<EdgeInt>::type *srcOffsets, Int *outSrcs
+  , typename CSRNoDeduce<EdgeInt>::type *cscIndices)
+{
+  CSRBins<Int, EdgeInt> csrBins(nVertices, nEdges);
+  CSRBins<Int, EdgeInt> cscBins(nVertices, nEdges);
+  countCSRBins(srcs, dstOffsets, csrBins);
+  countCSRBins(dsts, srcOffsets, cscBins);
+
+  bool csr = outDsts || csrIndices;
+  bool csc = outSrcs || cscIndices;
+  if( !csr && !csc )
+    return;
+
+  //both bins have the same chunks
+  #pragma omp parallel for schedule(static, 1) num_threads(csrBins.nThreads)
+  for( int t = 0; t < csrBins.nThreads; ++t )
+  {
+    EdgeInt end = csrBins.begin(t + 1);
+    for( EdgeInt i = csrBins.begin(t); i < end; ++i )
+    {
+      Int src = srcs[i];
+      Int dst = dsts[i];
+      if( csr )
+      {
+        EdgeInt pos = csrBins.bin(t, src)++;
+        if( csrIndices )
+          csrIndices[pos] = i;
+        if( outDsts )
+          outDsts[pos] = dst;
+      }
+      if( csc )
+      {
+        EdgeInt pos = cscBins.bin(t, dst)++;
+        if( cscIndices )
+          cscIndices[pos] = i;
+        if( outSrcs )
+          outSrcs[pos] = src;
+      }
+    }
+  }
+}
+
+
+//Transpose a CSR graph into CSC (or the other way round), the counting sort
+//of edgeListToCSR run over the CSR edges.  outIndices[i] is the CSR position
+//of CSC edge i.  outSrcs or outIndices may be null.  outOffsets should have
+//nVertices + 1 elements.
+template<typename Int, typename EdgeInt>
+void transposeCSR(Int nVertices, typename CSRNoDeduce<EdgeInt>::type nEdges
+  , const EdgeInt *offsets, const Int *dsts
+  , typename CSRNoDeduce<EdgeInt>::type *outOffsets, Int *outSrcs
+  , typename CSRNoDeduce<EdgeInt>::type *outIndices)
+{
+  CSRBins<Int, EdgeInt> bins(nVertices, nEdges);
+  countCSRBins(dsts, outOffsets, bins);
+
+  if( !outSrcs && !outIndices )
+    return;
+
+  #pragma omp parallel for schedule(static, 1) num_threads(bins.nThreads)
+  for( int t = 0; t < bins.nThreads; ++t )
+  {
+    EdgeInt begin = bins.begin(t);
+    EdgeInt end   = bins.begin(t + 1);
+    //source of the first edge of the chunk
+    Int v = (Int)(std::upper_bound(offsets, offsets + nVertices + 1, begin)
+      - offsets) - 1;
+    for( EdgeInt i = begin; i < end; ++i )
+    {
+      while( offsets[v + 1] <= i )
+        ++v;
+      EdgeInt pos = bins.bin(t, dsts[i])++;
+      if( outSrcs )
+        outSrcs[pos] = v;
+      if( outIndices )
+        outIndices[pos] = i;
+    }
+  }
+}
+
+
+//convert a list of edges into a CSC representation of the adjacency matrix
+template<typename Int, typename EdgeInt>
+void edgeListToCSC(Int nVertices, typename CSRNoDeduce<EdgeInt>::type nEdges
+  , const Int *srcs, const Int *dsts
+  , EdgeInt *offsets, Int *outSrcs
+  , typename CSRNoDeduce<EdgeInt>::type *sortIndices)
+{
+  edgeListToCSR<Int, EdgeInt>(nVertices, nEdges, dsts, srcs
+    , offsets, outSrcs, sortIndices);
+};
+
+
+#endif
@@ -0,0 +1,328 @@
+/******************************************************************************
+Copyright 2013 Royal Caliber LLC. (http://www.royal-caliber.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************************/
+
+#ifndef FRONTIER_H__
+#define FRONTIER_H__
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+
+//Next-iteration frontier for the CPU engines.
+//
+//Membership is always tracked in a word-packed bitmap so that a vertex is
+//only added once.  How the frontier is turned back into an active list
+//depends on its expected size:
+//-  sparse: each thread also appends newly set vertices to its own queue.
+//   finish() concatenates the queues and clears only the bits that were set,
+//   so the cost is proportional to the frontier, not the graph.
+//-  dense: no queues are kept, finish() scans the bitmap a word at a time.
+//
+//The mode is chosen in begin() from an upper bound on the frontier size
+//(usually the number of edges being scattered) relative to nVertices.
+template<typename Int>
+class Frontier
+{
+  //one queue per thread, padded so that threads appending to their own
+  //queue don't share a cache line
+  struct Queue
+  {
+    std::vector<Int> verts;
+    char pad[64];
+  };
+
+  Int       m_nVertices;
+  Int       m_nWords;
+  uint64_t *m_bits;
+  int       m_nThreads;
+  Queue    *m_queues;
+  Int      *m_threadCounts;
+  float     m_threshold;
+  bool      m_dense;
+
+  void release()
+  {
+    delete [] m_bits;
+    delete [] m_queues;
+    delete [] m_threadCounts;
+    m_bits = 0;
+    m_queues = 0;
+    m_threadCounts = 0;
+  }
+
+  public:
+    Frontier()
+      : m_nVertices(0)
+      , m_nWords(0)
+      , m_bits(0)
+      , m_nThreads(0)
+      , m_queues(0)
+      , m_threadCounts(0)
+      , m_threshold(0.05f)
+      , m_dense(false)
+    {}
+
+    ~Frontier()
+    {
+      release();
+    }
+
+    void init(Int nVertices, int nThreads)
+    {
+      release();
+      m_nVertices = nVertices;
+      m_nWords    = (nVertices + 63) / 64;
+      m_nThreads  = nThreads;
+      m_bits      = new uint64_t[m_nWords];
+      m_queues    = new Queue[nThreads];
+      m_threadCounts = new Int[nThreads + 1];
+      m_dense     = false;
+
+      #pragma omp parallel for num_threads(m_nThreads) schedule(static)
+      for( Int i = 0; i < m_nWords; ++i )
+        m_bits[i] = 0;
+    }
+
+    //fraction of nVertices above which the frontier is built densely
+    void setThreshold(float threshold)
+    {
+      m_threshold = threshold;
+    }
+
+    float threshold() const
+    {
+      return m_threshold;
+    }
+
+    bool isDense() const
+    {
+      return m_dense;
+    }
+
+    //start collecting a new frontier, expectedSize is an upper bound on the
+    //number of vertices that will be inserted
+    void begin(int64_t expectedSize)
+    {
+      m_dense = expectedSize > m_threshold * m_nVertices;
+      if( !m_dense )
+      {
+        for( int t = 0; t < m_nThreads; ++t )
+          m_queues[t].verts.clear();
+      }
+    }
+
+    //thread-safe, tid is the calling thread's omp_get_thread_num()
+    void insert(Int v, int tid)
+    {
+      uint64_t *word = m_bits + (v >> 6);
+      uint64_t  mask = (uint64_t)1 << (v & 63);
+      //cheap test first, most inserts in a dense frontier are repeats
+      if( *word & mask )
+        return;
+      uint64_t old = __sync_fetch_and_or(word, mask);
+      if( !m_dense && !(old & mask) )
+        m_queues[tid].verts.push_back(v);
+    }
+
+    //write the frontier to active in ascending vertex order, reset the
+    //frontier and return its size
+    Int finish(Int *active)
+    {
+      if( m_dense )
+      {
+        #pragma omp parallel num_threads(m_nThreads)
+        {
+          int tid = omp_get_thread_num();
+          Int begin = (Int)((int64_t)m_nWords * tid / m_nThreads);
+          Int end   = (Int)((int64_t)m_nWords * (tid + 1) / m_nThreads);
+
+          Int count = 0;
+          for( Int w = begin; w < end; ++w )
+            count += __builtin_popcountll(m_bits[w]);
+          m_threadCounts[tid + 1] = count;
+
+          #pragma omp barrier
+          #pragma omp single
+          {
+            m_threadCounts[0] = 0;
+            for( int t = 0; t < m_nThreads; ++t )
+              m_threadCounts[t + 1] += m_threadCounts[t];
+          }
+
+          Int out = m_threadCounts[tid];
+          for( Int w = begin; w < end; ++w )
+          {
+            uint64_t bits = m_bits[w];
+            while( bits )
+            {
+              active[out++] = (w << 6) + __builtin_ctzll(bits);
+              bits &= bits - 1;
+            }
+            m_bits[w] = 0;
+          }
+        }
+        return m_threadCounts[m_nThreads];
+      }
+
+      m_threadCounts[0] = 0;
+      for( int t = 0; t < m_nThreads; ++t )
+        m_threadCounts[t + 1] = m_threadCounts[t] + (Int)m_queues[t].verts.size();
+      Int n = m_threadCounts[m_nThreads];
+
+      #pragma omp parallel num_threads(m_nThreads)
+      {
+        int tid = omp_get_thread_num();
+        const std::vector<Int> &q = m_queues[tid].verts;
+        Int out = m_threadCounts[tid];
+        for( size_t i = 0; i < q.size(); ++i )
+        {
+          active[out + i] = q[i];
+          //every set bit in this word is in some queue, so the whole
+          //word can be cleared
+          m_bits[q[i] >> 6] = 0;
+        }
+      }
+
+      //keep the active list sorted for locality in gather
+      std::sort(active, active + n);
+      return n;
+    }
+};
+
+
+//Beamer-style choice between top-down (push from the frontier over CSR) and
+//bottom-up (pull over CSC into vertices that can still be activated) for the
+//activation step.  Go bottom-up once the frontier's out-edges exceed
+//1/alpha of the edges not yet explored, and come back top-down once the
+//frontier is shrinking and smaller than 1/beta of the vertices.
+//The unexplored edge count is an estimate, decremented by the frontier's
+//edges every iteration as in the reference BFS implementation.
+struct DirectionHeuristic
+{
+  int     alpha;
+  int     beta;
+  bool    bottomUp;
+  int64_t edgesUnexplored;
+  int64_t prevFrontierSize;
+
+  DirectionHeuristic()
+    : alpha(15)
+    , beta(18)
+    , bottomUp(false)
+    , edgesUnexplored(0)
+    , prevFrontierSize(0)
+  {}
+
+  //call at the start of every traversal
+  void reset(int64_t nEdges)
+  {
+    bottomUp         = false;
+    edgesUnexplored  = nEdges;
+    prevFrontierSize = 0;
+  }
+
+  //frontierSize is the number of vertices activating their neighbors,
+  //frontierEdges their total out-degree.  Returns true for bottom-up.
+  bool choose(int64_t frontierSize, int64_t frontierEdges, int64_t nVertices)
+  {
+    if( !bottomUp )
+    {
+      if( frontierEdges > edgesUnexplored / alpha )
+        bottomUp = true;
+    }
+    else if( frontierSize < prevFrontierSize && frontierSize < nVertices / beta )
+      bottomUp = false;
+
+    edgesUnexplored -= frontierEdges;
+    if( edgesUnexplored < 0 )
+      edgesUnexplored = 0;
+    prevFrontierSize = frontierSize;
+    return bottomUp;
+  }
+};
+
+
+//Delta stepping buckets: vertices whose value changed and whose out-edges
+//still have to be relaxed, binned by floor(priority / delta).  A vertex can
+//sit in several buckets if it improved more than once, callers drop the
+//stale copies when they take a bucket.
+template<typename Int>
+class DeltaBuckets
+{
+  std::vector< std::vector<Int> > m_buckets;
+  size_t                          m_current;
+
+  public:
+    //bucket indices are clamped to this, so a few vertices with huge
+    //priorities can't blow up the bucket array.  The last bucket collects
+    //all of them, compare against clamp(bucket) when taking it.
+    static const int64_t maxBuckets = 1 << 20;
+
+    static int64_t clamp(int64_t bucket)
+    {
+      return std::min(bucket, maxBuckets - 1);
+    }
+
+    DeltaBuckets()
+      : m_current(0)
+    {}
+
+    void clear()
+    {
+      for( size_t i = 0; i < m_buckets.size(); ++i )
+        m_buckets[i].clear();
+      m_current = 0;
+    }
+
+    size_t current() const
+    {
+      return m_current;
+    }
+
+    //vertices are never put below the current bucket
+    void insert(Int v, int64_t bucket)
+    {
+      size_t b = bucket < (int64_t)m_current ? m_current
+        : (size_t)clamp(bucket);
+      if( b >= m_buckets.size() )
+        m_buckets.resize(b + 1);
+      m_buckets[b].push_back(v);
+    }
+
+    //contents of the current bucket, the caller empties it
+    std::vector<Int>& currentBucket()
+    {
+      if( m_current >= m_buckets.size() )
+        m_buckets.resize(m_current + 1);
+      return m_buckets[m_current];
+    }
+
+    //move to the next non-empty bucket, false if there is none
+    bool advance()
+    {
+      while( ++m_current < m_buckets.size() )
+      {
+        if( !m_buckets[m_current].empty() )
+          return true;
+      }
+      return false;
+    }
+};
+
+
+
+#endif
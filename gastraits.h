@@ -0,0 +1,380 @@
+/******************************************************************************
+Copyright 2013 Royal Caliber LLC. (http://www.royal-caliber.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************************/
+
+#ifndef GASTRAITS_H__
+#define GASTRAITS_H__
+
+//Optional parts of the vertex program interface.
+//
+//A Program must always provide VertexData, EdgeData, GatherResult,
+//gatherZero, gatherMap, gatherReduce, apply and scatter.  The hooks below
+//may be left out; the engines detect them at compile time and fall back to
+//the defaults given here.
+//
+//  static bool canActivate(const VertexData*)
+//    return false if activating the vertex can no longer have any effect,
+//    e.g. an already visited vertex in BFS.  Such vertices are left out of
+//    the next frontier, and the direction optimizing traversal only scans
+//    in-edges of vertices that pass.  Default: always true.
+//
+//  static double priority(const VertexData*)
+//    scheduling key for the asynchronous engine, lower runs first (e.g. the
+//    tentative distance in SSSP).  Default: no priorities, one FIFO
+//    queue per thread.  Also the bucket key of delta stepping in
+//    GASEngineCPU.
+//
+//  static double edgeWeight(const EdgeData*)
+//    length of an edge for the light/heavy split of delta stepping.
+//    Default: 0, all edges are light.
+//
+//  static bool postDelta(const VertexData *src, const VertexData *dst
+//    , const EdgeData *edge, GatherResult *delta)
+//    gather cache of GASEngineRef and GASEngineCPU (setGatherCache), after
+//    GraphLab's delta cache.  Called after scatter on every out-edge of a
+//    vertex whose apply returned true.  Return true with the change of
+//    dst's gather result in *delta, which is reduced into dst's cached
+//    result with gatherReduce, or false to drop dst's cached result.  An
+//    active vertex with a cached result skips its gather.  Only valid if
+//    the gather result of a vertex changes through its in-edges from
+//    vertices that scatter and nothing else.  Default: no gather cache.
+//
+//  typedef GASTraits::PlusReduction GatherReduction  (or MinReduction,
+//    MaxReduction)
+//  static GatherResult gatherSource(const VertexData *src)
+//  static GatherResult gatherEdge(const EdgeData *edge)
+//    vectorized gather of GASEngineRef (gathersimd.h).  Declares that
+//    gatherReduce is the given reduction and that gatherMap(dst, src, edge)
+//    is gatherSource(src) + gatherEdge(edge), independent of dst.
+//    gatherEdge may be left out if the edge adds nothing.  Default: gather
+//    calls gatherMap and gatherReduce on every edge.
+//
+//  static const bool hasGather = false
+//  static const bool hasScatter = false
+//    gatherMap or scatter does nothing.  The engines leave the phase out at
+//    compile time, as if gather(false) or scatterActivate(false) were
+//    called.  Default: true.
+//
+//  static const bool hasEdgeData = false
+//    EdgeData is empty and never read.  The engines keep no edge data
+//    index, which saves two Ints per edge and an indirection in gather and
+//    scatter, and pass the caller's edge data pointer (usually null) for
+//    every edge.  Default: true.
+
+
+namespace GASTraits
+{
+
+typedef char Yes;
+typedef long No;
+
+
+//reductions a Program can declare as its GatherReduction
+struct PlusReduction
+{
+  template<typename T>
+  static T reduce(const T& left, const T& right)
+  {
+    return left + right;
+  }
+};
+
+struct MinReduction
+{
+  template<typename T>
+  static T reduce(const T& left, const T& right)
+  {
+    return right < left ? right : left;
+  }
+};
+
+struct MaxReduction
+{
+  template<typename T>
+  static T reduce(const T& left, const T& right)
+  {
+    return left < right ? right : left;
+  }
+};
+
+
+//HasCanActivate<Program>::value is true if Program::canActivate exists
+template<typename Program>
+struct HasCanActivate
+{
+  template<typename U, bool (*)(const typename U::VertexData*)> struct Check;
+  template<typename U> static Yes test(Check<U, &U::canActivate>*);
+  template<typename U> static No  test(...);
+  enum { value = sizeof(test<Program>(0)) == sizeof(Yes) };
+};
+
+
+template<typename Program, bool has = HasCanActivate<Program>::value>
+struct ActivateFilter
+{
+  enum { enabled = 0 };
+  static bool canActivate(const typename Program::VertexData*)
+  {
+    return true;
+  }
+};
+
+template<typename Program>
+struct ActivateFilter<Program, true>
+{
+  enum { enabled = 1 };
+  static bool canActivate(const typename Program::VertexData* v)
+  {
+    return Program::canActivate(v);
+  }
+};
+
+
+//HasPriority<Program>::value is true if Program::priority exists
+template<typename Program>
+struct HasPriority
+{
+  template<typename U, double (*)(const typename U::VertexData*)> struct Check;
+  template<typename U> static Yes test(Check<U, &U::priority>*);
+  template<typename U> static No  test(...);
+  enum { value = sizeof(test<Program>(0)) == sizeof(Yes) };
+};
+
+
+template<typename Program, bool has = HasPriority<Program>::value>
+struct Priority
+{
+  enum { enabled = 0 };
+  static double priority(const typename Program::VertexData*)
+  {
+    return 0;
+  }
+};
+
+template<typename Program>
+struct Priority<Program, true>
+{
+  enum { enabled = 1 };
+  static double priority(const typename Program::VertexData* v)
+  {
+    return Program::priority(v);
+  }
+};
+
+
+//HasEdgeWeight<Program>::value is true if Program::edgeWeight exists
+template<typename Program>
+struct HasEdgeWeight
+{
+  template<typename U, double (*)(const typename U::EdgeData*)> struct Check;
+  template<typename U> static Yes test(Check<U, &U::edgeWeight>*);
+  template<typename U> static No  test(...);
+  enum { value = sizeof(test<Program>(0)) == sizeof(Yes) };
+};
+
+
+template<typename Program, bool has = HasEdgeWeight<Program>::value>
+struct EdgeWeight
+{
+  enum { enabled = 0 };
+  static double edgeWeight(const typename Program::EdgeData*)
+  {
+    return 0;
+  }
+};
+
+template<typename Program>
+struct EdgeWeight<Program, true>
+{
+  enum { enabled = 1 };
+  static double edgeWeight(const typename Program::EdgeData* e)
+  {
+    return Program::edgeWeight(e);
+  }
+};
+
+
+//HasPostDelta<Program>::value is true if Program::postDelta exists
+template<typename Program>
+struct HasPostDelta
+{
+  template<typename U, bool (*)(const typename U::VertexData*
+    , const typename U::VertexData*, const typename U::EdgeData*
+    , typename U::GatherResult*)> struct Check;
+  template<typename U> static Yes test(Check<U, &U::postDelta>*);
+  template<typename U> static No  test(...);
+  enum { value = sizeof(test<Program>(0)) == sizeof(Yes) };
+};
+
+
+template<typename Program, bool has = HasPostDelta<Program>::value>
+struct DeltaCache
+{
+  enum { enabled = 0 };
+  static bool postDelta(const typename Program::VertexData*
+    , const typename Program::VertexData*, const typename Program::EdgeData*
+    , typename Program::GatherResult*)
+  {
+    return false;
+  }
+};
+
+template<typename Program>
+struct DeltaCache<Program, true>
+{
+  enum { enabled = 1 };
+  static bool postDelta(const typename Program::VertexData* src
+    , const typename Program::VertexData* dst
+    , const typename Program::EdgeData* edge
+    , typename Program::GatherResult* delta)
+  {
+    return Program::postDelta(src, dst, edge, delta);
+  }
+};
+
+
+//HasGatherReduction<Program>::value is true if Program::GatherReduction
+//and Program::gatherSource exist
+template<typename Program>
+struct HasGatherReduction
+{
+  template<typename U, typename U::GatherResult (*)(const typename U::VertexData*)> struct Check;
+  template<typename U> static Yes test(Check<U, &U::gatherSource>*, typename U::GatherReduction* = 0);
+  template<typename U> static No  test(...);
+  enum { value = sizeof(test<Program>(0)) == sizeof(Yes) };
+};
+
+
+template<typename Program, bool has = HasGatherReduction<Program>::value>
+struct VectorGather
+{
+  enum { enabled = 0 };
+  typedef PlusReduction Reduction;
+  static typename Program::GatherResult gatherSource(const typename Program::VertexData*)
+  {
+    return Program::gatherZero;
+  }
+};
+
+template<typename Program>
+struct VectorGather<Program, true>
+{
+  enum { enabled = 1 };
+  typedef typename Program::GatherReduction Reduction;
+  static typename Program::GatherResult gatherSource(const typename Program::VertexData* src)
+  {
+    return Program::gatherSource(src);
+  }
+};
+
+
+//HasGatherEdge<Program>::value is true if Program::gatherEdge exists
+template<typename Program>
+struct HasGatherEdge
+{
+  template<typename U, typename U::GatherResult (*)(const typename U::EdgeData*)> struct Check;
+  template<typename U> static Yes test(Check<U, &U::gatherEdge>*);
+  template<typename U> static No  test(...);
+  enum { value = sizeof(test<Program>(0)) == sizeof(Yes) };
+};
+
+
+template<typename Program, bool has = HasGatherEdge<Program>::value>
+struct GatherEdge
+{
+  enum { enabled = 0 };
+  static typename Program::GatherResult gatherEdge(const typename Program::EdgeData*)
+  {
+    return typename Program::GatherResult();
+  }
+};
+
+template<typename Program>
+struct GatherEdge<Program, true>
+{
+  enum { enabled = 1 };
+  static typename Program::GatherResult gatherEdge(const typename Program::EdgeData* edge)
+  {
+    return Program::gatherEdge(edge);
+  }
+};
+
+
+//HasGatherFlag<Program>::value is true if Program::hasGather exists, and
+//so on
+template<typename Program>
+struct HasGatherFlag
+{
+  template<bool> struct Check;
+  template<typename U> static Yes test(Check<U::hasGather>*);
+  template<typename U> static No  test(...);
+  enum { value = sizeof(test<Program>(0)) == sizeof(Yes) };
+};
+
+template<typename Program>
+struct HasScatterFlag
+{
+  template<bool> struct Check;
+  template<typename U> static Yes test(Check<U::hasScatter>*);
+  template<typename U> static No  test(...);
+  enum { value = sizeof(test<Program>(0)) == sizeof(Yes) };
+};
+
+template<typename Program>
+struct HasEdgeDataFlag
+{
+  template<bool> struct Check;
+  template<typename U> static Yes test(Check<U::hasEdgeData>*);
+  template<typename U> static No  test(...);
+  enum { value = sizeof(test<Program>(0)) == sizeof(Yes) };
+};
+
+
+template<typename Program, bool has = HasGatherFlag<Program>::value>
+struct GatherFlag { enum { value = 1 }; };
+
+template<typename Program>
+struct GatherFlag<Program, true> { enum { value = Program::hasGather }; };
+
+template<typename Program, bool has = HasScatterFlag<Program>::value>
+struct ScatterFlag { enum { value = 1 }; };
+
+template<typename Program>
+struct ScatterFlag<Program, true> { enum { value = Program::hasScatter }; };
+
+template<typename Program, bool has = HasEdgeDataFlag<Program>::value>
+struct EdgeDataFlag { enum { value = 1 }; };
+
+template<typename Program>
+struct EdgeDataFlag<Program, true> { enum { value = Program::hasEdgeData }; };
+
+
+//the phases and data a Program uses, with the defaults filled in
+template<typename Program>
+struct Phases
+{
+  enum
+  {
+    hasGather   = GatherFlag<Program>::value,
+    hasScatter  = ScatterFlag<Program>::value,
+    hasEdgeData = EdgeDataFlag<Program>::value
+  };
+};
+
+
+} //end namespace GASTraits
+
+
+#endif
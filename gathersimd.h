@@ -0,0 +1,231 @@
+/******************************************************************************
+Copyright 2013 Royal Caliber LLC. (http://www.royal-caliber.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************************/
+
+#ifndef GATHERSIMD_H__
+#define GATHERSIMD_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "gastraits.h"
+
+//Vectorized gather for programs that declare a GatherReduction (see
+//gastraits.h).  The engine keeps gatherSource(v) of every vertex in a
+//dense array and gatherEdge of every in-edge in CSC order in another, so
+//the gather of a vertex is a reduction over
+//
+//  source[srcs[ie]] + edge[ie]
+//
+//for its in-edges ie.  With 32 bit vertex and edge indices and an int or
+//float result, this is done with AVX-512 or AVX2 gather instructions when
+//the host compiler targets them (e.g. -Xcompiler -march=native), one lane
+//per in-edge and a single horizontal reduction at the end.  Otherwise, and
+//for the remainder of each vertex's in-edges, a scalar loop.  Float sums
+//are added in a different order than by the scalar loop.
+
+#if !defined(__CUDA_ARCH__) && (defined(__AVX512F__) || defined(__AVX2__))
+#include <immintrin.h>
+#define GATHERSIMD_LANES 1
+#endif
+
+
+namespace GatherSIMD
+{
+
+template<typename Reduction, typename T, typename Int, typename EdgeInt>
+struct ScalarKernel
+{
+  static T gather(T sum, const T *source, const Int *srcs
+    , const T *edge, EdgeInt begin, EdgeInt end)
+  {
+    if( edge )
+    {
+      for( EdgeInt ie = begin; ie < end; ++ie )
+        sum = Reduction::reduce(sum, (T)(source[srcs[ie]] + edge[ie]));
+    }
+    else
+    {
+      for( EdgeInt ie = begin; ie < end; ++ie )
+        sum = Reduction::reduce(sum, source[srcs[ie]]);
+    }
+    return sum;
+  }
+};
+
+
+template<typename Reduction, typename T, typename Int, typename EdgeInt>
+struct Kernel : public ScalarKernel<Reduction, T, Int, EdgeInt> {};
+
+
+#ifdef GATHERSIMD_LANES
+
+//vector type and operations per result type
+template<typename T> struct Lanes;
+
+#ifdef __AVX512F__
+
+template<>
+struct Lanes<float>
+{
+  typedef __m512 Vec;
+  enum { width = 16 };
+  static Vec gather(const float *base, const int32_t *index)
+  {
+    return _mm512_i32gather_ps(_mm512_loadu_si512((const void*)index), base, 4);
+  }
+  static Vec load(const float *p) { return _mm512_loadu_ps(p); }
+  static void store(float *out, Vec v) { _mm512_storeu_ps(out, v); }
+  static Vec add(Vec a, Vec b) { return _mm512_add_ps(a, b); }
+  static Vec min(Vec a, Vec b) { return _mm512_min_ps(a, b); }
+  static Vec max(Vec a, Vec b) { return _mm512_max_ps(a, b); }
+};
+
+template<>
+struct Lanes<int32_t>
+{
+  typedef __m512i Vec;
+  enum { width = 16 };
+  static Vec gather(const int32_t *base, const int32_t *index)
+  {
+    return _mm512_i32gather_epi32(_mm512_loadu_si512((const void*)index), base, 4);
+  }
+  static Vec load(const int32_t *p) { return _mm512_loadu_si512((const void*)p); }
+  static void store(int32_t *out, Vec v) { _mm512_storeu_si512((void*)out, v); }
+  static Vec add(Vec a, Vec b) { return _mm512_add_epi32(a, b); }
+  static Vec min(Vec a, Vec b) { return _mm512_min_epi32(a, b); }
+  static Vec max(Vec a, Vec b) { return _mm512_max_epi32(a, b); }
+};
+
+#else
+
+template<>
+struct Lanes<float>
+{
+  typedef __m256 Vec;
+  enum { width = 8 };
+  static Vec gather(const float *base, const int32_t *index)
+  {
+    return _mm256_i32gather_ps(base, _mm256_loadu_si256((const __m256i*)index), 4);
+  }
+  static Vec load(const float *p) { return _mm256_loadu_ps(p); }
+  static void store(float *out, Vec v) { _mm256_storeu_ps(out, v); }
+  static Vec add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+  static Vec min(Vec a, Vec b) { return _mm256_min_ps(a, b); }
+  static Vec max(Vec a, Vec b) { return _mm256_max_ps(a, b); }
+};
+
+template<>
+struct Lanes<int32_t>
+{
+  typedef __m256i Vec;
+  enum { width = 8 };
+  static Vec gather(const int32_t *base, const int32_t *index)
+  {
+    return _mm256_i32gather_epi32((const int*)base, _mm256_loadu_si256((const __m256i*)index), 4);
+  }
+  static Vec load(const int32_t *p) { return _mm256_loadu_si256((const __m256i*)p); }
+  static void store(int32_t *out, Vec v) { _mm256_storeu_si256((__m256i*)out, v); }
+  static Vec add(Vec a, Vec b) { return _mm256_add_epi32(a, b); }
+  static Vec min(Vec a, Vec b) { return _mm256_min_epi32(a, b); }
+  static Vec max(Vec a, Vec b) { return _mm256_max_epi32(a, b); }
+};
+
+#endif
+
+
+//lane-wise reduction
+template<typename Reduction, typename T> struct LaneReduce;
+
+template<typename T>
+struct LaneReduce<GASTraits::PlusReduction, T>
+{
+  typedef typename Lanes<T>::Vec Vec;
+  static Vec reduce(Vec a, Vec b) { return Lanes<T>::add(a, b); }
+};
+
+template<typename T>
+struct LaneReduce<GASTraits::MinReduction, T>
+{
+  typedef typename Lanes<T>::Vec Vec;
+  static Vec reduce(Vec a, Vec b) { return Lanes<T>::min(a, b); }
+};
+
+template<typename T>
+struct LaneReduce<GASTraits::MaxReduction, T>
+{
+  typedef typename Lanes<T>::Vec Vec;
+  static Vec reduce(Vec a, Vec b) { return Lanes<T>::max(a, b); }
+};
+
+
+template<typename Reduction, typename T>
+struct LaneKernel
+{
+  typedef Lanes<T> L;
+  typedef typename L::Vec Vec;
+
+  static Vec terms(const T *source, const int32_t *srcs, const T *edge
+    , int32_t ie)
+  {
+    Vec v = L::gather(source, srcs + ie);
+    if( edge )
+      v = L::add(v, L::load(edge + ie));
+    return v;
+  }
+
+  static T gather(T sum, const T *source, const int32_t *srcs
+    , const T *edge, int32_t begin, int32_t end)
+  {
+    if( end - begin >= (int32_t)L::width )
+    {
+      Vec acc = terms(source, srcs, edge, begin);
+      for( begin += L::width; end - begin >= (int32_t)L::width; begin += L::width )
+        acc = LaneReduce<Reduction, T>::reduce(acc
+          , terms(source, srcs, edge, begin));
+      T lanes[L::width];
+      L::store(lanes, acc);
+      for( int i = 0; i < L::width; ++i )
+        sum = Reduction::reduce(sum, lanes[i]);
+    }
+    return ScalarKernel<Reduction, T, int32_t, int32_t>::gather(sum, source, srcs
+      , edge, begin, end);
+  }
+};
+
+
+template<typename Reduction>
+struct Kernel<Reduction, float, int32_t, int32_t>
+  : public LaneKernel<Reduction, float> {};
+
+template<typename Reduction>
+struct Kernel<Reduction, int32_t, int32_t, int32_t>
+  : public LaneKernel<Reduction, int32_t> {};
+
+#endif
+
+
+//reduce sum with the terms of in-edges begin .. end - 1; edge may be null
+//if the program has no gatherEdge
+template<typename Reduction, typename T, typename Int, typename EdgeInt>
+T gather(T sum, const T *source, const Int *srcs, const T *edge
+  , EdgeInt begin, EdgeInt end)
+{
+  return Kernel<Reduction, T, Int, EdgeInt>::gather(sum, source, srcs
+    , edge, begin, end);
+}
+
+} //end namespace GatherSIMD
+
+#endif
@@ -69,6 +69,7 @@ Implementation Notes(VV):
 #include "moderngpu.cuh"
 #include "primitives/scatter_if_mgpu.h"
 #include "util.cuh"
+#include "gastraits.h"
 
 //using this because CUB device-wide reduce_by_key does not yet work
 //and I am still working on a fused gatherMap/gatherReduce kernel.
@@ -77,9 +78,12 @@ Implementation Notes(VV):
 
 
 //CUDA implementation of GAS API, version 2.
+//Edges are numbered within a shard, so only the edge indices, which refer to
+//the engine's global edge data order, are of type EdgeInt.
 template<typename Program
   , typename Int = int32_t
-  , bool sortEdgesForGather = true>
+  , bool sortEdgesForGather = true
+  , typename EdgeInt = Int>
 class GASEngineGPUShard
 {
   //public to make nvcc happy
@@ -110,12 +114,12 @@ private:
   //Kernel accessible data
   Int *m_srcs; //Not required since I will be creating the CSC representation in the parent class
   Int *m_srcOffsets;
-  Int *m_edgeIndexCSC;
+  EdgeInt *m_edgeIndexCSC;
 
   //CSR representation for reduce phase
   Int *m_dsts; //Not required since I will be creating the CSR representation in the parent class
   Int *m_dstOffsets;
-  Int *m_edgeIndexCSR;
+  EdgeInt *m_edgeIndexCSR;
 
   //Active vertex lists
   Int *m_active;
@@ -462,10 +466,10 @@ private:
         , EdgeData* edgeDataHost
         , const Int *srcsHost
         , const Int *srcOffsetsHost
-        , const Int *edgeIndexCSCHost
+        , const EdgeInt *edgeIndexCSCHost
         , const Int *dstsHost
         , const Int *dstOffsetsHost
-        , const Int *edgeIndexCSRHost
+        , const EdgeInt *edgeIndexCSRHost
         , Int* nActive
         , Int* activeHost
         , Int* applyRetHost
@@ -1022,9 +1026,14 @@ private:
   class. Each function will in turn call the corresponding function of
   GASEngineGPUShard for each shard.
 */
+//Int is the vertex type and EdgeInt the type of global edge counts, offsets
+//and indices on the host, e.g. GASEngineGPU<Program, int32_t, true, int64_t>
+//for graphs of more than 2^31 edges.  Every shard holds at most
+//maxEdgesPerShard edges, so the per shard arrays on the GPU stay Int.
 template<typename Program
   , typename Int = int32_t
-  , bool sortEdgesForGather = true>
+  , bool sortEdgesForGather = true
+  , typename EdgeInt = Int>
 class GASEngineGPU
 {
 public:
@@ -1039,15 +1048,15 @@ private:
   static const Int maxEdgesPerShard = 91042010;//100000000;//91042010;//68993773;//45030389; 
   Int maxVerticesPerShard;
   Int numShards;
-  GASEngineGPUShard<Program, Int, sortEdgesForGather> *shard[NUM_STREAMS];
+  GASEngineGPUShard<Program, Int, sortEdgesForGather, EdgeInt> *shard[NUM_STREAMS];
   Int *vertexShardMap;
-  Int *edgeShardMapCSR;
-  Int *edgeShardMapCSC;
+  EdgeInt *edgeShardMapCSR;
+  EdgeInt *edgeShardMapCSC;
   Int *shardMapTmp;
   Int *nActiveShardMap;
 
   Int         nVertices;
-  Int         nEdges;
+  EdgeInt     nEdges;
 
   //input/output pointers to host data
   VertexData *vertexDataHost;
@@ -1063,16 +1072,16 @@ private:
   //Kernel accessible data
   Int *srcs; //O(E)
   Int *srcOffsets; //O(V)
-  Int *edgeIndexCSC; //O(E)
+  EdgeInt *edgeIndexCSC; //O(E)
 
   //CSR representation for reduce phase
   Int *dsts; //O(E)
   Int *dstOffsets; //O(V)
-  Int *edgeIndexCSR; //O(E)
+  EdgeInt *edgeIndexCSR; //O(E)
 
   //Temporary variable needed to sum both in and out edges for the vertices to determine shards
-  Int *edgesPerVertexTmpScan;
-  Int edgeOffsetTmp;
+  EdgeInt *edgesPerVertexTmpScan;
+  EdgeInt edgeOffsetTmp;
 
   //Global active vertex lists
   Int *active; //O(V)
@@ -1159,7 +1168,7 @@ private:
     {
       mgpuContext = mgpu::CreateCudaDevice(0);
       for( size_t i = 0; i < NUM_STREAMS; ++i)
-        shard[i] = new GASEngineGPUShard<Program, Int, sortEdgesForGather>();
+        shard[i] = new GASEngineGPUShard<Program, Int, sortEdgesForGather, EdgeInt>();
     }
     
     ~GASEngineGPU()
@@ -1199,13 +1208,13 @@ private:
   #define SYNC_CHECK() syncAndErrorCheck(__FILE__, __LINE__)
 
   template<typename T>
-  void gpuAlloc(T* &p, Int n)
+  void gpuAlloc(T* &p, size_t n)
   {
     CHECK( cudaMalloc(&p, sizeof(T) * n) );
   }
 
   template<typename T>
-  void cpuAlloc(T* &p, Int n)
+  void cpuAlloc(T* &p, size_t n)
   {
     p = (T *) malloc(sizeof(T) * n);
   }
@@ -1239,13 +1248,13 @@ private:
   }
 
   template<typename T>
-  void copyToGPU(T* dst, const T* src, Int n)
+  void copyToGPU(T* dst, const T* src, size_t n)
   {
     CHECK( cudaMemcpy(dst, src, sizeof(T) * n, cudaMemcpyHostToDevice) );
   }
 
   template<typename T>
-  void copyToHost(T* dst, const T* src, Int n)
+  void copyToHost(T* dst, const T* src, size_t n)
   {
     //error check please!
     CHECK( cudaMemcpy(dst, src, sizeof(T) * n, cudaMemcpyDeviceToHost) );
@@ -1253,20 +1262,20 @@ private:
 
   //async copies 
   template<typename T>
-  void copyToGPUAsync(T* dst, const T* src, Int n, cudaStream_t str)
+  void copyToGPUAsync(T* dst, const T* src, size_t n, cudaStream_t str)
   {
     CHECK( cudaMemcpyAsync(dst, src, sizeof(T) * n, cudaMemcpyHostToDevice, str) );
   }
 
   template<typename T>
-  void copyToHostAsync(T* dst, const T* src, Int n, cudaStream_t str)
+  void copyToHostAsync(T* dst, const T* src, size_t n, cudaStream_t str)
   {
     //error check please!
     CHECK( cudaMemcpyAsync(dst, src, sizeof(T) * n, cudaMemcpyDeviceToHost, str) );
   }
 
   template<typename T>
-  void copyD2D(T* dst, const T* src, Int n)
+  void copyD2D(T* dst, const T* src, size_t n)
   {
     CHECK( cudaMemcpy(dst, src, sizeof(T) * n, cudaMemcpyDeviceToDevice) );
   }
@@ -1311,12 +1320,15 @@ private:
 
 #endif
 
-  void setGraph(Int u_nVertices //number of vertices
-      , VertexData* u_vertexData //vertex states
-      , Int u_nEdges //number of edges
-      , EdgeData* u_edgeData //edge states
-      , const Int *edgeListSrcs //list of src vertices
-      , const Int *edgeListDsts) //list of dst vertices
+  //Part of setGraph common to all graph formats: allocate the vertex data on
+  //the GPU and the host CSR/CSC arrays, which the caller then fills in
+  //before calling buildShards().
+  void allocGraph(Int u_nVertices
+      , VertexData* u_vertexData
+      , EdgeInt u_nEdges
+      , EdgeData* u_edgeData
+      , EdgeInt *&srcOffsetsTmp
+      , EdgeInt *&dstOffsetsTmp)
     {
       nVertices  = u_nVertices;
       nEdges     = u_nEdges;
@@ -1332,7 +1344,6 @@ private:
       }
 
       //allocate CSR and CSC edges
-      Int *srcOffsetsTmp, *dstOffsetsTmp;
       cpuAlloc(srcOffsetsTmp, nVertices + 1);
       cpuAlloc(dstOffsetsTmp, nVertices + 1);
       cpuAlloc(srcs, nEdges);
@@ -1354,29 +1365,116 @@ private:
         //copyToGPU(edgeData, &sortedEdgeData[0], nEdges);
         edgeDataExist = true;
       }
+    }
 
-      //get CSC representation for gather/apply
-      edgeListToCSC(nVertices, nEdges
+
+  void setGraph(Int u_nVertices //number of vertices
+      , VertexData* u_vertexData //vertex states
+      , EdgeInt u_nEdges //number of edges
+      , EdgeData* u_edgeData //edge states
+      , const Int *edgeListSrcs //list of src vertices
+      , const Int *edgeListDsts) //list of dst vertices
+    {
+      EdgeInt *srcOffsetsTmp, *dstOffsetsTmp;
+      allocGraph(u_nVertices, u_vertexData, u_nEdges, u_edgeData
+        , srcOffsetsTmp, dstOffsetsTmp);
+
+      //get CSC representation for gather/apply and CSR representation for
+      //activate/scatter in one pass.  Only one edge index is kept, the
+      //other one is only needed to sort the edge data into its order.
+      std::vector<EdgeInt> edgeDataIndex(edgeDataHost ? nEdges : 0);
+      EdgeInt *sortIndex = edgeDataHost ? &edgeDataIndex[0] : 0;
+      edgeListToCSRAndCSC(nVertices, nEdges
         , edgeListSrcs, edgeListDsts
-        , &srcOffsetsTmp[0], &srcs[0], &edgeIndexCSC[0]);
+        , &dstOffsetsTmp[0], &dsts[0]
+        , sortEdgesForGather ? edgeIndexCSR : sortIndex
+        , &srcOffsetsTmp[0], &srcs[0]
+        , sortEdgesForGather ? sortIndex : edgeIndexCSC);
 
-      //sort edge data into CSC order to avoid an indirected read in gather
+      buildShards(srcOffsetsTmp, dstOffsetsTmp, sortIndex);
+    }
+
+
+    //Like setGraph, for a graph given as CSR: offsets has nVertices + 1
+    //entries and the out-edges of v are u_dsts[offsets[v]] ..
+    //u_dsts[offsets[v + 1] - 1].  u_edgeData is in the same order as u_dsts.
+    //Sharding needs the degrees on both sides, so the CSC representation is
+    //built right away, by transposition rather than by sorting.
+    void setGraphCSR(Int u_nVertices
+      , VertexData* u_vertexData
+      , EdgeInt u_nEdges
+      , EdgeData* u_edgeData
+      , const EdgeInt *offsets
+      , const Int *u_dsts)
+    {
+      EdgeInt *srcOffsetsTmp, *dstOffsetsTmp;
+      allocGraph(u_nVertices, u_vertexData, u_nEdges, u_edgeData
+        , srcOffsetsTmp, dstOffsetsTmp);
+
+      std::copy(offsets, offsets + nVertices + 1, dstOffsetsTmp);
+      std::copy(u_dsts, u_dsts + nEdges, dsts);
+
+      //the caller's edge order is the CSR order, so the CSR edge index is
+      //the identity and the CSC one comes out of the transposition
+      std::vector<EdgeInt> edgeDataIndex(edgeDataHost ? nEdges : 0);
+      EdgeInt *sortIndex = 0;
       if( sortEdgesForGather )
       {
         for(size_t i = 0; i < nEdges; ++i)
-          edgeData[i] = edgeDataHost[ edgeIndexCSC[i] ];
+          edgeIndexCSR[i] = i;
+        sortIndex = edgeDataHost ? &edgeDataIndex[0] : 0;
       }
+      transposeCSR(nVertices, nEdges, offsets, u_dsts
+        , srcOffsetsTmp, srcs, sortEdgesForGather ? sortIndex : edgeIndexCSC);
 
-      //get CSR representation for activate/scatter
-      edgeListToCSR(nVertices, nEdges
-        , edgeListSrcs, edgeListDsts
-        , &dstOffsetsTmp[0], &dsts[0], &edgeIndexCSR[0]);
+      buildShards(srcOffsetsTmp, dstOffsetsTmp, sortIndex);
+    }
 
-      //sort edge data into CSR order to avoid an indirected write in scatter
+
+    //Like setGraphCSR, for a graph given as CSC: the in-edges of v are
+    //u_srcs[offsets[v]] .. u_srcs[offsets[v + 1] - 1] and u_edgeData is in
+    //the same order as u_srcs.
+    void setGraphCSC(Int u_nVertices
+      , VertexData* u_vertexData
+      , EdgeInt u_nEdges
+      , EdgeData* u_edgeData
+      , const EdgeInt *offsets
+      , const Int *u_srcs)
+    {
+      EdgeInt *srcOffsetsTmp, *dstOffsetsTmp;
+      allocGraph(u_nVertices, u_vertexData, u_nEdges, u_edgeData
+        , srcOffsetsTmp, dstOffsetsTmp);
+
+      std::copy(offsets, offsets + nVertices + 1, srcOffsetsTmp);
+      std::copy(u_srcs, u_srcs + nEdges, srcs);
+
+      std::vector<EdgeInt> edgeDataIndex(edgeDataHost ? nEdges : 0);
+      EdgeInt *sortIndex = 0;
       if( !sortEdgesForGather )
       {
         for(size_t i = 0; i < nEdges; ++i)
-          edgeData[i] = edgeDataHost[ edgeIndexCSR[i] ];
+          edgeIndexCSC[i] = i;
+        sortIndex = edgeDataHost ? &edgeDataIndex[0] : 0;
+      }
+      transposeCSR(nVertices, nEdges, offsets, u_srcs
+        , dstOffsetsTmp, dsts, sortEdgesForGather ? edgeIndexCSR : sortIndex);
+
+      buildShards(srcOffsetsTmp, dstOffsetsTmp, sortIndex);
+    }
+
+
+    //Rest of setGraph once the host CSR/CSC arrays are filled in.  sortIndex
+    //is the caller's edge index of every edge in the order the edge data is
+    //kept in (CSC if sortEdgesForGather, else CSR), null for no reordering.
+    //Frees the temporary offsets.
+    void buildShards(EdgeInt *srcOffsetsTmp, EdgeInt *dstOffsetsTmp, const EdgeInt *sortIndex)
+    {
+      //sort edge data into CSC order to avoid an indirected read in gather,
+      //or into CSR order to avoid an indirected write in scatter
+      if( edgeDataHost )
+      {
+        for(size_t i = 0; i < nEdges; ++i)
+          edgeData[i] = edgeDataHost[ sortIndex ? sortIndex[i] : i ];
       }
 
       //allocate active lists
@@ -1400,8 +1498,9 @@ private:
         edgesPerVertexTmpScan[i] = srcOffsetsTmp[i] + dstOffsetsTmp[i];
       
       size_t i = 0;
-      Int *posTmp, pos;
-      Int maxEdgesPerShardTmp = maxEdgesPerShard;
+      EdgeInt *posTmp;
+      size_t pos;
+      EdgeInt maxEdgesPerShardTmp = maxEdgesPerShard;
       cpuAlloc(shardMapTmp, nVertices);
       
       do
@@ -1431,8 +1530,8 @@ private:
       cpuAlloc(edgeShardMapCSC, numShards + 1);
       cpuAlloc(nActiveShardMap, numShards);
       std::memset(vertexShardMap, 0, sizeof(Int)*(numShards+1));
-      std::memset(edgeShardMapCSR, 0, sizeof(Int)*(numShards+1));
-      std::memset(edgeShardMapCSC, 0, sizeof(Int)*(numShards+1));
+      std::memset(edgeShardMapCSR, 0, sizeof(EdgeInt)*(numShards+1));
+      std::memset(edgeShardMapCSC, 0, sizeof(EdgeInt)*(numShards+1));
       for(size_t i = 0; i < nVertices; ++i)
       {
         vertexShardMap[shardMapTmp[i] + 1]++;
@@ -1461,8 +1560,8 @@ private:
         dstOffsets[vertexShardMap[i] + i] = 0;
         for(size_t j = vertexShardMap[i]; j < vertexShardMap[i + 1]; ++j)
         {
-          srcOffsets[j + i + 1] = srcOffsetsTmp[k + 1] - edgeShardMapCSC[shardMapTmp[k]]; 
-          dstOffsets[j + i + 1] = dstOffsetsTmp[k + 1] - edgeShardMapCSR[shardMapTmp[k]]; 
+          srcOffsets[j + i + 1] = (Int)(srcOffsetsTmp[k + 1] - edgeShardMapCSC[shardMapTmp[k]]); 
+          dstOffsets[j + i + 1] = (Int)(dstOffsetsTmp[k + 1] - edgeShardMapCSR[shardMapTmp[k]]); 
 //          dstOffsets[j + i + 1] = dstOffsetsTmp[k + 1]; 
           k++;
         }
@@ -1553,7 +1652,8 @@ private:
     void gather(bool haveGather=true)
     {
 
-      if( haveGather )
+      //programs without a gather skip it at compile time, see gastraits.h
+      if( haveGather && GASTraits::Phases<Program>::hasGather )
       {
 
         //Clearing out the temp arrays
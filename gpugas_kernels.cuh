@@ -106,7 +106,8 @@ __global__ void fixRangeOut(Int *out, Int num, Int *s2vMap, Int *v2sMap, Int num
 
 //This version does the gatherMap only and generates keys for subsequent
 //use iwth thrust reduce_by_key
-template<typename Program, typename Int, int NT, int indirectedGather>
+//EdgeInt, the type of the edge indices, is deduced from edgeIndexCSC
+template<typename Program, typename Int, int NT, int indirectedGather, typename EdgeInt>
 __global__ void kGatherMap(Int nActiveVertices
   , const Int *activeVertices
   , const int numBlocks
@@ -117,7 +118,7 @@ __global__ void kGatherMap(Int nActiveVertices
   , const Int *srcs
   , const typename Program::VertexData* vertexData
   , const typename Program::EdgeData*   edgeData
-  , const Int* edgeIndexCSC
+  , const EdgeInt* edgeIndexCSC
   , const Int dstOffset
   , Int *dsts
   , typename Program::GatherResult* output)
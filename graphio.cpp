@@ -26,12 +26,24 @@ limitations under the License.
 
 
 #include "graphio.h"
+#include "csr.h"
+#include "reorder.h"
 #include <zlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <iostream>
 #include <cstdlib>
 #include <stdint.h>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <limits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 
@@ -39,88 +51,376 @@ using namespace std;
 enum SymmetryType { stNone, stSymmetric, stSkewSymmetric, stHermitian };
 
 
-static bool isBlankLine( const char* line )
+//Source of the (decompressed) bytes of a text graph file
+class TextReader
 {
-  while( *line )
+public:
+  TextReader() : m_pendingPos(0) {}
+  virtual ~TextReader() {}
+
+  //Read len bytes into dst, fewer only at the end of the file.  May be
+  //called from an OpenMP task; parallel readers spawn tasks of their own.
+  size_t read( char* dst, size_t len )
   {
-    if( !isspace( *line ) )
+    size_t n = min( len, m_pending.size() - m_pendingPos );
+    if( n )
+      memcpy( dst, &m_pending[m_pendingPos], n );
+    m_pendingPos += n;
+    return n + readMore( dst + n, len - n );
+  }
+
+  //read one line like gzgets, false at the end of the file
+  bool getLine( char* line, int size )
+  {
+    int n = 0;
+    while( n + 1 < size && read( line + n, 1 ) == 1 )
+    {
+      if( line[n++] == '\n' )
+        break;
+    }
+    line[n] = 0;
+    return n > 0;
+  }
+
+protected:
+  virtual size_t readMore( char* dst, size_t len ) = 0;
+
+  //decompressed bytes not yet returned by read
+  std::vector<char> m_pending;
+  size_t            m_pendingPos;
+};
+
+
+//Plain or gzip compressed file, read through one zlib stream
+class GzTextReader : public TextReader
+{
+public:
+  GzTextReader( const char* fname ) : m_fname( fname )
+  {
+    m_f = gzopen( fname, "rb" );
+    if( !m_f )
+    {
+      cerr << "error opening file " << fname << endl;
+      exit(1);
+    }
+    gzbuffer( m_f, 1 << 20 );
+  }
+
+  ~GzTextReader()
+  {
+    gzclose( m_f );
+  }
+
+protected:
+  size_t readMore( char* dst, size_t len )
+  {
+    size_t total = 0;
+    while( total < len )
+    {
+      unsigned chunk = (unsigned) min( len - total, (size_t) 1 << 30 );
+      int n = gzread( m_f, dst + total, chunk );
+      if( n < 0 )
+      {
+        int err;
+        gzerror( m_f, &err );
+        cerr << "gz error " << err << " reading " << m_fname << endl;
+        exit(1);
+      }
+      if( n == 0 )
+        break;
+      total += n;
+    }
+    return total;
+  }
+
+private:
+  gzFile      m_f;
+  const char* m_fname;
+};
+
+
+//A BGZF file, as written by bgzip: a series of gzip members of at most 64KB
+//of input each, whose headers give their compressed length and whose
+//trailers give their uncompressed length.  So the members can be found and
+//inflated in parallel straight to their final place.
+class BgzfTextReader : public TextReader
+{
+public:
+  //true if the file starts with a BGZF header
+  static bool detect( const char* fname )
+  {
+    FILE* f = fopen( fname, "rb" );
+    if( !f )
       return false;
-    ++line;
+    unsigned char h[16];
+    bool ok = fread( h, 1, sizeof(h), f ) == sizeof(h) && isHeader( h, sizeof(h) );
+    fclose( f );
+    return ok;
   }
-  return true;
+
+  BgzfTextReader( const char* fname ) : m_fname( fname ), m_pos(0)
+  {
+    int fd = open( fname, O_RDONLY );
+    struct stat st;
+    if( fd < 0 || fstat( fd, &st ) != 0 )
+    {
+      cerr << "error opening file " << fname << endl;
+      exit(1);
+    }
+    m_size = st.st_size;
+    m_data = (const unsigned char*) mmap( 0, m_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if( m_data == MAP_FAILED )
+    {
+      cerr << "unable to map file " << fname << endl;
+      exit(1);
+    }
+    madvise( (void*) m_data, m_size, MADV_SEQUENTIAL );
+  }
+
+  ~BgzfTextReader()
+  {
+    munmap( (void*) m_data, m_size );
+  }
+
+protected:
+  size_t readMore( char* dst, size_t len )
+  {
+    //the whole members that fit
+    std::vector<size_t> begins, outs;
+    size_t pos = m_pos, out = 0;
+    while( pos < m_size )
+    {
+      size_t blockSize = memberSize( pos );
+      uint32_t isize = trailerSize( pos, blockSize );
+      if( out + isize > len )
+        break;
+      begins.push_back( pos );
+      outs.push_back( out );
+      pos += blockSize;
+      out += isize;
+    }
+    begins.push_back( pos );
+    outs.push_back( out );
+
+    //inflate them in parallel, a few members per task
+    const size_t perTask = 64;
+    size_t nMembers = begins.size() - 1;
+    for( size_t first = 0; first < nMembers; first += perTask )
+    {
+      size_t last = min( first + perTask, nMembers );
+      #pragma omp task firstprivate(first, last) shared(begins, outs)
+      {
+        for( size_t i = first; i < last; ++i )
+          inflateMember( begins[i], begins[i + 1] - begins[i], dst + outs[i] );
+      }
+    }
+    #pragma omp taskwait
+    m_pos = pos;
+
+    //a member that does not fit goes through the pending buffer
+    if( out < len && m_pos < m_size )
+    {
+      size_t blockSize = memberSize( m_pos );
+      m_pending.resize( trailerSize( m_pos, blockSize ) );
+      inflateMember( m_pos, blockSize, m_pending.empty() ? 0 : &m_pending[0] );
+      m_pendingPos = 0;
+      m_pos += blockSize;
+      return out + read( dst + out, len - out );
+    }
+    return out;
+  }
+
+private:
+  static bool isHeader( const unsigned char* h, size_t n )
+  {
+    //gzip magic, deflate, FEXTRA, and a 'BC' subfield of length 2 first
+    return n >= 16 && h[0] == 31 && h[1] == 139 && h[2] == 8 && (h[3] & 4)
+      && h[12] == 'B' && h[13] == 'C' && h[14] == 2 && h[15] == 0;
+  }
+
+  void corrupt() const
+  {
+    cerr << "corrupt bgzf file " << m_fname << endl;
+    exit(1);
+  }
+
+  //total size of the member starting at pos
+  size_t memberSize( size_t pos ) const
+  {
+    if( m_size - pos < 28 || !isHeader( m_data + pos, m_size - pos ) )
+      corrupt();
+    size_t blockSize = (m_data[pos + 16] | (m_data[pos + 17] << 8)) + 1;
+    if( blockSize > m_size - pos )
+      corrupt();
+    return blockSize;
+  }
+
+  uint32_t trailerSize( size_t pos, size_t blockSize ) const
+  {
+    const unsigned char* t = m_data + pos + blockSize - 4;
+    return t[0] | (t[1] << 8) | (t[2] << 16) | ((uint32_t) t[3] << 24);
+  }
+
+  void inflateMember( size_t pos, size_t blockSize, char* dst ) const
+  {
+    const unsigned char* m = m_data + pos;
+    size_t xlen = m[10] | (m[11] << 8);
+    if( 12 + xlen + 8 > blockSize )
+      corrupt();
+    uint32_t isize = trailerSize( pos, blockSize );
+    const unsigned char* t = m + blockSize - 8;
+    uint32_t crc = t[0] | (t[1] << 8) | (t[2] << 16) | ((uint32_t) t[3] << 24);
+
+    z_stream zs;
+    memset( &zs, 0, sizeof(zs) );
+    if( inflateInit2( &zs, -15 ) != Z_OK )
+      corrupt();
+    zs.next_in   = (Bytef*) m + 12 + xlen;
+    zs.avail_in  = blockSize - 12 - xlen - 8;
+    zs.next_out  = (Bytef*) dst;
+    zs.avail_out = isize;
+    int ret = inflate( &zs, Z_FINISH );
+    bool ok = (ret == Z_STREAM_END || (ret == Z_BUF_ERROR && isize == 0))
+      && zs.total_out == isize;
+    inflateEnd( &zs );
+    if( !ok || crc32( 0, (const Bytef*) dst, isize ) != crc )
+      corrupt();
+  }
+
+  const char*          m_fname;
+  const unsigned char* m_data;
+  size_t               m_size;
+  size_t               m_pos;
+};
+
+
+static TextReader* openFile( const char* fname )
+{
+  if( BgzfTextReader::detect( fname ) )
+    return new BgzfTextReader( fname );
+  return new GzTextReader( fname );
 }
 
+//Text graphs are read in blocks of this many bytes.  The complete lines of
+//a block are split among the threads and parsed in parallel, the partial
+//line at its end is carried over to the next block.
+static const size_t parseBlockSize = 1 << 26;
 
-static gzFile openFile( const char* fname )
+
+//what the threads parsing one piece of a block found
+struct ParsedChunk
+{
+  std::vector<int> srcs;
+  std::vector<int> dsts;
+  std::vector<int> edgeValues;
+  int              maxVertex;
+  int64_t          nLines;
+  int64_t          errorLine; //line within the chunk, 0 if none
+};
+
+
+static int maxParseThreads()
+{
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+
+//spaces within a line, unlike isspace this stops at the newline
+static inline const char* skipBlanks( const char* p )
 {
-  gzFile f = gzopen( fname, "rb" );
-  if( !f )
+  while( *p == ' ' || *p == '\t' || *p == '\r' || *p == '\v' || *p == '\f' )
+    ++p;
+  return p;
+}
+
+
+//Parse a decimal integer like "%d", returns 0 if there is none
+static inline const char* parseInt( const char* p, int &value )
+{
+  p = skipBlanks( p );
+  bool neg = false;
+  if( *p == '-' || *p == '+' )
   {
-    cerr << "error opening file " << fname << endl;
-    exit(1);
+    neg = *p == '-';
+    ++p;
+  }
+  if( (unsigned)(*p - '0') > 9 )
+    return 0;
+  int v = 0;
+  while( (unsigned)(*p - '0') <= 9 )
+  {
+    v = v * 10 + (*p - '0');
+    ++p;
   }
-  return f;
+  value = neg ? -v : v;
+  return p;
 }
 
-//common code for some simple line-based graph formats
-//This is totally hacky right now - if we really need to
-//implement IO code, we need to survey the different formats
-//and figure out the correct abstraction.
-static int loadGraph_common( gzFile f
+
+//Parse an edge value like "%f", with a fast path for plain integers
+static inline float parseValue( const char* p )
+{
+  int v;
+  const char* q = parseInt( p, v );
+  if( q && *q != '.' && *q != 'e' && *q != 'E' && q - p < 10 )
+    return (float) v;
+  return (float) strtod( p, 0 );
+}
+
+
+static inline bool isBlankLine( const char* line, const char* eol )
+{
+  for( ; line < eol; ++line )
+  {
+    if( !isspace( *line ) )
+      return false;
+  }
+  return true;
+}
+
+
+//Parse the lines in [begin, end), which must end in a newline
+static void parseLines( const char* begin, const char* end
   , char commentChar
-  , bool ignoreFirstDataLine
   , bool decrementIndices
   , bool disallowSelfLinks
   , SymmetryType symType
-  , int &nVertices
-  , std::vector<int> *srcs
-  , std::vector<int> *dsts
-  , std::vector<int> *edgeValues )
+  , bool wantValues
+  , ParsedChunk &out )
 {
-  char buffer[1024];
-  int lineNum = 0;
-  int maxVertex = 0;
-  bool firstDataLine = true;
-  while( !gzeof(f) )
+  out.srcs.clear();
+  out.dsts.clear();
+  out.edgeValues.clear();
+  out.maxVertex = 0;
+  out.nLines    = 0;
+  out.errorLine = 0;
+
+  const char* line = begin;
+  while( line < end )
   {
-    if( !gzgets( f, buffer, sizeof(buffer) ) )
-    {
-      int err;
-      gzerror( f, &err );
-      if( err )
-      {
-        cerr << "gz error " << err << " at line " << lineNum << endl;
-        exit(1);
-      }
-      else
-        continue;
-    }
-
-    ++lineNum; //one-based line numbers!
-
-    //empty line means eof
-    if( buffer[0] == 0 )
-      continue;
+    const char* eol = (const char*) memchr( line, '\n', end - line );
+    ++out.nLines;
 
     //ignore comments and blank lines
-    if( buffer[0] == commentChar || isBlankLine( buffer ) )
-      continue;
-
-    if( ignoreFirstDataLine && firstDataLine )
+    if( *line == commentChar || isBlankLine( line, eol ) )
     {
-      int nVerticesX, nVerticesY, nEdges;
-      sscanf(buffer, "%d%d%d", &nVerticesX, &nVerticesY, &nEdges);
-      firstDataLine = false;
+      line = eol + 1;
       continue;
     }
 
     int src, dst;
-    int nbytes;
-    int np = sscanf( buffer, "%d%d%n", &src, &dst, &nbytes );
-    if( np != 2 )
+    const char* p = parseInt( line, src );
+    if( p )
+      p = parseInt( p, dst );
+    if( !p )
     {
-      cerr << "error parsing src/dst at line " << lineNum << endl;
-      exit(1);
+      out.errorLine = out.nLines;
+      return;
     }
 
     //use 0-based indexing
@@ -130,44 +430,324 @@ static int loadGraph_common( gzFile f
       --dst;
     }
 
-    if (disallowSelfLinks && src == dst) {
-      //scan for an associated edge value
-      //and then ignore it
-      if ( edgeValues ) {
-        float edgeValue;
-        sscanf( buffer + nbytes, "%f", &edgeValue );
+    if( disallowSelfLinks && src == dst )
+    {
+      //ignore the edge and its value
+      if( wantValues )
+      {
+        line = eol + 1;
         continue;
       }
     }
-    else {
-      srcs->push_back( src );
-      dsts->push_back( dst );
+    else
+    {
+      out.srcs.push_back( src );
+      out.dsts.push_back( dst );
 
       if( symType != stNone )
       {
-        srcs->push_back( dst );
-        dsts->push_back( src );
+        out.srcs.push_back( dst );
+        out.dsts.push_back( src );
       }
     }
 
-    if( edgeValues )
+    if( wantValues )
     {
-      float edgeValue;
-      sscanf( buffer + nbytes, "%f", &edgeValue );
-      edgeValues->push_back( edgeValue );
+      float edgeValue = parseValue( p );
+      out.edgeValues.push_back( (int) edgeValue );
 
       switch( symType )
       {
         case stNone: break; //do nothing
-        case stSymmetric: edgeValues->push_back( edgeValue ); break;
-        case stSkewSymmetric: edgeValues->push_back( -edgeValue ); break;
+        case stSymmetric: out.edgeValues.push_back( (int) edgeValue ); break;
+        case stSkewSymmetric: out.edgeValues.push_back( (int) -edgeValue ); break;
         case stHermitian: break; //unsupported
       }
     }
 
     int tmp = max( src, dst );
-    if( tmp > maxVertex )
-      maxVertex = tmp;
+    if( tmp > out.maxVertex )
+      out.maxVertex = tmp;
+
+    line = eol + 1;
+  }
+}
+
+
+//append a chunk's results to the output arrays at the given offsets
+static void appendChunk( const ParsedChunk &chunk, size_t edgeOffset
+  , size_t valueOffset, std::vector<int> *srcs, std::vector<int> *dsts
+  , std::vector<int> *edgeValues )
+{
+  if( !chunk.srcs.empty() )
+  {
+    memcpy( &(*srcs)[edgeOffset], &chunk.srcs[0], chunk.srcs.size() * sizeof(int) );
+    memcpy( &(*dsts)[edgeOffset], &chunk.dsts[0], chunk.dsts.size() * sizeof(int) );
+  }
+  if( edgeValues && !chunk.edgeValues.empty() )
+  {
+    memcpy( &(*edgeValues)[valueOffset], &chunk.edgeValues[0]
+      , chunk.edgeValues.size() * sizeof(int) );
+  }
+}
+
+
+//Where loadGraph_common puts the edges it parses
+class ChunkConsumer
+{
+public:
+  virtual ~ChunkConsumer() {}
+
+  //called once before any edges, the hints are -1 if the file has no header
+  virtual void begin( int64_t nVerticesHint, int64_t nEdgesHint ) = 0;
+
+  //the parsed pieces of one block, in file order
+  virtual void consume( const std::vector<ParsedChunk> &chunks ) = 0;
+};
+
+
+//Appends to edge list vectors, sized up front from the header if there is one
+class EdgeListConsumer : public ChunkConsumer
+{
+public:
+  EdgeListConsumer( std::vector<int> *srcs, std::vector<int> *dsts
+    , std::vector<int> *edgeValues )
+    : m_srcs( srcs ), m_dsts( dsts ), m_edgeValues( edgeValues )
+    , m_edgeOffsets( 0 ), m_valueOffsets( 0 )
+  {
+  }
+
+  virtual void begin( int64_t, int64_t nEdgesHint )
+  {
+    if( nEdgesHint > 0 )
+    {
+      m_srcs->reserve( nEdgesHint );
+      m_dsts->reserve( nEdgesHint );
+      if( m_edgeValues )
+        m_edgeValues->reserve( nEdgesHint );
+    }
+  }
+
+  virtual void consume( const std::vector<ParsedChunk> &chunks )
+  {
+    size_t nChunks = chunks.size();
+    m_edgeOffsets.resize( nChunks );
+    m_valueOffsets.resize( nChunks );
+    size_t nEdges  = m_srcs->size();
+    size_t nValues = m_edgeValues ? m_edgeValues->size() : 0;
+    for( size_t i = 0; i < nChunks; ++i )
+    {
+      m_edgeOffsets[i]  = nEdges;
+      m_valueOffsets[i] = nValues;
+      nEdges  += chunks[i].srcs.size();
+      nValues += chunks[i].edgeValues.size();
+    }
+
+    m_srcs->resize( nEdges );
+    m_dsts->resize( nEdges );
+    if( m_edgeValues )
+      m_edgeValues->resize( nValues );
+    for( size_t i = 0; i < nChunks; ++i )
+    {
+      #pragma omp task firstprivate(i)
+      appendChunk( chunks[i], m_edgeOffsets[i], m_valueOffsets[i]
+        , m_srcs, m_dsts, m_edgeValues );
+    }
+    #pragma omp taskwait
+  }
+
+private:
+  std::vector<int>   *m_srcs;
+  std::vector<int>   *m_dsts;
+  std::vector<int>   *m_edgeValues;
+  std::vector<size_t> m_edgeOffsets;
+  std::vector<size_t> m_valueOffsets;
+};
+
+
+//Hands the parsed pieces on to an EdgeSink
+class SinkConsumer : public ChunkConsumer
+{
+public:
+  SinkConsumer( EdgeSink &sink, bool hasValues )
+    : m_sink( sink ), m_hasValues( hasValues )
+  {
+  }
+
+  virtual void begin( int64_t nVerticesHint, int64_t nEdgesHint )
+  {
+    m_sink.begin( nVerticesHint, nEdgesHint, m_hasValues );
+  }
+
+  virtual void consume( const std::vector<ParsedChunk> &chunks )
+  {
+    for( size_t i = 0; i < chunks.size(); ++i )
+    {
+      const ParsedChunk &c = chunks[i];
+      if( c.srcs.empty() )
+        continue;
+      m_sink.edges( &c.srcs[0], &c.dsts[0]
+        , m_hasValues ? &c.edgeValues[0] : 0, c.srcs.size() );
+    }
+  }
+
+private:
+  EdgeSink &m_sink;
+  bool      m_hasValues;
+};
+
+
+//A block of text being parsed, holding the complete lines [begin, end) of
+//the file after a carried over partial line
+struct TextBlock
+{
+  std::vector<char> data;
+  size_t            end;
+  size_t            length;
+  bool              eof;
+};
+
+
+//Fill block with the partial line carry followed by the next bytes of the
+//file.  Runs as a task, overlapping with the parsing of the block before.
+static void fillBlock( TextReader &reader, TextBlock &block
+  , const char* carry, size_t carryLength )
+{
+  //one spare byte for a missing final newline
+  block.data.resize( carryLength + parseBlockSize + 1 );
+  if( carryLength )
+    memcpy( &block.data[0], carry, carryLength );
+  size_t n = reader.read( &block.data[carryLength], parseBlockSize );
+  block.eof    = n < parseBlockSize;
+  block.length = carryLength + n;
+  if( block.eof && block.length && block.data[block.length - 1] != '\n' )
+    block.data[block.length++] = '\n';
+
+  //complete lines only
+  block.end = block.length;
+  while( block.end && block.data[block.end - 1] != '\n' )
+    --block.end;
+}
+
+
+//common code for some simple line-based graph formats
+//This is totally hacky right now - if we really need to
+//implement IO code, we need to survey the different formats
+//and figure out the correct abstraction.
+//
+//The input is read in large blocks rather than line by line.  Each block
+//is cut at line boundaries into a few pieces per thread, which are parsed
+//in parallel into per-piece arrays and then appended in order, so the
+//result is the same as parsing the lines one after another.  Two blocks
+//are used in turn, so the next one is read (and inflated) while the
+//current one is parsed.
+//
+//If ignoreFirstDataLine is set that line is the MatrixMarket size line
+//"rows cols entries", which gives the consumer its size hints: the entry
+//count, doubled if symType mirrors every edge, bounds the edge count.
+static int loadGraph_common( TextReader &reader
+  , char commentChar
+  , bool ignoreFirstDataLine
+  , bool decrementIndices
+  , bool disallowSelfLinks
+  , SymmetryType symType
+  , bool wantValues
+  , ChunkConsumer &consumer
+  , int &nVertices )
+{
+  const int nThreads = maxParseThreads();
+  std::vector<ParsedChunk> chunks( nThreads * 4 );
+  std::vector<size_t> chunkBegin( chunks.size() + 1 );
+
+  TextBlock blocks[2];
+  int64_t lineNum   = 0;     //lines before the current block
+  int     maxVertex = 0;
+  bool    skipFirst = ignoreFirstDataLine;
+  bool    begun     = false;
+
+  #pragma omp parallel num_threads(nThreads)
+  #pragma omp single
+  {
+    fillBlock( reader, blocks[0], 0, 0 );
+    for( int cur = 0; ; cur = 1 - cur )
+    {
+      TextBlock *block = &blocks[cur];
+      TextBlock *next  = &blocks[1 - cur];
+      if( !block->eof )
+      {
+        #pragma omp task firstprivate(block, next)
+        fillBlock( reader, *next, &block->data[0] + block->end
+          , block->length - block->end );
+      }
+
+      const char* data = &block->data[0];
+      size_t end = block->end;
+
+      //the size line of a MatrixMarket file
+      size_t begin = 0;
+      while( skipFirst && begin < end )
+      {
+        const char* eol = (const char*) memchr( data + begin, '\n', end - begin );
+        ++lineNum;
+        if( data[begin] != commentChar && !isBlankLine( data + begin, eol ) )
+        {
+          skipFirst = false;
+          char* q;
+          long long rows    = strtoll( data + begin, &q, 10 );
+          long long cols    = strtoll( q, &q, 10 );
+          long long entries = strtoll( q, &q, 10 );
+          if( symType != stNone )
+            entries *= 2;
+          consumer.begin( rows > 0 ? max( rows, cols ) : -1
+            , entries > 0 ? entries : -1 );
+          begun = true;
+        }
+        begin = eol + 1 - data;
+      }
+      if( !begun )
+      {
+        consumer.begin( -1, -1 );
+        begun = true;
+      }
+
+      //cut the block at line starts
+      size_t nChunks = chunks.size();
+      chunkBegin[0] = begin;
+      chunkBegin[nChunks] = end;
+      for( size_t i = 1; i < nChunks; ++i )
+      {
+        size_t pos = begin + (end - begin) / nChunks * i;
+        if( pos < chunkBegin[i - 1] )
+          pos = chunkBegin[i - 1];
+        while( pos < end && pos > begin && data[pos - 1] != '\n' )
+          ++pos;
+        chunkBegin[i] = pos;
+      }
+
+      for( size_t i = 0; i < nChunks; ++i )
+      {
+        #pragma omp task firstprivate(i, data)
+        parseLines( data + chunkBegin[i], data + chunkBegin[i + 1]
+          , commentChar, decrementIndices, disallowSelfLinks, symType
+          , wantValues, chunks[i] );
+      }
+      #pragma omp taskwait
+
+      for( size_t i = 0; i < nChunks; ++i )
+      {
+        if( chunks[i].errorLine )
+        {
+          cerr << "error parsing src/dst at line " << lineNum + chunks[i].errorLine << endl;
+          exit(1);
+        }
+        lineNum += chunks[i].nLines;
+        maxVertex = max( maxVertex, chunks[i].maxVertex );
+      }
+      consumer.consume( chunks );
+
+      if( block->eof )
+        break;
+    }
   }
 
   nVertices = maxVertex + 1;
@@ -180,23 +760,20 @@ int loadGraph_GraphLabSnap( const char* fname
   , std::vector<int> &srcs
   , std::vector<int> &dsts )
 {
-  gzFile f = openFile( fname );
-  int ret = loadGraph_common( f, '#', false, false, true, stNone, nVertices, &srcs, &dsts, 0 );
-  gzclose(f);
+  TextReader *f = openFile( fname );
+  EdgeListConsumer consumer( &srcs, &dsts, 0 );
+  int ret = loadGraph_common( *f, '#', false, false, true, stNone, false, consumer, nVertices );
+  delete f;
   return ret;
 }
 
 
-int loadGraph_MatrixMarket( const char* fname
-  , int &nVertices
-  , std::vector<int> &srcs
-  , std::vector<int> &dsts
-  , std::vector<int> *edgeValues )
+//Read the MatrixMarket banner line, hasValues is false for pattern files
+static SymmetryType readMatrixMarketHeader( TextReader &f, bool &hasValues )
 {
-  gzFile f = openFile( fname );
   //first comment line is special
   char line[1024];
-  if( !gzgets( f, line, sizeof(line) ) )
+  if( !f.getLine( line, sizeof(line) ) )
   {
     cerr << "error reading header" << endl;
     exit(1);
@@ -225,14 +802,9 @@ int loadGraph_MatrixMarket( const char* fname
 
   //edge data type
   tok = strtok_r( 0, delim, &p );
+  hasValues = true;
   if( strcmp( tok, "pattern" ) == 0 )
-  {
-    if( edgeValues )
-    {
-      cerr << "warning: graph does not have edge values" << endl;
-      edgeValues = 0;
-    }
-  }
+    hasValues = false;
   else if( strcmp( tok, "complex" ) == 0 )
   {
     cerr << "complex edge values not supported" << endl;
@@ -241,23 +813,38 @@ int loadGraph_MatrixMarket( const char* fname
 
   //symmetry
   tok = strtok_r( 0, delim, &p );
-  SymmetryType st;
   if( strcmp( tok, "general" ) == 0 )
-    st = stNone;
+    return stNone;
   else if( strcmp( tok, "symmetric" ) == 0 )
-    st = stSymmetric;
+    return stSymmetric;
   else if( strcmp( tok, "skew-symmetric" ) == 0 )
-    st = stSkewSymmetric;
+    return stSkewSymmetric;
   else if( strcmp( tok, "hermitian" ) == 0 )
-    st = stHermitian;
-  else
+    return stHermitian;
+
+  cerr << "unrecognized symmetry type '" << tok << "'" <<  endl;
+  exit(1);
+}
+
+
+int loadGraph_MatrixMarket( const char* fname
+  , int &nVertices
+  , std::vector<int> &srcs
+  , std::vector<int> &dsts
+  , std::vector<int> *edgeValues )
+{
+  TextReader *f = openFile( fname );
+  bool hasValues;
+  SymmetryType st = readMatrixMarketHeader( *f, hasValues );
+  if( !hasValues && edgeValues )
   {
-    cerr << "unrecognized symmetry type '" << tok << "'" <<  endl;
-    exit(1);
+    cerr << "warning: graph does not have edge values" << endl;
+    edgeValues = 0;
   }
 
-  int ret = loadGraph_common( f, '%', true, true, true, st, nVertices, &srcs, &dsts, edgeValues );
-  gzclose(f);
+  EdgeListConsumer consumer( &srcs, &dsts, edgeValues );
+  int ret = loadGraph_common( *f, '%', true, true, true, st, edgeValues != 0, consumer, nVertices );
+  delete f;
   return ret;
 }
 
@@ -271,12 +858,13 @@ int loadGraph_MatrixMarket( const char* fname
 //4-byte * nEdges dst indices, padded to 8-byte boundary at end
 //4-byte * nEdges unsigned edge data
 //This loader assumes a little endian host.
-int loadGraph_binaryCSR(const char* fname
-  , int &nVertices, std::vector<int> &srcs, std::vector<int> &dsts
-  , std::vector<int> *edgeValues, bool expand)
+//Reads the ending offsets into ends and the rest into dsts/edgeValues.
+static void readBinaryCSR(const char* fname
+  , int &nVertices, std::vector<uint64_t> &ends, std::vector<int> &dsts
+  , std::vector<int> *edgeValues)
 {
   #define CHK_FREAD(ptr, sz, count, stream) \
-    if (fread(ptr, sz, count, stream) != count) \
+    if (fread(ptr, sz, count, stream) != (size_t)(count)) \
     { \
       cerr << "error reading lonestar binary CSR file " << fname << endl; \
       exit(1); \
@@ -300,14 +888,20 @@ int loadGraph_binaryCSR(const char* fname
     cerr << "file does not have edge values" << endl;
     exit(1);
   }
-  else if (sizeEdgeType != 4)
+  else if (sizeEdgeType != 0 && sizeEdgeType != 4)
   {
     cerr << "file edge data is " << sizeEdgeType << " bytes wide" << endl;
     exit(1);
   }
 
+  //vertex ids are 32-bit, edge counts need not be
   uint64_t nVertices64;
   CHK_FREAD(&nVertices64, 8, 1, f);
+  if (nVertices64 > INT_MAX)
+  {
+    cerr << "graph has too many vertices for 32 bit vertex ids" << endl;
+    exit(1);
+  }
   nVertices = nVertices64;
   printf("nVertices = %lu\n", nVertices64);
 
@@ -316,14 +910,10 @@ int loadGraph_binaryCSR(const char* fname
   printf("nEdges = %lu\n", nEdges);
 
   dsts.resize(nEdges);
-  if (expand)
-    srcs.resize(nEdges);
-  else
-    srcs.resize(nVertices + 1);
 
   //read in the offsets
-  std::vector<uint64_t> tmp(nVertices);
-  CHK_FREAD(&tmp[0], 8, nVertices, f);
+  ends.resize(nVertices);
+  CHK_FREAD(&ends[0], 8, nVertices, f);
   printf("read in %d offsets\n", nVertices);
 
   //read in dst indices and consume padding if any
@@ -336,34 +926,173 @@ int loadGraph_binaryCSR(const char* fname
     CHK_FREAD(&dummy, 4, 1, f);
   }
 
+  if (edgeValues)
+  {
+    edgeValues->resize(nEdges);
+    CHK_FREAD(&((*edgeValues)[0]), 4, nEdges, f);
+  }
+  
+  fclose(f);
+  #undef CHK_FREAD
+}
+
+
+int loadGraph_binaryCSR(const char* fname
+  , int &nVertices, std::vector<int> &srcs, std::vector<int> &dsts
+  , std::vector<int> *edgeValues, bool expand)
+{
+  std::vector<uint64_t> ends;
+  readBinaryCSR(fname, nVertices, ends, dsts, edgeValues);
+
   if (expand)
   {
-    int j = 0;
+    srcs.resize(dsts.size());
+    uint64_t j = 0;
     for (int i = 0; i < nVertices; ++i)
     {
-      for (; j < tmp[i]; ++j)
+      for (; j < ends[i]; ++j)
         srcs[j] = i;
     }
   }
   else
   {
+    if (dsts.size() > INT_MAX)
+    {
+      cerr << "graph has too many edges for 32 bit offsets" << endl;
+      exit(1);
+    }
+    srcs.resize(nVertices + 1);
+    srcs[0] = 0;
     for (int i = 0; i < nVertices; ++i)
-      srcs[i + 1] = tmp[i];
+      srcs[i + 1] = ends[i];
   }
+  return 0;
+}
 
-  if (edgeValues)
+
+int loadGraph_binaryCSR(const char* fname
+  , int &nVertices, std::vector<int64_t> &offsets, std::vector<int> &dsts
+  , std::vector<int> *edgeValues)
+{
+  std::vector<uint64_t> ends;
+  readBinaryCSR(fname, nVertices, ends, dsts, edgeValues);
+  offsets.resize(nVertices + 1);
+  offsets[0] = 0;
+  for (int i = 0; i < nVertices; ++i)
+    offsets[i + 1] = ends[i];
+  return 0;
+}
+
+
+int mapGraph_binaryCSR(const char* fname, MappedCSRGraph &graph)
+{
+  int fd = open(fname, O_RDONLY);
+  if (fd < 0)
   {
-    edgeValues->resize(nEdges);
-    CHK_FREAD(&((*edgeValues)[0]), 4, nEdges, f);
+    cerr << "unable to open file " << fname << endl;
+    exit(1);
   }
-  
-  fclose(f);
-  #undef CHK_FREAD
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < 32)
+  {
+    cerr << "error reading lonestar binary CSR file " << fname << endl;
+    exit(1);
+  }
+
+  //read only, every view points straight into the shared page cache
+  void *base = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+  {
+    cerr << "unable to map file " << fname << endl;
+    exit(1);
+  }
+
+  const uint64_t *header = (const uint64_t *) base;
+  uint64_t sizeEdgeType = header[1];
+  uint64_t nVertices    = header[2];
+  uint64_t nEdges       = header[3];
+  if (sizeEdgeType != 0 && sizeEdgeType != 4)
+  {
+    cerr << "file edge data is " << sizeEdgeType << " bytes wide" << endl;
+    exit(1);
+  }
+
+  //header, offsets, dsts padded to 8 bytes, edge values.  Each part is
+  //checked against what is left of the file before it is sized, so counts
+  //from a corrupt header cannot overflow and wrap past the check.
+  uint64_t left = (uint64_t) st.st_size - 32;
+  bool truncated = nVertices > left / 8;
+  if (!truncated)
+  {
+    left -= nVertices * 8;
+    truncated = nEdges > left / 4;
+  }
+  uint64_t dstsBytes = truncated ? 0 : (nEdges * 4 + 7) & ~(uint64_t)7;
+  if (!truncated)
+  {
+    truncated = dstsBytes > left;
+    left -= truncated ? 0 : dstsBytes;
+  }
+  if (truncated || nEdges * sizeEdgeType > left)
+  {
+    cerr << "lonestar binary CSR file " << fname << " is truncated" << endl;
+    exit(1);
+  }
+
+  //the vertex data is read sequentially, the edges mostly not
+  madvise(base, 32 + nVertices * 8, MADV_SEQUENTIAL);
+
+  char *p = (char *) base + 32;
+  graph.nVertices  = nVertices;
+  graph.nEdges     = nEdges;
+  graph.offsets    = (const uint64_t *) p;
+  graph.dsts       = (const uint32_t *) (p + nVertices * 8);
+  graph.edgeValues = sizeEdgeType ? (const int *) (p + nVertices * 8 + dstsBytes) : 0;
+  graph.base       = base;
+  graph.length     = st.st_size;
+  return 0;
 }
 
 
-int writeGraph_binaryCSR(const char* fname
-  , int nVertices, int nEdges, const int *offsets, const int* dsts
+void unmapGraph(MappedCSRGraph &graph)
+{
+  if (graph.base)
+    munmap(graph.base, graph.length);
+  graph.base       = 0;
+  graph.offsets    = 0;
+  graph.dsts       = 0;
+  graph.edgeValues = 0;
+}
+
+
+void mappedGraphOffsets(const MappedCSRGraph &graph, int64_t *offsets)
+{
+  offsets[0] = 0;
+  #pragma omp parallel for schedule(static)
+  for (int64_t i = 0; i < graph.nVertices; ++i)
+    offsets[i + 1] = (int64_t) graph.offsets[i];
+}
+
+
+void mappedGraphOffsets(const MappedCSRGraph &graph, int *offsets)
+{
+  if (graph.nEdges > INT_MAX)
+  {
+    cerr << "graph has too many edges for 32 bit offsets" << endl;
+    exit(1);
+  }
+  offsets[0] = 0;
+  #pragma omp parallel for schedule(static)
+  for (int64_t i = 0; i < graph.nVertices; ++i)
+    offsets[i + 1] = (int) graph.offsets[i];
+}
+
+
+template<typename Offset>
+static int writeBinaryCSR(const char* fname
+  , int nVertices, int64_t nEdges, const Offset *offsets, const int* dsts
   , const int *edgeValues)
 {
   FILE *f = fopen(fname, "w");
@@ -410,10 +1139,27 @@ int writeGraph_binaryCSR(const char* fname
     fwrite(edgeValues, 4, nEdges, f);
   
   fclose(f);
-} 
+  return 0;
+}
 
 
-int writeGraph_mtx(const char* fname, int nVertices, int nEdges
+int writeGraph_binaryCSR(const char* fname
+  , int nVertices, int nEdges, const int *offsets, const int* dsts
+  , const int *edgeValues)
+{
+  return writeBinaryCSR(fname, nVertices, nEdges, offsets, dsts, edgeValues);
+}
+
+
+int writeGraph_binaryCSR(const char* fname
+  , int nVertices, int64_t nEdges, const int64_t *offsets, const int* dsts
+  , const int *edgeValues)
+{
+  return writeBinaryCSR(fname, nVertices, nEdges, offsets, dsts, edgeValues);
+}
+
+
+int writeGraph_mtx(const char* fname, int nVertices, int64_t nEdges
   , const int *srcs, const int *dsts, const int* edgeValues)
 {
   FILE *f = fopen(fname, "w");
@@ -423,26 +1169,238 @@ int writeGraph_mtx(const char* fname, int nVertices, int nEdges
     exit(1);
   }
   fprintf(f, "%%MatrixMarket matrix coordinate Integer general\n");
-  fprintf(f, "%d %d %d\n", nVertices, nVertices, nEdges);
+  fprintf(f, "%d %d %lld\n", nVertices, nVertices, (long long) nEdges);
   if (edgeValues)
   {
-    for (int i = 0; i < nEdges; ++i)
+    for (int64_t i = 0; i < nEdges; ++i)
       fprintf(f, "%d %d %d\n", srcs[i]+1, dsts[i]+1, edgeValues[i]);
   }
   else
   {
-    for (int i = 0; i < nEdges; ++i)
+    for (int64_t i = 0; i < nEdges; ++i)
       fprintf(f, "%d %d\n", srcs[i]+1, dsts[i]+1);
   }
   fclose(f);
+  return 0;
 }
 
 
-int loadGraph( const char* fname
-  , int &nVertices
-  , std::vector<int> &srcs
-  , std::vector<int> &dsts
-  , std::vector<int> *edgeValues )
+//Compressed binary CSR, little endian like .gr:
+//8-byte magic
+//8-byte version
+//8-byte sizeEdgeType (0 or 4)
+//8-byte nVertices
+//8-byte nEdges
+//8-byte block size of the encoding
+//8-byte nBytes of encoded neighbors
+//8-byte * (nVertices + 1) offsets
+//8-byte * (nBlocks + 1) byte positions of the blocks
+//nBytes encoded neighbors, padded to 8-byte boundary at end
+//4-byte * nEdges edge data, in the order of the compressed edges
+static const char     compressedCSRMagic[8] = { 'V', 'A', 'P', 'I', '2', 'C', 'G', 'R' };
+static const uint64_t compressedCSRVersion = 1;
+
+
+template<typename EdgeInt>
+static int readCompressedCSR(const char* fname
+  , CompressedCSR<int, EdgeInt> &graph, std::vector<int> *edgeValues)
+{
+  #define CHK_FREAD(ptr, sz, count, stream) \
+    if (fread(ptr, sz, count, stream) != (size_t)(count)) \
+    { \
+      cerr << "error reading compressed CSR file " << fname << endl; \
+      exit(1); \
+    } \
+
+  FILE* f = fopen(fname, "r");
+  if (!f)
+  {
+    cerr << "unable to open file " << fname << endl;
+    exit(1);
+  }
+
+  char magic[8];
+  uint64_t header[6];
+  CHK_FREAD(magic, 1, 8, f);
+  CHK_FREAD(header, 8, 6, f);
+  uint64_t sizeEdgeType = header[1];
+  uint64_t nVertices    = header[2];
+  uint64_t nEdges       = header[3];
+  uint64_t nBytes       = header[5];
+  if (memcmp(magic, compressedCSRMagic, 8) != 0 || header[0] != compressedCSRVersion)
+  {
+    cerr << fname << " is not a compressed CSR file of version "
+         << compressedCSRVersion << endl;
+    exit(1);
+  }
+  if (header[4] != (uint64_t) CompressedCSR<int, EdgeInt>::blockSize)
+  {
+    cerr << "compressed CSR file has block size " << header[4] << endl;
+    exit(1);
+  }
+  if (sizeEdgeType != 0 && sizeEdgeType != 4)
+  {
+    cerr << "file edge data is " << sizeEdgeType << " bytes wide" << endl;
+    exit(1);
+  }
+  if (nVertices > INT_MAX)
+  {
+    cerr << "graph has too many vertices for 32 bit vertex ids" << endl;
+    exit(1);
+  }
+  if (nEdges > (uint64_t) numeric_limits<EdgeInt>::max())
+  {
+    cerr << "graph has too many edges for 32 bit offsets" << endl;
+    exit(1);
+  }
+
+  graph.nVertices = (int) nVertices;
+  graph.nEdges    = (EdgeInt) nEdges;
+
+  std::vector<int64_t> tmp(nVertices + 1);
+  CHK_FREAD(&tmp[0], 8, nVertices + 1, f);
+  graph.offsets.assign(tmp.begin(), tmp.end());
+
+  graph.blockOffsets.resize(graph.nBlocks() + 1);
+  CHK_FREAD(&graph.blockOffsets[0], 8, graph.blockOffsets.size(), f);
+
+  graph.bytes.resize(nBytes);
+  if (nBytes)
+    CHK_FREAD(&graph.bytes[0], 1, nBytes, f);
+  if (nBytes % 8)
+  {
+    char pad[8];
+    CHK_FREAD(pad, 1, 8 - nBytes % 8, f);
+  }
+
+  //values are left empty if the file has none, as with text files
+  if (edgeValues)
+  {
+    edgeValues->clear();
+    if (sizeEdgeType)
+    {
+      edgeValues->resize(nEdges);
+      if (nEdges)
+        CHK_FREAD(&(*edgeValues)[0], 4, nEdges, f);
+    }
+  }
+
+  fclose(f);
+  #undef CHK_FREAD
+  return 0;
+}
+
+
+int loadGraph_compressedCSR(const char* fname
+  , CompressedCSR<int> &graph, std::vector<int> *edgeValues)
+{
+  return readCompressedCSR(fname, graph, edgeValues);
+}
+
+
+int loadGraph_compressedCSR(const char* fname
+  , CompressedCSR<int, int64_t> &graph, std::vector<int> *edgeValues)
+{
+  return readCompressedCSR(fname, graph, edgeValues);
+}
+
+
+template<typename EdgeInt>
+static int writeCompressedCSR(const char* fname
+  , const CompressedCSR<int, EdgeInt> &graph, const int *edgeValues)
+{
+  FILE *f = fopen(fname, "w");
+  if (!f)
+  {
+    cerr << "unable to write to file " << fname << endl;
+    exit(1);
+  }
+
+  uint64_t header[6];
+  header[0] = compressedCSRVersion;
+  header[1] = edgeValues ? 4 : 0;
+  header[2] = graph.nVertices;
+  header[3] = graph.nEdges;
+  header[4] = CompressedCSR<int, EdgeInt>::blockSize;
+  header[5] = graph.bytes.size();
+  fwrite(compressedCSRMagic, 1, 8, f);
+  fwrite(header, 8, 6, f);
+
+  std::vector<int64_t> tmp(graph.offsets.begin(), graph.offsets.end());
+  fwrite(&tmp[0], 8, tmp.size(), f);
+  fwrite(&graph.blockOffsets[0], 8, graph.blockOffsets.size(), f);
+
+  if (!graph.bytes.empty())
+    fwrite(&graph.bytes[0], 1, graph.bytes.size(), f);
+  if (graph.bytes.size() % 8)
+  {
+    char pad[8] = { 0 };
+    fwrite(pad, 1, 8 - graph.bytes.size() % 8, f);
+  }
+
+  if (edgeValues)
+    fwrite(edgeValues, 4, graph.nEdges, f);
+
+  fclose(f);
+  return 0;
+}
+
+
+int writeGraph_compressedCSR(const char* fname
+  , const CompressedCSR<int> &graph, const int *edgeValues)
+{
+  return writeCompressedCSR(fname, graph, edgeValues);
+}
+
+
+int writeGraph_compressedCSR(const char* fname
+  , const CompressedCSR<int, int64_t> &graph, const int *edgeValues)
+{
+  return writeCompressedCSR(fname, graph, edgeValues);
+}
+
+
+//vertex order files are text, line v holds the new id of vertex v
+int writeVertexOrder(const char* fname, int nVertices, const int *newId)
+{
+  FILE *f = fopen(fname, "w");
+  if (!f)
+  {
+    cerr << "unable to write to file " << fname << endl;
+    exit(1);
+  }
+  for (int v = 0; v < nVertices; ++v)
+    fprintf(f, "%d\n", newId[v]);
+  fclose(f);
+  return 0;
+}
+
+
+int loadVertexOrder(const char* fname, std::vector<int> &newId)
+{
+  FILE *f = fopen(fname, "r");
+  if (!f)
+  {
+    cerr << "unable to open file " << fname << endl;
+    exit(1);
+  }
+  newId.clear();
+  int id;
+  while (fscanf(f, "%d", &id) == 1)
+    newId.push_back(id);
+  fclose(f);
+
+  if (!isVertexOrder((int) newId.size(), newId.empty() ? 0 : &newId[0]))
+  {
+    cerr << fname << " is not a permutation of the vertices" << endl;
+    exit(1);
+  }
+  return 0;
+}
+
+
+//the extension of fname before any .gz
+static const char* graphExtension( const char* fname )
 {
   const char*p = fname;
   while( *p )
@@ -456,6 +1414,17 @@ int loadGraph( const char* fname
     while( p >= fname && *p != '.' )
       --p;
   }
+  return p;
+}
+
+
+static int loadGraph_uncached( const char* fname
+  , int &nVertices
+  , std::vector<int> &srcs
+  , std::vector<int> &dsts
+  , std::vector<int> *edgeValues )
+{
+  const char*p = graphExtension( fname );
 
   if( strncmp( p, ".edge", 5 ) == 0 )
     return loadGraph_GraphLabSnap( fname, nVertices, srcs, dsts );
@@ -463,12 +1432,627 @@ int loadGraph( const char* fname
     return loadGraph_MatrixMarket( fname, nVertices, srcs, dsts, edgeValues );
   else if( strncmp( p, ".gr", 3 ) == 0 )
     return loadGraph_binaryCSR( fname, nVertices, srcs, dsts, edgeValues, true );
+  else if( strncmp( p, ".cgr", 4 ) == 0 )
+  {
+    //back to an edge list in the order of the compressed edges
+    CompressedCSR<int, int64_t> graph;
+    loadGraph_compressedCSR( fname, graph, edgeValues );
+    nVertices = graph.nVertices;
+    srcs.resize( graph.nEdges );
+    dsts.resize( graph.nEdges );
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for( int v = 0; v < nVertices; ++v )
+    {
+      for( int64_t i = graph.offsets[v]; i < graph.offsets[v + 1]; ++i )
+        srcs[i] = v;
+    }
+    if( graph.nEdges )
+      decompressCSR( graph, &dsts[0] );
+    return 0;
+  }
+  else
+  {
+    cerr << "unrecognized filetype extension " << p << endl;
+    exit(1);
+  }
+
+  return 0;
+}
+
+
+//Edges per EdgeSink::edges call for .gr files
+static const size_t streamChunkEdges = 1 << 20;
+
+
+//Stream a mapped .gr file, expanding its CSR in fixed size chunks
+static void streamGraph_binaryCSR( const char* fname, EdgeSink &sink
+  , int &nVertices, bool edgeValues )
+{
+  MappedCSRGraph graph;
+  mapGraph_binaryCSR( fname, graph );
+  if( graph.nEdges > INT_MAX || graph.nVertices > INT_MAX )
+  {
+    cerr << "graph is too large for 32 bit indices" << endl;
+    exit(1);
+  }
+  bool hasValues = edgeValues && graph.edgeValues;
+  sink.begin( graph.nVertices, graph.nEdges, hasValues );
+
+  std::vector<int> srcs( streamChunkEdges );
+  int64_t v = 0;
+  for( int64_t begin = 0; begin < graph.nEdges; begin += streamChunkEdges )
+  {
+    int64_t end = min( begin + (int64_t) streamChunkEdges, graph.nEdges );
+    for( int64_t i = begin; i < end; ++i )
+    {
+      while( graph.offsets[v] <= (uint64_t) i )
+        ++v;
+      srcs[i - begin] = (int) v;
+    }
+    sink.edges( &srcs[0], (const int*) graph.dsts + begin
+      , hasValues ? graph.edgeValues + begin : 0, end - begin );
+  }
+
+  nVertices = (int) graph.nVertices;
+  unmapGraph( graph );
+}
+
+
+//Stream a .cgr file, decoding it in fixed size chunks.  The compressed
+//graph is read whole, it is small next to the edge list.
+static void streamGraph_compressedCSR( const char* fname, EdgeSink &sink
+  , int &nVertices, bool edgeValues )
+{
+  CompressedCSR<int, int64_t> graph;
+  std::vector<int> values;
+  loadGraph_compressedCSR( fname, graph, edgeValues ? &values : 0 );
+  if( graph.nEdges > INT_MAX )
+  {
+    cerr << "graph is too large for 32 bit indices" << endl;
+    exit(1);
+  }
+  bool hasValues = !values.empty();
+  sink.begin( graph.nVertices, graph.nEdges, hasValues );
+
+  std::vector<int> srcs( streamChunkEdges );
+  std::vector<int> dsts( streamChunkEdges );
+  CompressedCSR<int, int64_t>::Reader reader( graph );
+  int v = 0;
+  for( int64_t begin = 0; begin < graph.nEdges; begin += streamChunkEdges )
+  {
+    int64_t end = min( begin + (int64_t) streamChunkEdges, graph.nEdges );
+    for( int64_t i = begin; i < end; ++i )
+    {
+      while( graph.offsets[v + 1] <= i )
+        ++v;
+      reader.seek( v, i );
+      srcs[i - begin] = v;
+      dsts[i - begin] = reader.next();
+    }
+    sink.edges( &srcs[0], &dsts[0], hasValues ? &values[begin] : 0, end - begin );
+  }
+
+  nVertices = graph.nVertices;
+}
+
+
+int streamGraph( const char* fname
+  , EdgeSink &sink
+  , int &nVertices
+  , bool edgeValues )
+{
+  const char*p = graphExtension( fname );
+
+  if( strncmp( p, ".gr", 3 ) == 0 )
+  {
+    streamGraph_binaryCSR( fname, sink, nVertices, edgeValues );
+    return 0;
+  }
+  if( strncmp( p, ".cgr", 4 ) == 0 )
+  {
+    streamGraph_compressedCSR( fname, sink, nVertices, edgeValues );
+    return 0;
+  }
+
+  TextReader *f = 0;
+  int ret;
+  if( strncmp( p, ".edge", 5 ) == 0 )
+  {
+    f = openFile( fname );
+    SinkConsumer consumer( sink, false );
+    ret = loadGraph_common( *f, '#', false, false, true, stNone, false, consumer, nVertices );
+  }
+  else if( strncmp( p, ".mtx", 4 ) == 0 )
+  {
+    f = openFile( fname );
+    bool hasValues;
+    SymmetryType st = readMatrixMarketHeader( *f, hasValues );
+    hasValues = hasValues && edgeValues;
+    SinkConsumer consumer( sink, hasValues );
+    ret = loadGraph_common( *f, '%', true, true, true, st, hasValues, consumer, nVertices );
+  }
   else
   {
     cerr << "unrecognized filetype extension " << p << endl;
     exit(1);
   }
+  delete f;
+  return ret;
+}
+
+
+//First pass of loadGraph_streamCSR: out-degrees
+class DegreeSink : public EdgeSink
+{
+public:
+  DegreeSink( std::vector<int64_t> &counts )
+    : m_counts( counts )
+  {
+  }
+
+  virtual void begin( int64_t nVerticesHint, int64_t, bool )
+  {
+    if( nVerticesHint > 0 )
+      m_counts.reserve( nVerticesHint + 1 );
+  }
+
+  virtual void edges( const int *srcs, const int*, const int*, size_t n )
+  {
+    for( size_t i = 0; i < n; ++i )
+    {
+      //counts[v + 1] is the degree of v, ready for scanCSROffsets
+      if( srcs[i] + 2 > (int) m_counts.size() )
+        m_counts.resize( srcs[i] + 2, 0 );
+      ++m_counts[srcs[i] + 1];
+    }
+  }
+
+private:
+  std::vector<int64_t> &m_counts;
+};
+
+
+//Second pass: every edge into the next slot of its source
+template<typename Offset>
+class PlacementSink : public EdgeSink
+{
+public:
+  PlacementSink( std::vector<Offset> &cursor, std::vector<int> &dsts
+    , std::vector<int> *edgeValues )
+    : m_cursor( cursor ), m_dsts( dsts ), m_edgeValues( edgeValues )
+    , m_hasValues( false )
+  {
+  }
+
+  virtual void begin( int64_t, int64_t, bool hasValues )
+  {
+    m_hasValues = hasValues;
+    if( !hasValues )
+      m_edgeValues = 0;
+  }
+
+  bool hasValues() const
+  {
+    return m_hasValues;
+  }
+
+  virtual void edges( const int *srcs, const int *dsts, const int *values, size_t n )
+  {
+    for( size_t i = 0; i < n; ++i )
+    {
+      Offset pos = m_cursor[srcs[i]]++;
+      m_dsts[pos] = dsts[i];
+      if( m_edgeValues )
+        (*m_edgeValues)[pos] = values[i];
+    }
+  }
+
+private:
+  std::vector<Offset> &m_cursor;
+  std::vector<int> &m_dsts;
+  std::vector<int> *m_edgeValues;
+  bool              m_hasValues;
+};
+
+
+template<typename Offset>
+static int streamCSR( const char* fname
+  , int &nVertices
+  , std::vector<Offset> &offsets
+  , std::vector<int> &dsts
+  , std::vector<int> *edgeValues )
+{
+  std::vector<int64_t> counts( 1, 0 );
+  DegreeSink degrees( counts );
+  streamGraph( fname, degrees, nVertices, false );
+  counts.resize( nVertices + 1, 0 );
+  scanCSROffsets( nVertices, &counts[0] );
+
+  int64_t nEdges = counts[nVertices];
+  if( nEdges > std::numeric_limits<Offset>::max() )
+  {
+    cerr << "graph has too many edges for 32 bit offsets" << endl;
+    exit(1);
+  }
+  offsets.assign( counts.begin(), counts.end() );
+  std::vector<int64_t>().swap( counts );
+
+  dsts.resize( nEdges );
+  if( edgeValues )
+    edgeValues->resize( nEdges );
+  std::vector<Offset> cursor( offsets.begin(), offsets.end() - 1 );
+  PlacementSink<Offset> placement( cursor, dsts, edgeValues );
+  streamGraph( fname, placement, nVertices, edgeValues != 0 );
+  if( edgeValues && !placement.hasValues() )
+    edgeValues->clear();
+  return 0;
+}
+
+
+int loadGraph_streamCSR( const char* fname
+  , int &nVertices
+  , std::vector<int> &offsets
+  , std::vector<int> &dsts
+  , std::vector<int> *edgeValues )
+{
+  return streamCSR( fname, nVertices, offsets, dsts, edgeValues );
+}
+
+
+int loadGraph_streamCSR( const char* fname
+  , int &nVertices
+  , std::vector<int64_t> &offsets
+  , std::vector<int> &dsts
+  , std::vector<int> *edgeValues )
+{
+  return streamCSR( fname, nVertices, offsets, dsts, edgeValues );
+}
+
+
+//The loadGraph cache file holds this header followed by the arrays of a
+//CachedGraph, each padded to a multiple of 8 bytes: csrOffsets, csrDsts,
+//csrIndex, cscOffsets, cscSrcs, cscIndex and, if hasValues is
+//cacheValuesStored, edgeValues.
+//Bump graphCacheVersion whenever the layout or the parsers' output changes.
+static const uint64_t graphCacheVersion = 1;
+static const char     graphCacheMagic[8] = { 'V', 'A', 'P', 'I', '2', 'G', 'C', 0 };
+
+struct GraphCacheHeader
+{
+  char     magic[8];
+  uint64_t version;
+  uint64_t sourceSize;
+  int64_t  sourceMtime;
+  int64_t  sourceMtimeNsec;
+  uint64_t sourceHash;
+  uint64_t hasValues;
+  uint64_t nVertices;
+  uint64_t nEdges;
+};
+
+//GraphCacheHeader::hasValues
+enum { cacheNoValues = 0, cacheValuesStored = 1, cacheSourceHasNoValues = 2 };
+
+static bool graphCacheEnabled = true;
+
+
+void setGraphCacheEnabled(bool enable)
+{
+  graphCacheEnabled = enable;
+}
+
+
+//.gr and .cgr files are binary already, only text files are cached
+static bool useGraphCache( const char* fname )
+{
+  const char* ext = graphExtension( fname );
+  return graphCacheEnabled && strncmp( ext, ".gr", 3 ) != 0
+    && strncmp( ext, ".cgr", 4 ) != 0;
+}
+
+
+static std::string graphCachePath( const char* fname )
+{
+  return std::string( fname ) + ".cache";
+}
+
+
+//FNV-1a hash of the first and last MB of the file, so that a rewritten
+//input with the same size and time stamp is still noticed in most cases
+//without reading all of it.  A change of the same size in between is not,
+//see setGraphCacheEnabled.
+static uint64_t sampleHash( FILE* f, uint64_t size )
+{
+  const uint64_t sample = 1 << 20;
+  std::vector<unsigned char> buf( sample );
+  uint64_t hash = 14695981039346656037ULL;
+  uint64_t starts[2] = { 0, size > sample ? size - sample : 0 };
+  for( int k = 0; k < 2; ++k )
+  {
+    fseeko( f, starts[k], SEEK_SET );
+    size_t n = fread( &buf[0], 1, sample, f );
+    for( size_t i = 0; i < n; ++i )
+      hash = (hash ^ buf[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+
+//the header a cache for fname must have, false if fname cannot be read
+static bool graphCacheKey( const char* fname, bool hasValues, GraphCacheHeader &key )
+{
+  struct stat st;
+  FILE* f = fopen( fname, "rb" );
+  if( !f || fstat( fileno( f ), &st ) != 0 )
+  {
+    if( f )
+      fclose( f );
+    return false;
+  }
+  memset( &key, 0, sizeof(key) );
+  memcpy( key.magic, graphCacheMagic, sizeof(key.magic) );
+  key.version         = graphCacheVersion;
+  key.sourceSize      = st.st_size;
+  key.sourceMtime     = st.st_mtim.tv_sec;
+  key.sourceMtimeNsec = st.st_mtim.tv_nsec;
+  key.sourceHash      = sampleHash( f, st.st_size );
+  key.hasValues       = hasValues ? cacheValuesStored : cacheNoValues;
+  fclose( f );
+  return true;
+}
+
+
+static size_t cacheArrayBytes( uint64_t n )
+{
+  return (n * sizeof(int) + 7) & ~(size_t) 7;
+}
+
+
+//point the arrays of graph into the cache layout at base
+static void setCachedArrays( CachedGraph &graph, const char* base, bool hasValues )
+{
+  size_t offsetBytes = cacheArrayBytes( graph.nVertices + 1 );
+  size_t edgeBytes   = cacheArrayBytes( graph.nEdges );
+  const char* p = base;
+  graph.csrOffsets = (const int*) p;  p += offsetBytes;
+  graph.csrDsts    = (const int*) p;  p += edgeBytes;
+  graph.csrIndex   = (const int*) p;  p += edgeBytes;
+  graph.cscOffsets = (const int*) p;  p += offsetBytes;
+  graph.cscSrcs    = (const int*) p;  p += edgeBytes;
+  graph.cscIndex   = (const int*) p;  p += edgeBytes;
+  graph.edgeValues = hasValues ? (const int*) p : 0;
+}
+
+
+static size_t cacheDataBytes( uint64_t nVertices, uint64_t nEdges, bool hasValues )
+{
+  return 2 * cacheArrayBytes( nVertices + 1 )
+    + (hasValues ? 5 : 4) * cacheArrayBytes( nEdges );
+}
+
+
+//map the cache of fname if it matches key, with edge values if wantValues
+static bool mapGraphCache( const char* fname, const GraphCacheHeader &key
+  , bool wantValues, CachedGraph &graph )
+{
+  std::string path = graphCachePath( fname );
+  int fd = open( path.c_str(), O_RDONLY );
+  if( fd < 0 )
+    return false;
+
+  GraphCacheHeader h;
+  struct stat st;
+  bool ok = read( fd, &h, sizeof(h) ) == (ssize_t) sizeof(h)
+    && fstat( fd, &st ) == 0
+    && memcmp( h.magic, key.magic, sizeof(h.magic) ) == 0
+    && h.version == key.version
+    && h.sourceSize == key.sourceSize
+    && h.sourceMtime == key.sourceMtime
+    && h.sourceMtimeNsec == key.sourceMtimeNsec
+    && h.sourceHash == key.sourceHash
+    && (h.hasValues != cacheNoValues || !wantValues)
+    && h.nVertices < INT_MAX && h.nEdges <= INT_MAX
+    && (uint64_t) st.st_size == sizeof(h)
+      + cacheDataBytes( h.nVertices, h.nEdges, h.hasValues == cacheValuesStored );
+  if( !ok )
+  {
+    close( fd );
+    return false;
+  }
+
+  void* base = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+  if( base == MAP_FAILED )
+    return false;
+
+  graph.nVertices = (int) h.nVertices;
+  graph.nEdges    = (int) h.nEdges;
+  graph.base      = base;
+  graph.length    = st.st_size;
+  setCachedArrays( graph, (const char*) base + sizeof(h), h.hasValues == cacheValuesStored );
+  if( !wantValues )
+    graph.edgeValues = 0;
+  return true;
+}
+
+
+//Build the CachedGraph arrays of an edge list in graph.storage.  values may
+//be null, or empty for a MatrixMarket pattern file.
+static void buildCachedGraph( int nVertices, const std::vector<int> &srcs
+  , const std::vector<int> &dsts, const std::vector<int> *values
+  , CachedGraph &graph )
+{
+  bool hasValues = values && values->size() == srcs.size();
+
+  graph.nVertices = nVertices;
+  graph.nEdges    = (int) srcs.size();
+  graph.base      = 0;
+  graph.length    = 0;
+  graph.storage.assign( cacheDataBytes( nVertices, graph.nEdges, hasValues ) / sizeof(int), 0 );
+  setCachedArrays( graph, (const char*) &graph.storage[0], hasValues );
+
+  int nEdges = graph.nEdges;
+  edgeListToCSRAndCSC( nVertices, nEdges
+    , nEdges ? &srcs[0] : 0, nEdges ? &dsts[0] : 0
+    , const_cast<int*>( graph.csrOffsets ), const_cast<int*>( graph.csrDsts )
+    , const_cast<int*>( graph.csrIndex )
+    , const_cast<int*>( graph.cscOffsets ), const_cast<int*>( graph.cscSrcs )
+    , const_cast<int*>( graph.cscIndex ) );
+  if( hasValues && nEdges )
+    memcpy( const_cast<int*>( graph.edgeValues ), &(*values)[0], nEdges * sizeof(int) );
+}
+
+
+//the cache has 32-bit offsets
+static bool fitsGraphCache( const std::vector<int> &srcs )
+{
+  return srcs.size() <= INT_MAX;
+}
+
+
+//A cache being written: a temporary file next to it that is renamed over
+//the cache once complete, so that concurrent loads never see a partial one.
+struct GraphCacheFile
+{
+  FILE*       f;
+  std::string path;
+  std::string tmp;
+};
+
+
+//Open the temporary file for the cache of fname.  Callers open it before
+//building the cache so that nothing is built when it cannot be written
+//(e.g. in a read-only directory), which is not an error.
+static bool openGraphCache( const char* fname, GraphCacheFile &file )
+{
+  file.path = graphCachePath( fname );
+  char pid[32];
+  snprintf( pid, sizeof(pid), ".%d", (int) getpid() );
+  file.tmp = file.path + pid;
+  file.f = fopen( file.tmp.c_str(), "wb" );
+  return file.f != 0;
+}
+
+
+//Write graph to an opened cache file and put it in place
+static void writeGraphCache( GraphCacheFile &file, GraphCacheHeader key
+  , const CachedGraph &graph )
+{
+  //remember that values were looked for even if there are none, so that
+  //the next load asking for them can still use the cache
+  if( graph.edgeValues )
+    key.hasValues = cacheValuesStored;
+  else if( key.hasValues == cacheValuesStored )
+    key.hasValues = cacheSourceHasNoValues;
+  key.nVertices = graph.nVertices;
+  key.nEdges    = graph.nEdges;
+
+  FILE* f = file.f;
+  file.f = 0;
+  size_t dataBytes = cacheDataBytes( key.nVertices, key.nEdges, graph.edgeValues != 0 );
+  const char* data = graph.base ? (const char*) graph.base + sizeof(key)
+    : (const char*) &graph.storage[0];
+  bool ok = fwrite( &key, sizeof(key), 1, f ) == 1
+    && fwrite( data, 1, dataBytes, f ) == dataBytes;
+  ok = (fclose( f ) == 0) && ok;
+  if( ok && rename( file.tmp.c_str(), file.path.c_str() ) == 0 )
+    cerr << "wrote graph cache " << file.path << endl;
+  else
+    unlink( file.tmp.c_str() );
+}
+
+
+int loadGraph_cached( const char* fname
+  , CachedGraph &graph
+  , bool edgeValues )
+{
+  GraphCacheHeader key;
+  bool haveKey = useGraphCache( fname ) && graphCacheKey( fname, edgeValues, key );
+  if( haveKey && mapGraphCache( fname, key, edgeValues, graph ) )
+  {
+    graph.storage.clear();
+    return 0;
+  }
+
+  int nVertices;
+  std::vector<int> srcs, dsts, values;
+  loadGraph_uncached( fname, nVertices, srcs, dsts, edgeValues ? &values : 0 );
+  if( !fitsGraphCache( srcs ) )
+  {
+    cerr << "graph has too many edges for 32 bit offsets" << endl;
+    exit(1);
+  }
+  GraphCacheFile file;
+  bool writeCache = haveKey && openGraphCache( fname, file );
+  buildCachedGraph( nVertices, srcs, dsts, edgeValues ? &values : 0, graph );
+  if( writeCache )
+    writeGraphCache( file, key, graph );
+  return 0;
+}
+
+
+void unmapGraph(CachedGraph &graph)
+{
+  if( graph.base )
+    munmap( graph.base, graph.length );
+  graph.base   = 0;
+  graph.length = 0;
+  std::vector<int>().swap( graph.storage );
+}
+
+
+int loadGraph( const char* fname
+  , int &nVertices
+  , std::vector<int> &srcs
+  , std::vector<int> &dsts
+  , std::vector<int> *edgeValues )
+{
+  if( !useGraphCache( fname ) )
+    return loadGraph_uncached( fname, nVertices, srcs, dsts, edgeValues );
+
+  CachedGraph graph;
+  GraphCacheHeader key;
+  bool haveKey = graphCacheKey( fname, edgeValues != 0, key );
+  if( !haveKey || !mapGraphCache( fname, key, edgeValues != 0, graph ) )
+  {
+    //parse straight into the caller's arrays and cache them, unless the
+    //graph is too large for the cache or the cache cannot be written
+    if( edgeValues )
+      edgeValues->clear();
+    loadGraph_uncached( fname, nVertices, srcs, dsts, edgeValues );
+    GraphCacheFile file;
+    if( haveKey && fitsGraphCache( srcs ) && openGraphCache( fname, file ) )
+    {
+      buildCachedGraph( nVertices, srcs, dsts, edgeValues, graph );
+      writeGraphCache( file, key, graph );
+      unmapGraph( graph );
+    }
+    return 0;
+  }
+
+  //back to the edge list: CSR edge i is edge csrIndex[i] of the list
+  int nEdges = graph.nEdges;
+  nVertices = graph.nVertices;
+  srcs.resize( nEdges );
+  dsts.resize( nEdges );
+  #pragma omp parallel for schedule(dynamic, 1024)
+  for( int v = 0; v < nVertices; ++v )
+  {
+    for( int i = graph.csrOffsets[v]; i < graph.csrOffsets[v + 1]; ++i )
+    {
+      srcs[graph.csrIndex[i]] = v;
+      dsts[graph.csrIndex[i]] = graph.csrDsts[i];
+    }
+  }
+  if( edgeValues )
+  {
+    if( graph.edgeValues )
+      edgeValues->assign( graph.edgeValues, graph.edgeValues + nEdges );
+    else
+      edgeValues->clear();
+  }
 
+  unmapGraph( graph );
   return 0;
 }
 
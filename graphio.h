@@ -31,6 +31,9 @@ limitations under the License.
 
 #include <string>
 #include <vector>
+#include <stdint.h>
+
+#include "compressedcsr.h"
 
 //Read in a snap format graph
 int loadGraph_GraphLabSnap( const char* fname
@@ -51,6 +54,7 @@ int loadGraph_MatrixMarket( const char* fname
 //If expand is true, converts CSR into list of edges
 //to be compatible with the other loaders, otherwise
 //the argument srcs will contain nVertices + 1 offsets
+//(which requires fewer than 2^31 edges)
 int loadGraph_binaryCSR(const char* fname
   , int &nVertices
   , std::vector<int> &srcs
@@ -59,7 +63,70 @@ int loadGraph_binaryCSR(const char* fname
   , bool expand = true);
 
 
+//Read in a binary CSR graph with 64-bit offsets, for any number of edges.
+//Vertex ids stay 32-bit.
+int loadGraph_binaryCSR(const char* fname
+  , int &nVertices
+  , std::vector<int64_t> &offsets
+  , std::vector<int> &dsts
+  , std::vector<int> *edgeValues);
+
+
+//A Lonestar binary CSR graph mapped into memory rather than read.  The
+//arrays point straight into the page cache, so mapping takes the same time
+//for any size, pages are only read when touched, and processes mapping the
+//same file share them.  Unlike the .gr loaders the layout is the file's own:
+//offsets holds the nVertices end offsets, so the out-edges of v are
+//[v ? offsets[v - 1] : 0, offsets[v]) in dsts.
+//The mapping is read only, so callers that want to modify the edge values
+//copy them first.
+struct MappedCSRGraph
+{
+  int64_t         nVertices;
+  int64_t         nEdges;
+  const uint64_t *offsets;
+  const uint32_t *dsts;
+  const int      *edgeValues; //null if the file has no edge values
+  void           *base;
+  size_t          length;
+};
+
+
+//Map a .gr file, exits on error like the other loaders
+int mapGraph_binaryCSR(const char* fname, MappedCSRGraph &graph);
+
+
+//Release a mapping made by mapGraph_binaryCSR
+void unmapGraph(MappedCSRGraph &graph);
+
+
+//Fill offsets (nVertices + 1 entries) with the usual zero based CSR offsets
+//of a mapped graph.  The destination indices can be used in place as ints.
+//The int version requires fewer than 2^31 edges.
+void mappedGraphOffsets(const MappedCSRGraph &graph, int *offsets);
+void mappedGraphOffsets(const MappedCSRGraph &graph, int64_t *offsets);
+
+
+//Read in a compressed binary CSR graph (.cgr, see writeGraph_compressedCSR).
+//edgeValues, if given, is left empty if the file has none and otherwise is
+//in the order of the compressed edges.  The int offsets version requires
+//fewer than 2^31 edges.
+int loadGraph_compressedCSR(const char* fname
+  , CompressedCSR<int> &graph
+  , std::vector<int> *edgeValues);
+
+int loadGraph_compressedCSR(const char* fname
+  , CompressedCSR<int, int64_t> &graph
+  , std::vector<int> *edgeValues);
+
+
 //Detects the filetype from the extension
+//Text formats may be gzip compressed (.gz); decompression overlaps with
+//parsing, and files written by bgzip are decompressed in parallel.
+//Text formats are also cached: the first load writes fname.cache next to
+//the input, later loads read that instead of parsing as long as the input
+//is unchanged (see loadGraph_cached).  Graphs of 2^31 edges or more are
+//loaded without the cache.
 int loadGraph( const char* fname
   , int &nVertices
   , std::vector<int> &srcs
@@ -67,12 +134,129 @@ int loadGraph( const char* fname
   , std::vector<int> *edgeValues = 0);
 
 
+//Receives the edges of a graph from streamGraph a chunk at a time, in file
+//order, so that a graph can be processed without holding its whole edge
+//list.  A chunk holds at most the edges of one parse block of a text file
+//(or 2^20 edges of a .gr file) and is only valid during the call.
+class EdgeSink
+{
+public:
+  virtual ~EdgeSink() {}
+
+  //Called once before any edges.  The hints come from the file's header and
+  //are -1 if there is none: nEdgesHint is the MatrixMarket entry count
+  //(doubled for symmetric files), an upper bound since self loops are
+  //dropped.  hasValues tells whether edges() will get values.
+  virtual void begin( int64_t /*nVerticesHint*/, int64_t /*nEdgesHint*/
+    , bool /*hasValues*/ ) {}
+
+  //n edges, values is null unless hasValues
+  virtual void edges( const int *srcs, const int *dsts, const int *values
+    , size_t n ) = 0;
+};
+
+
+//Stream the edges of a graph file to sink, with the same edges in the same
+//order as loadGraph without its cache.  nVertices is set at the end.
+int streamGraph( const char* fname
+  , EdgeSink &sink
+  , int &nVertices
+  , bool edgeValues = false );
+
+
+//Build the CSR of a graph file directly, streaming it twice: once to count
+//out-degrees and once to place the edges.  Peak memory is the CSR itself
+//instead of an edge list plus the CSR.  The result is that of loadGraph and
+//edgeListToCSR with sortIndices: the edges of a vertex in file order, and
+//edgeValues (if given, and left empty if the file has none) in CSR order.
+//The int offsets version exits if there are 2^31 edges or more.
+int loadGraph_streamCSR( const char* fname
+  , int &nVertices
+  , std::vector<int> &offsets
+  , std::vector<int> &dsts
+  , std::vector<int> *edgeValues = 0 );
+
+int loadGraph_streamCSR( const char* fname
+  , int &nVertices
+  , std::vector<int64_t> &offsets
+  , std::vector<int> &dsts
+  , std::vector<int> *edgeValues = 0 );
+
+
+//A text graph as kept in its loadGraph cache file: CSR and CSC with the
+//edge list position of every edge, so engines need not build them again.
+//The arrays point into a read-only mapping of the cache file (or into
+//storage if there is no cache).
+struct CachedGraph
+{
+  int        nVertices;
+  int        nEdges;
+  const int *csrOffsets; //nVertices + 1
+  const int *csrDsts;
+  const int *csrIndex;   //edge list position of each CSR edge
+  const int *cscOffsets; //nVertices + 1
+  const int *cscSrcs;
+  const int *cscIndex;   //edge list position of each CSC edge
+  const int *edgeValues; //in edge list order, null if not requested
+  void      *base;
+  size_t     length;
+  std::vector<int> storage;
+};
+
+
+//Load a text graph through its cache file fname.cache, parsing the input
+//and writing the cache first if there is no valid one.  A cache is valid
+//if it has the current format version and was made from a file of the same
+//size, modification time and (sampled) content hash, with edge values if
+//they are requested.  Other formats, or any file with the cache turned off
+//(setGraphCacheEnabled), are loaded and converted into storage without a
+//cache file.  Exits on error like the other loaders, and for graphs of
+//2^31 edges or more, which the cache's 32-bit offsets cannot hold.
+int loadGraph_cached( const char* fname
+  , CachedGraph &graph
+  , bool edgeValues = false );
+
+
+//Release a graph from loadGraph_cached
+void unmapGraph(CachedGraph &graph);
+
+
+//Turn the cache of loadGraph and loadGraph_cached on or off (it is on by
+//default).
+//A cache is matched to its input by size, modification time and a hash of
+//the first and last MB only, so an edit that keeps the size, away from both
+//ends, of a file whose time stamp is kept as well (cp -p, rsync -t, touch
+//-r) reuses the stale graph.  Delete the .cache file, or turn the cache
+//off, after such an edit.
+void setGraphCacheEnabled(bool enable);
+
+
 //write out a lonestar format binary csr file
 int writeGraph_binaryCSR(const char* fname
   , int nVertices, int nEdges, const int *offsets, const int* dsts
   , const int *edgeValues);
+
+int writeGraph_binaryCSR(const char* fname
+  , int nVertices, int64_t nEdges, const int64_t *offsets, const int* dsts
+  , const int *edgeValues);
   
-int writeGraph_mtx(const char* fname, int nVertices, int nEdges
+//write out a compressed binary CSR file (.cgr): the offsets as in .gr and
+//the neighbor lists as encoded by compressCSR (compressedcsr.h), usually a
+//fraction of the size of .gr.  edgeValues are in compressed edge order.
+int writeGraph_compressedCSR(const char* fname
+  , const CompressedCSR<int> &graph, const int *edgeValues);
+
+int writeGraph_compressedCSR(const char* fname
+  , const CompressedCSR<int, int64_t> &graph, const int *edgeValues);
+
+//write out and read back a vertex order (see reorder.h), a text file with
+//the new id of vertex v on line v.  loadVertexOrder exits if the file is
+//not a permutation.
+int writeVertexOrder(const char* fname, int nVertices, const int *newId);
+
+int loadVertexOrder(const char* fname, std::vector<int> &newId);
+
+int writeGraph_mtx(const char* fname, int nVertices, int64_t nEdges
   , const int *srcs, const int *dsts, const int* edgeValues);
 
 #endif
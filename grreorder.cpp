@@ -0,0 +1,112 @@
+/******************************************************************************
+Copyright 2013 Royal Caliber LLC. (http://www.royal-caliber.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************************/
+
+//Utility to renumber the vertices of a graph for locality (see reorder.h)
+//and write it out as .gr.  The default ordering is Gorder; -d sorts by
+//decreasing out-degree and -r uses reverse Cuthill-McKee.  If an order file
+//is given, the new id of every input vertex is written to it, so results
+//computed on the output can be mapped back (see loadVertexOrder).
+
+#include "util.cuh"
+#include "graphio.h"
+#include "reorder.h"
+#include <math.h>
+
+//mean log2 distance between consecutive in-neighbors, roughly the bits
+//a gather spends jumping around the vertex data
+static double gapBits(int nVertices, const int64_t *offsets, const int *nbrs)
+{
+  std::vector<int> list;
+  double bits = 0;
+  for( int v = 0; v < nVertices; ++v )
+  {
+    list.assign(nbrs + offsets[v], nbrs + offsets[v + 1]);
+    std::sort(list.begin(), list.end());
+    for( size_t i = 1; i < list.size(); ++i )
+      bits += log(1.0 + list[i] - list[i - 1]) / log(2.0);
+  }
+  return offsets[nVertices] ? bits / offsets[nVertices] : 0;
+}
+
+
+int main(int argc, char **argv)
+{
+  char *inputFilename;
+  char *outputFilename;
+  char *orderFilename = 0;
+  bool degreeSort, rcm;
+
+  if (!parseCmdLineSimple(argc, argv, "-d-rss|s", &degreeSort, &rcm
+    , &inputFilename, &outputFilename, &orderFilename))
+  {
+    printf("Usage: grreorder [-d] [-r] input output.gr [orderfile]\n");
+    exit(1);
+  }
+
+  int nVertices;
+  std::vector<int64_t> offsets;
+  std::vector<int> dsts;
+  std::vector<int> edgeValues;
+  loadGraph_streamCSR(inputFilename, nVertices, offsets, dsts, &edgeValues);
+  int64_t nEdges = (int64_t)dsts.size();
+  printf("Read input file with %d vertices and %ld edges\n", nVertices, (long)nEdges);
+
+  //gather walks in-edges, so that is the side orderings and the metric
+  //look at
+  std::vector<int64_t> inOffsets(nVertices + 1);
+  std::vector<int> srcs(nEdges);
+  transposeCSR(nVertices, nEdges, &offsets[0], nEdges ? &dsts[0] : 0
+    , &inOffsets[0], nEdges ? &srcs[0] : 0, (int64_t *)0);
+  printf("in-neighbor gaps before: %.2f bits\n"
+    , gapBits(nVertices, &inOffsets[0], nEdges ? &srcs[0] : 0));
+
+  std::vector<int> newId(nVertices);
+  if( degreeSort )
+    degreeSortOrder(nVertices, &offsets[0], nVertices ? &newId[0] : 0);
+  else if( rcm )
+    rcmOrder(nVertices, &offsets[0], nEdges ? &dsts[0] : 0
+      , &inOffsets[0], nEdges ? &srcs[0] : 0, nVertices ? &newId[0] : 0);
+  else
+    gorderOrder(nVertices, &offsets[0], nEdges ? &dsts[0] : 0
+      , &inOffsets[0], nEdges ? &srcs[0] : 0, nVertices ? &newId[0] : 0);
+
+  //the renumbered in-edges only for the metric
+  std::vector<int64_t> newOffsets(nVertices + 1);
+  std::vector<int> newNbrs(nEdges);
+  permuteCSR(nVertices, nEdges, &inOffsets[0], nEdges ? &srcs[0] : 0
+    , nVertices ? &newId[0] : 0, &newOffsets[0], nEdges ? &newNbrs[0] : 0
+    , (int64_t *)0);
+  printf("in-neighbor gaps after:  %.2f bits\n"
+    , gapBits(nVertices, &newOffsets[0], nEdges ? &newNbrs[0] : 0));
+  std::vector<int>().swap(srcs);
+  std::vector<int64_t>().swap(inOffsets);
+
+  //values follow their edges
+  std::vector<int64_t> index(nEdges);
+  permuteCSR(nVertices, nEdges, &offsets[0], nEdges ? &dsts[0] : 0
+    , nVertices ? &newId[0] : 0, &newOffsets[0], nEdges ? &newNbrs[0] : 0
+    , nEdges ? &index[0] : 0);
+  std::vector<int> values(edgeValues.size());
+  for( size_t i = 0; i < values.size(); ++i )
+    values[i] = edgeValues[index[i]];
+
+  printf("writing output\n");
+  writeGraph_binaryCSR(outputFilename, nVertices, nEdges
+    , &newOffsets[0], nEdges ? &newNbrs[0] : 0
+    , values.empty() ? 0 : &values[0]);
+  if( orderFilename )
+    writeVertexOrder(orderFilename, nVertices, nVertices ? &newId[0] : 0);
+}
@@ -14,10 +14,12 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ******************************************************************************/
 
-//Utility to convert mtx files to .gr for faster loading.
+//Utility to convert mtx files to .gr for faster loading.  An output name
+//ending in .cgr writes the compressed CSR format instead.
 
 #include "util.cuh"
 #include "graphio.h"
+#include <string.h>
 
 int main(int argc, char **argv)
 {
@@ -30,24 +32,34 @@ int main(int argc, char **argv)
     exit(1);
   }
 
+  //the CSR is built straight from the file, never holding the edge list
   int nVertices;
-  std::vector<int> srcs;
-  std::vector<int> dsts;
+  std::vector<int64_t> offsets;
+  std::vector<int> csrDsts;
   std::vector<int> edgeValues;
-  loadGraph(inputFilename, nVertices, srcs, dsts, &edgeValues);
-  printf("Read input file with %d vertices and %zd edges\n", nVertices, dsts.size());
-
-  printf("Converting to CSR\n");
-  std::vector<int> offsets(nVertices + 1);
-  std::vector<int> csrDsts(dsts.size());
-  std::vector<int> sortIndices(dsts.size());
-  std::vector<int> sortedEdgeValues(dsts.size());
-  edgeListToCSR<int>(nVertices, dsts.size(), &srcs[0], &dsts[0]
-    , &offsets[0], &csrDsts[0], &sortIndices[0]);
-  for (size_t i = 0; i < sortIndices.size(); ++i)
-    sortedEdgeValues[i] = edgeValues[sortIndices[i]];
+  loadGraph_streamCSR(inputFilename, nVertices, offsets, csrDsts, &edgeValues);
+  printf("Read input file with %d vertices and %zd edges\n", nVertices, csrDsts.size());
+
+  size_t nameLen = strlen(outputFilename);
+  if( nameLen > 4 && strcmp(outputFilename + nameLen - 4, ".cgr") == 0 )
+  {
+    //values follow the edges as they move within their neighbor lists
+    CompressedCSR<int, int64_t> graph;
+    std::vector<int64_t> order;
+    compressCSR(nVertices, (int64_t)csrDsts.size(), &offsets[0]
+      , csrDsts.empty() ? 0 : &csrDsts[0], graph, &order);
+    std::vector<int>().swap(csrDsts);
+    std::vector<int> values(edgeValues.size());
+    for( size_t i = 0; i < values.size(); ++i )
+      values[i] = edgeValues[order[i]];
+
+    printf("writing output, neighbors compressed to %zd bytes\n", graph.bytes.size());
+    writeGraph_compressedCSR(outputFilename, graph, values.empty() ? 0 : &values[0]);
+    return 0;
+  }
 
   printf("writing output\n");
-  writeGraph_binaryCSR(outputFilename, nVertices, dsts.size()
-    , &offsets[0], &csrDsts[0], &sortedEdgeValues[0]);
+  writeGraph_binaryCSR(outputFilename, nVertices, (int64_t)csrDsts.size()
+    , &offsets[0], csrDsts.empty() ? 0 : &csrDsts[0]
+    , edgeValues.empty() ? 0 : &edgeValues[0]);
 }
@@ -0,0 +1,170 @@
+/******************************************************************************
+Copyright 2013 Royal Caliber LLC. (http://www.royal-caliber.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************************/
+
+#ifndef NUMA_H__
+#define NUMA_H__
+
+//Minimal NUMA support for the CPU engines, without a libnuma dependency.
+//The node layout is read from sysfs, and memory placement relies on the
+//kernel's first-touch policy: a page lives on the node of the thread that
+//first writes it.  Without sysfs (or on non-Linux hosts) everything is
+//treated as a single node.
+
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+
+
+struct NumaTopology
+{
+  //cpus of every node, restricted to the cpus this process may run on.
+  //Nodes without usable cpus are left out.
+  std::vector< std::vector<int> > nodeCpus;
+
+  NumaTopology()
+  {
+    detect();
+  }
+
+  int nNodes() const
+  {
+    return (int)nodeCpus.size();
+  }
+
+  //node of thread tid out of nThreads, threads are spread evenly and in
+  //order over the nodes
+  int threadNode(int tid, int nThreads) const
+  {
+    int nodes = nNodes() < nThreads ? nNodes() : nThreads;
+    return (int)((long)tid * nodes / nThreads);
+  }
+
+  //cpu for thread tid, round robin over the cpus of its node
+  int threadCpu(int tid, int nThreads) const
+  {
+    int node  = threadNode(tid, nThreads);
+    int nodes = nNodes() < nThreads ? nNodes() : nThreads;
+    //rank of tid among the threads on its node
+    int first = (int)(((long)node * nThreads + nodes - 1) / nodes);
+    const std::vector<int> &cpus = nodeCpus[node];
+    return cpus[(tid - first) % cpus.size()];
+  }
+
+  //parse a sysfs cpu list like "0-7,16-23"
+  static void parseList(const char *s, std::vector<int> &out)
+  {
+    while( *s )
+    {
+      char *end;
+      long a = strtol(s, &end, 10);
+      if( end == s )
+        break;
+      long b = a;
+      s = end;
+      if( *s == '-' )
+      {
+        b = strtol(s + 1, &end, 10);
+        s = end;
+      }
+      for( long i = a; i <= b; ++i )
+        out.push_back((int)i);
+      while( *s == ',' || *s == '\n' || *s == ' ' )
+        ++s;
+    }
+  }
+
+  void detect()
+  {
+    nodeCpus.clear();
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool haveMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    for( int node = 0; ; ++node )
+    {
+      char path[128];
+      snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+      FILE *f = fopen(path, "r");
+      if( !f )
+        break;
+      char buf[4096];
+      std::vector<int> cpus;
+      if( fgets(buf, sizeof(buf), f) )
+        parseList(buf, cpus);
+      fclose(f);
+
+      std::vector<int> usable;
+      for( size_t i = 0; i < cpus.size(); ++i )
+      {
+        if( !haveMask || CPU_ISSET(cpus[i], &allowed) )
+          usable.push_back(cpus[i]);
+      }
+      if( !usable.empty() )
+        nodeCpus.push_back(usable);
+    }
+
+    if( nodeCpus.empty() )
+    {
+      std::vector<int> cpus;
+      long n = sysconf(_SC_NPROCESSORS_ONLN);
+      for( int i = 0; i < n; ++i )
+      {
+        if( !haveMask || CPU_ISSET(i, &allowed) )
+          cpus.push_back(i);
+      }
+      if( cpus.empty() )
+        cpus.push_back(0);
+      nodeCpus.push_back(cpus);
+    }
+  }
+};
+
+
+//pin the calling thread to one cpu, returns false on failure
+inline bool pinThreadToCpu(int cpu)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+
+//affinity mask of the calling thread, so that it can be put back after
+//pinThreadToCpu
+struct SavedAffinity
+{
+  cpu_set_t set;
+  bool      saved;
+
+  SavedAffinity()
+  {
+    CPU_ZERO(&set);
+    saved = sched_getaffinity(0, sizeof(set), &set) == 0;
+  }
+
+  //restore the mask on the calling thread, returns false on failure
+  bool restore() const
+  {
+    return saved && sched_setaffinity(0, sizeof(set), &set) == 0;
+  }
+};
+
+
+#endif
@@ -17,10 +17,14 @@ limitations under the License.
 
 #include "refgas.h"
 #include "gpugas.h"
+#include "cpugas.h"
 #include "util.cuh"
 #include "graphio.h"
 #include <vector>
 #include <iostream>
+#include <string.h>
+#include <climits>
+#include <unistd.h>
 
 
 //Vertex program for Pagerank
@@ -38,6 +42,10 @@ struct PageRank
 
   struct EdgeData {};
 
+  //the engines leave out scatter and the edge index, see gastraits.h
+  static const bool hasScatter  = false;
+  static const bool hasEdgeData = false;
+
   typedef float GatherResult;
 
   static const float gatherZero = 0.0f;
@@ -56,6 +64,15 @@ struct PageRank
     return left + right;
   }
 
+  //gatherMap is a sum of src->rank / src->numOutEdges, see gastraits.h
+  typedef GASTraits::PlusReduction GatherReduction;
+
+  __host__ __device__
+  static float gatherSource(const VertexData* src)
+  {
+    return src->rank / src->numOutEdges;
+  }
+
   __host__ __device__
   static bool apply(VertexData* vertexData, const float& gatherResult)
   {
@@ -73,6 +90,88 @@ struct PageRank
 };
 
 
+//PageRank by residual push, after GraphLab's delta cache.  Every edge keeps
+//the contribution of its source as of the last push, so gather just sums
+//edge values, with no division and no reads of the source's vertex data.
+//apply accumulates the change of its rank divided by the out-degree in
+//pending, and once the accumulated change reaches tol the vertex pushes it
+//to its out-edges in scatter and activates its out-neighbors.  A vertex is
+//gathered again only if one of its in-neighbors pushed, so late iterations
+//touch only the vertices still converging.  Changes below tol stay pending
+//rather than being dropped.
+//
+//Ranks start at 0 and edge contributions at 0, the first apply sets every
+//rank to pageConst.  scatter writes edge data, so this needs an engine
+//that runs scatter (reference or CPU, not fused).  postDelta hands the same
+//change to the engine's gather cache, so a vertex whose sum of in-edges is
+//cached is not gathered at all.
+struct PageRankDelta
+{
+  static const float pageConst = 0.15f;
+  static const float tol = 0.01f;
+
+  struct VertexData
+  {
+    float rank;
+    float pending;     //rank change per out-edge not pushed yet
+    int   numOutEdges;
+    bool  pushed;      //pending went out with the last scatter
+  };
+
+  struct EdgeData
+  {
+    float contribution; //source rank / out-degree as of its last push
+  };
+
+  typedef float GatherResult;
+
+  static const float gatherZero = 0.0f;
+
+  __host__ __device__
+  static float gatherMap(const VertexData* dst, const VertexData* src, const EdgeData* edge)
+  {
+    return edge->contribution;
+  }
+
+  __host__ __device__
+  static float gatherReduce(const float& left, const float& right)
+  {
+    return left + right;
+  }
+
+  __host__ __device__
+  static bool apply(VertexData* vertexData, const float& gatherResult)
+  {
+    float newRank = pageConst + (1.0f - pageConst) * gatherResult;
+    float change = newRank - vertexData->rank;
+    vertexData->rank = newRank;
+    if( vertexData->pushed )
+      vertexData->pending = 0.0f;
+    if( vertexData->numOutEdges == 0 )
+    {
+      vertexData->pushed = false;
+      return false;
+    }
+    vertexData->pending += change / vertexData->numOutEdges;
+    vertexData->pushed = fabs(vertexData->pending) * vertexData->numOutEdges >= tol;
+    return vertexData->pushed;
+  }
+
+  __host__ __device__
+  static void scatter(const VertexData* src, const VertexData *dst, EdgeData* edge)
+  {
+    edge->contribution += src->pending;
+  }
+
+  static bool postDelta(const VertexData* src, const VertexData *dst
+    , const EdgeData* edge, float* delta)
+  {
+    *delta = src->pending;
+    return true;
+  }
+};
+
+
 void outputRanks(int n, const PageRank::VertexData* vertexData, FILE* f = stdout)
 {
   for( int i = 0; i < n; ++i )
@@ -82,15 +181,120 @@ void outputRanks(int n, const PageRank::VertexData* vertexData, FILE* f = stdout
 }
 
 
+//PageRank has no scatter, so it can use the fused pass of the CPU engine
+template<typename Engine>
+void setFused(Engine &engine)
+{
+}
+
+void setFused(GASEngineCPU<PageRank> &engine)
+{
+  engine.setFused(true);
+}
+
+
+//NUMA placement is CPU engine only.  PageRank is bandwidth bound, so report
+//how many gather reads stayed on their node.
+template<typename Engine>
+void setNuma(Engine &engine, bool enable)
+{
+}
+
+template<typename Program>
+void setNuma(GASEngineCPU<Program> &engine, bool enable)
+{
+  engine.setNuma(enable, true);
+}
+
+//The CPU engine can gather a cache sized segment of sources at a time
+template<typename Engine>
+void setGatherBlocking(Engine &engine, size_t cacheBytes)
+{
+}
+
+template<typename Program>
+void setGatherBlocking(GASEngineCPU<Program> &engine, size_t cacheBytes)
+{
+  engine.setGatherBlocking(cacheBytes);
+}
+
+
+//half the last level cache for the vertex data of a gather segment
+size_t gatherBlockBytes()
+{
+  long cacheBytes = 0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+  cacheBytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if( cacheBytes <= 0 )
+    cacheBytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+  if( cacheBytes <= 0 )
+    cacheBytes = 8 << 20;
+  return cacheBytes / 2;
+}
+
+
+//The CPU engine can gather from compressed in-edges
+template<typename Engine>
+void setCompressed(Engine &engine, bool enable)
+{
+}
+
+template<typename Program>
+void setCompressed(GASEngineCPU<Program> &engine, bool enable)
+{
+  engine.setCompressed(enable);
+}
+
+template<typename Engine>
+void reportCompressed(Engine &engine)
+{
+}
+
+template<typename Program>
+void reportCompressed(GASEngineCPU<Program> &engine)
+{
+  if( engine.compressedBytes() )
+    printf("in-edges compressed to %ld bytes\n", (long)engine.compressedBytes());
+}
+
+
+template<typename Engine>
+void reportNuma(Engine &engine)
+{
+}
+
+template<typename Program>
+void reportNuma(GASEngineCPU<Program> &engine)
+{
+  int64_t local, remote;
+  engine.numaReads(local, remote);
+  if( local + remote )
+    printf("%d NUMA nodes, %ld local and %ld remote gather reads (%.1f%% remote)\n"
+      , engine.numaNodes(), (long)local, (long)remote
+      , 100.0 * remote / (local + remote));
+}
+
+
+//srcs holds the nVertices + 1 CSR offsets rather than an edge list if csr
+//is set
 template<typename Engine>
 void run(int nVertices, PageRank::VertexData* vertexData, int nEdges
-  , const int* srcs, const int* dsts)
+  , const int* srcs, const int* dsts, bool csr, bool numa = false
+  , bool compressed = false, size_t blockBytes = 0)
 {
   for( int i = 0; i < nVertices; ++i )
     vertexData[i].rank = PageRank::pageConst;
 
   Engine engine;
-  engine.setGraph(nVertices, vertexData, nEdges, 0, srcs, dsts);
+  setNuma(engine, numa);
+  setCompressed(engine, compressed);
+  setGatherBlocking(engine, blockBytes);
+  if( csr )
+    engine.setGraphCSR(nVertices, vertexData, nEdges, 0, srcs, dsts);
+  else
+    engine.setGraph(nVertices, vertexData, nEdges, 0, srcs, dsts);
+  setFused(engine);
   //all vertices begin active for pagerank
   engine.setActive(0, nVertices);
   int64_t t0 = currentTime();
@@ -98,6 +302,49 @@ void run(int nVertices, PageRank::VertexData* vertexData, int nEdges
   engine.getResults();
   int64_t t1 = currentTime();
   printf("Took %f ms\n", (t1 - t0)/1000.0f);
+  reportNuma(engine);
+  reportCompressed(engine);
+}
+
+
+//Same as run with PageRankDelta, the ranks are copied back to vertexData
+template<typename Engine>
+void runDelta(int nVertices, PageRank::VertexData* vertexData, int nEdges
+  , const int* srcs, const int* dsts, bool csr, bool numa = false
+  , bool compressed = false)
+{
+  std::vector<PageRankDelta::VertexData> deltaData(nVertices);
+  for( int i = 0; i < nVertices; ++i )
+  {
+    deltaData[i].rank        = 0.0f;
+    deltaData[i].pending     = 0.0f;
+    deltaData[i].numOutEdges = vertexData[i].numOutEdges;
+    deltaData[i].pushed      = false;
+  }
+  std::vector<PageRankDelta::EdgeData> edgeData(nEdges);
+  for( int i = 0; i < nEdges; ++i )
+    edgeData[i].contribution = 0.0f;
+
+  Engine engine;
+  setNuma(engine, numa);
+  setCompressed(engine, compressed);
+  engine.setGatherCache(true);
+  PageRankDelta::EdgeData *edges = nEdges ? &edgeData[0] : 0;
+  if( csr )
+    engine.setGraphCSR(nVertices, &deltaData[0], nEdges, edges, srcs, dsts);
+  else
+    engine.setGraph(nVertices, &deltaData[0], nEdges, edges, srcs, dsts);
+  engine.setActive(0, nVertices);
+  int64_t t0 = currentTime();
+  engine.run();
+  engine.getResults();
+  int64_t t1 = currentTime();
+  printf("Took %f ms\n", (t1 - t0)/1000.0f);
+  reportNuma(engine);
+  reportCompressed(engine);
+
+  for( int i = 0; i < nVertices; ++i )
+    vertexData[i].rank = deltaData[i].rank;
 }
 
 
@@ -107,25 +354,99 @@ int main(int argc, char **argv)
   char* outputFilename = 0;
   bool runTest;
   bool dumpResults;
-  if( !parseCmdLineSimple(argc, argv, "s-t-d|s"
-    , &inputFilename, &runTest, &dumpResults, &outputFilename) )
+  bool useCPU;
+  bool useNuma;
+  bool useCompressed;
+  bool useDelta;
+  bool useBlocking;
+  if( !parseCmdLineSimple(argc, argv, "s-t-d-c-n-z-r-b|s"
+    , &inputFilename, &runTest, &dumpResults, &useCPU, &useNuma
+    , &useCompressed, &useDelta, &useBlocking, &outputFilename) )
   {
-    printf("Usage: pagerank [-t] [-d] inputfile [outputfile]\n");
+    printf("Usage: pagerank [-t] [-d] [-c] [-n] [-z] [-r] [-b] inputfile [outputfile]\n");
     exit(1);
   }
 
-  //load the graph
+  //-c runs the multithreaded CPU engine in place of the GPU one, -n runs it
+  //with NUMA placement and -z with compressed in-edges.  -r runs
+  //PageRankDelta, also for the reference; the GPU engine does not scatter.
+  //-b runs the CPU engine with the cache blocked gather.
+  useCPU = useCPU || useNuma || useCompressed || useDelta || useBlocking;
+  size_t blockBytes = useBlocking ? gatherBlockBytes() : 0;
+  if( blockBytes )
+    printf("gather blocked in segments of %ld bytes of vertex data\n", (long)blockBytes);
+
+  //.gr and .cgr files are CSR already and text files come as CSR from their
+  //cache (see loadGraph_cached), so all go to the engines as such, without
+  //the round trip through an edge list.  .gr files are mapped rather than
+  //read: only the offsets are converted, the destinations are used from
+  //the mapping.  NUMA placement needs setGraph.
+  size_t nameLen = strlen(inputFilename);
+  bool gr = nameLen > 3 && strcmp(inputFilename + nameLen - 3, ".gr") == 0;
+  bool cgr = nameLen > 4 && strcmp(inputFilename + nameLen - 4, ".cgr") == 0;
+  bool csr = !useNuma;
+
+  //load the graph, srcs/dsts point to either the edge list or the CSR
   int nVertices;
-  std::vector<int> srcs;
-  std::vector<int> dsts;
-  loadGraph(inputFilename, nVertices, srcs, dsts);
-  printf("loaded %s with %d vertices and %zd edges\n", inputFilename, nVertices, srcs.size());
+  int nEdges;
+  std::vector<int> srcList;
+  std::vector<int> dstList;
+  CachedGraph cached;
+  MappedCSRGraph mapped;
+  const int* srcs;
+  const int* dsts;
+  if( csr && cgr )
+  {
+    CompressedCSR<int> graph;
+    loadGraph_compressedCSR(inputFilename, graph, 0);
+    nVertices = graph.nVertices;
+    nEdges = graph.nEdges;
+    dstList.resize(nEdges);
+    if( nEdges )
+      decompressCSR(graph, &dstList[0]);
+    srcList.swap(graph.offsets);
+    srcs = &srcList[0];
+    dsts = nEdges ? &dstList[0] : 0;
+  }
+  else if( csr && gr )
+  {
+    mapGraph_binaryCSR(inputFilename, mapped);
+    if( mapped.nVertices >= INT_MAX )
+    {
+      printf("%s has too many vertices\n", inputFilename);
+      exit(1);
+    }
+    nVertices = (int)mapped.nVertices;
+    nEdges = checkedEdgeCount(mapped.nEdges);
+    srcList.resize(nVertices + 1);
+    mappedGraphOffsets(mapped, &srcList[0]);
+    srcs = &srcList[0];
+    dsts = (const int *)mapped.dsts;
+  }
+  else if( csr )
+  {
+    loadGraph_cached(inputFilename, cached);
+    nVertices = cached.nVertices;
+    nEdges = cached.nEdges;
+    srcs = cached.csrOffsets;
+    dsts = cached.csrDsts;
+  }
+  else
+  {
+    loadGraph(inputFilename, nVertices, srcList, dstList);
+    nEdges = checkedEdgeCount(dstList.size());
+    srcs = &srcList[0];
+    dsts = nEdges ? &dstList[0] : 0;
+  }
+  printf("loaded %s with %d vertices and %d edges\n", inputFilename, nVertices, nEdges);
 
   //initialize vertex data
   //convert to CSR to get the count of edges.
   std::vector<int> srcOffsets(nVertices + 1);
-  std::vector<int> csrSrcs(srcs.size());
-  edgeListToCSR<int>(nVertices, srcs.size(), &srcs[0], &dsts[0], &srcOffsets[0], 0, 0);
+  if( csr )
+    srcOffsets.assign(srcs, srcs + nVertices + 1);
+  else
+    edgeListToCSR<int>(nVertices, nEdges, srcs, dsts, &srcOffsets[0], 0, 0);
 
   std::vector<PageRank::VertexData> vertexData(nVertices);
   for( int i = 0; i < nVertices; ++i )
@@ -136,7 +457,10 @@ int main(int argc, char **argv)
   {
     printf("Running reference calculation\n");
     refVertexData = vertexData;
-    run< GASEngineRef<PageRank> >(nVertices, &refVertexData[0], (int)srcs.size(), &srcs[0], &dsts[0]);
+    if( useDelta )
+      runDelta< GASEngineRef<PageRankDelta> >(nVertices, &refVertexData[0], nEdges, srcs, dsts, csr);
+    else
+      run< GASEngineRef<PageRank> >(nVertices, &refVertexData[0], nEdges, srcs, dsts, csr);
     if( dumpResults )
     {
       printf("Reference\n");
@@ -144,16 +468,26 @@ int main(int argc, char **argv)
     }
   }
 
-  run< GASEngineGPU<PageRank> >(nVertices, &vertexData[0], (int)srcs.size(), &srcs[0], &dsts[0]);
+  if( useDelta )
+    runDelta< GASEngineCPU<PageRankDelta> >(nVertices, &vertexData[0], nEdges, srcs, dsts, csr
+      , useNuma, useCompressed);
+  else if( useCPU )
+    run< GASEngineCPU<PageRank> >(nVertices, &vertexData[0], nEdges, srcs, dsts, csr, useNuma
+      , useCompressed, blockBytes);
+  else
+    run< GASEngineGPU<PageRank> >(nVertices, &vertexData[0], nEdges, srcs, dsts, csr);
   if( dumpResults )
   {
-    printf("GPU:\n");
+    printf(useCPU ? "CPU:\n" : "GPU:\n");
     outputRanks(nVertices, &vertexData[0]);
   }
 
   if( runTest )
   {
-    const float tol = 1.0e-6f;
+    //-r pushes a change once it adds up to PageRankDelta::tol, so runs that
+    //sum in another order (threads, gather cache) can push at other times
+    //and differ by up to about that much
+    const float tol = useDelta ? PageRankDelta::tol : 1.0e-6f;
     bool diff = false;
     for( int i = 0; i < nVertices; ++i )
     {
@@ -177,6 +511,10 @@ int main(int argc, char **argv)
     fclose(f);
   }
 
+  if( csr && gr )
+    unmapGraph(mapped);
+  else if( csr && !cgr )
+    unmapGraph(cached);
   free(inputFilename);
   free(outputFilename);
 
@@ -21,34 +21,80 @@ limitations under the License.
 #include <stdio.h>
 
 #include "util.cuh"
+#include "gastraits.h"
+#include "frontier.h"
+#include "reorder.h"
+#include "gathersimd.h"
 
 //Reference implementation, useful for correctness checking
 //and prototyping interfaces.
 //This is not an optimized CPU implementation.
+//
+//Int is the vertex type and EdgeInt the type of edge offsets and indices,
+//e.g. GASEngineRef<Program, int32_t, int64_t> for graphs of more than 2^31
+//edges (see csr.h).
+//
+//setVertexOrder renumbers the vertices inside the engine (see reorder.h)
+//without the caller noticing: vertex ids given to setGraph and setActive
+//and the vertex data returned by getResults are in the caller's numbering.
+//
+//setGatherBlocking splits the source vertices into segments whose vertex
+//data fits in a cache, and keeps a CSC slice per segment.  Gather then
+//makes one pass per segment over the active vertices with in-edges from
+//it, so source reads stay in cache even when the vertex data is many times
+//larger, and partial results are merged with gatherReduce.  The order of
+//reduction changes, floating point sums may differ in the last bits.
+//
+//setGatherCache keeps the gather result of every vertex for programs with
+//Program::postDelta (gastraits.h): scatter posts deltas to the cached
+//results of out-neighbors, and a vertex with a cached result skips its
+//gather.  The cache is dropped by setGraph* and setActive.  A floating
+//point result kept up by deltas collects their rounding errors, so it
+//drifts slightly from what a full gather would give.
+//
+//With setVectorGather(true), programs that declare a GatherReduction
+//(gastraits.h) are gathered from dense arrays of gatherSource per vertex
+//and gatherEdge per edge with the kernels of gathersimd.h.  The arrays are
+//built at the first gather after setGraph* or setActive and kept up to
+//date by apply and scatter, so vertex and edge data changed by the caller
+//in between iterations is only seen after the next setActive.  It is off
+//by default, so that the reference engine checks the others with the plain
+//gatherMap / gatherReduce loop.
+//
+//Phases a Program declares it doesn't have (hasGather, hasScatter in
+//gastraits.h) are skipped whatever gather() and scatterActivate() are
+//told, and without hasEdgeData no edge index is kept.
 
 
 template<typename Program
-  , typename Int = int32_t>
+  , typename Int = int32_t
+  , typename EdgeInt = Int>
 class GASEngineRef
 {
   typedef typename Program::VertexData   VertexData;
   typedef typename Program::EdgeData     EdgeData;
   typedef typename Program::GatherResult GatherResult;
+  typedef GASTraits::ActivateFilter<Program> ActivateFilter;
+  typedef GASTraits::DeltaCache<Program>     DeltaCache;
+  typedef GASTraits::VectorGather<Program>   VectorGather;
+  typedef GASTraits::GatherEdge<Program>     GatherEdge;
+  typedef GASTraits::Phases<Program>         Phases;
 
   Int         m_nVertices;
-  Int         m_nEdges;
+  EdgeInt     m_nEdges;
   VertexData *m_vertexData;
   EdgeData   *m_edgeData;
 
-  //CSC representation for gather phase
-  std::vector<Int> m_srcs;
-  std::vector<Int> m_srcOffsets;
-  std::vector<Int> m_edgeIndexCSC;
+  //CSC representation for gather phase; the edge indexes are empty for
+  //programs without edge data
+  std::vector<Int>     m_srcs;
+  std::vector<EdgeInt> m_srcOffsets;
+  std::vector<EdgeInt> m_edgeIndexCSC;
 
   //CSR representation for reduce phase
-  std::vector<Int> m_dsts;
-  std::vector<Int> m_dstOffsets;
-  std::vector<Int> m_edgeIndexCSR;
+  std::vector<Int>     m_dsts;
+  std::vector<EdgeInt> m_dstOffsets;
+  std::vector<EdgeInt> m_edgeIndexCSR;
 
   //doing similar to the GPU for ease of comparison
   std::vector<GatherResult> m_gatherResults;
@@ -56,10 +102,307 @@ class GASEngineRef
   std::vector<Int>  m_applyRet;
   std::vector<bool> m_activeFlags;
 
+  //direction optimizing traversal
+  bool               m_directionOptimizing;
+  DirectionHeuristic m_direction;
+
+  //cache blocked gather, sources split in segments of m_blockVertices;
+  //segment s has the runs m_blockSegments[s] .. m_blockSegments[s+1] - 1,
+  //run r the in-edges of m_blockDsts[r] from that segment, edges
+  //m_blockOffsets[r] .. m_blockOffsets[r+1] - 1
+  Int                  m_blockVertices; //0 if off
+  std::vector<EdgeInt> m_blockSegments;
+  std::vector<Int>     m_blockDsts;
+  std::vector<EdgeInt> m_blockOffsets;
+  std::vector<Int>     m_blockSrcs;
+  std::vector<EdgeInt> m_blockEdgeIndex;
+  std::vector<Int>     m_activeSlot; //position in m_active, or -1
+
+  //gather cache, see setGatherCache
+  bool                      m_gatherCache;
+  std::vector<GatherResult> m_cachedResults;
+  std::vector<bool>         m_cacheValid;
+
+  //vectorized gather, gatherSource of every vertex and gatherEdge of
+  //every edge in CSC order; m_cscPosition[e] is the CSC position of the
+  //caller's edge e, for updates from scatter
+  std::vector<GatherResult> m_gatherSource;
+  std::vector<GatherResult> m_gatherEdge;
+  std::vector<EdgeInt>      m_cscPosition;
+  bool                      m_vectorGather;
+  bool                      m_gatherTermsValid;
+
+  //vertex order, caller's vertex v is m_newId[v] in the engine
+  std::vector<Int>        m_newId;
+  std::vector<VertexData> m_orderedVertexData;
+  VertexData             *m_unorderedVertexData; //caller's array, if renumbered
+
+
+  void allocTemporaries()
+  {
+    m_active.clear();
+    m_active.reserve(m_nVertices);
+    m_applyRet.resize(m_nVertices);
+    m_activeFlags.assign(m_nVertices, false);
+    m_gatherResults.resize(m_nVertices);
+    m_blockSegments.clear(); //slices of the previous graph
+    m_cacheValid.assign(m_nVertices, false);
+    m_gatherTermsValid = false;
+  }
+
+
+  //Build one representation from the other by transposition if the graph
+  //was given in the other format.  The new edge index maps through the
+  //existing one, so both refer to the caller's edge data order.
+  static void transpose(Int nVertices, EdgeInt nEdges
+    , const std::vector<EdgeInt> &offsets, const std::vector<Int> &verts
+    , const std::vector<EdgeInt> &edgeIndex
+    , std::vector<EdgeInt> &outOffsets, std::vector<Int> &outVerts
+    , std::vector<EdgeInt> &outEdgeIndex)
+  {
+    outOffsets.resize(nVertices + 1);
+    outVerts.resize(nEdges);
+    outEdgeIndex.resize(edgeIndex.size());
+    transposeCSR(nVertices, nEdges, &offsets[0], nEdges ? &verts[0] : 0
+      , &outOffsets[0], nEdges ? &outVerts[0] : 0
+      , outEdgeIndex.empty() ? 0 : &outEdgeIndex[0]);
+    for( EdgeInt i = 0; i < (EdgeInt)outEdgeIndex.size(); ++i )
+      outEdgeIndex[i] = edgeIndex[outEdgeIndex[i]];
+  }
+
+
+  //an edge index of nEdges entries, or none without edge data
+  EdgeInt* allocEdgeIndex(std::vector<EdgeInt> &edgeIndex)
+  {
+    edgeIndex.resize(Phases::hasEdgeData ? m_nEdges : 0);
+    return edgeIndex.empty() ? 0 : &edgeIndex[0];
+  }
+
+
+  //edge data of the edges at CSC and CSR position ie
+  EdgeData* edgeCSC(EdgeInt ie)
+  {
+    return Phases::hasEdgeData ? m_edgeData + m_edgeIndexCSC[ie] : m_edgeData;
+  }
+
+  EdgeData* edgeCSR(EdgeInt ie)
+  {
+    return Phases::hasEdgeData ? m_edgeData + m_edgeIndexCSR[ie] : m_edgeData;
+  }
+
+
+  void needCSC()
+  {
+    if( m_srcOffsets.empty() )
+      transpose(m_nVertices, m_nEdges, m_dstOffsets, m_dsts, m_edgeIndexCSR
+        , m_srcOffsets, m_srcs, m_edgeIndexCSC);
+  }
+
+
+  void needCSR()
+  {
+    if( m_dstOffsets.empty() )
+      transpose(m_nVertices, m_nEdges, m_srcOffsets, m_srcs, m_edgeIndexCSC
+        , m_dstOffsets, m_dsts, m_edgeIndexCSR);
+  }
+
+
+  //Split the CSC by source segment, see m_blockSegments.  Edges are
+  //counting sorted by segment, which keeps them in destination order within
+  //a segment, and runs are cut where the destination changes.
+  void needBlockedCSC()
+  {
+    if( !m_blockSegments.empty() )
+      return;
+    needCSC();
+    Int nSegments = (m_nVertices + m_blockVertices - 1) / m_blockVertices;
+    std::vector<EdgeInt> segmentStart(nSegments + 1, 0);
+    for( EdgeInt ie = 0; ie < m_nEdges; ++ie )
+      ++segmentStart[m_srcs[ie] / m_blockVertices + 1];
+    for( Int s = 0; s < nSegments; ++s )
+      segmentStart[s + 1] += segmentStart[s];
+
+    std::vector<Int> edgeDsts(m_nEdges);
+    std::vector<EdgeInt> next(segmentStart.begin(), segmentStart.end() - 1);
+    m_blockSrcs.resize(m_nEdges);
+    m_blockEdgeIndex.resize(m_edgeIndexCSC.size());
+    for( Int dv = 0; dv < m_nVertices; ++dv )
+    {
+      for( EdgeInt ie = m_srcOffsets[dv]; ie < m_srcOffsets[dv + 1]; ++ie )
+      {
+        EdgeInt pos = next[m_srcs[ie] / m_blockVertices]++;
+        edgeDsts[pos]         = dv;
+        m_blockSrcs[pos]      = m_srcs[ie];
+        if( Phases::hasEdgeData )
+          m_blockEdgeIndex[pos] = m_edgeIndexCSC[ie];
+      }
+    }
+
+    m_blockSegments.assign(1, 0);
+    m_blockDsts.clear();
+    m_blockOffsets.clear();
+    for( Int s = 0; s < nSegments; ++s )
+    {
+      for( EdgeInt ie = segmentStart[s]; ie < segmentStart[s + 1]; ++ie )
+      {
+        if( ie == segmentStart[s] || edgeDsts[ie] != edgeDsts[ie - 1] )
+        {
+          m_blockDsts.push_back(edgeDsts[ie]);
+          m_blockOffsets.push_back(ie);
+        }
+      }
+      m_blockSegments.push_back(m_blockDsts.size());
+    }
+    m_blockOffsets.push_back(m_nEdges);
+  }
+
+
+  //gather only the active vertices without a cached result, see
+  //setGatherCache
+  void cachedGather()
+  {
+    needCSC();
+    m_cachedResults.resize(m_nVertices);
+    for( Int i = 0; i < m_active.size(); ++i )
+    {
+      Int dv = m_active[i];
+      if( !m_cacheValid[dv] )
+      {
+        GatherResult sum = Program::gatherZero;
+        for( EdgeInt ie = m_srcOffsets[dv]; ie < m_srcOffsets[dv + 1]; ++ie )
+        {
+          GatherResult tmp = Program::gatherMap(m_vertexData + dv
+            , m_vertexData + m_srcs[ie], edgeCSC(ie));
+          sum = Program::gatherReduce(sum, tmp);
+        }
+        m_cachedResults[dv] = sum;
+        m_cacheValid[dv] = true;
+      }
+      m_gatherResults[i] = m_cachedResults[dv];
+    }
+  }
+
+
+  //gather with the kernels of gathersimd.h, see the notes at the top
+  void vectorGather()
+  {
+    needCSC();
+    if( !m_gatherTermsValid )
+    {
+      m_gatherSource.resize(m_nVertices);
+      for( Int v = 0; v < m_nVertices; ++v )
+        m_gatherSource[v] = VectorGather::gatherSource(m_vertexData + v);
+      if( GatherEdge::enabled )
+      {
+        m_gatherEdge.resize(m_nEdges);
+        m_cscPosition.resize(m_nEdges);
+        for( EdgeInt ie = 0; ie < m_nEdges; ++ie )
+        {
+          m_gatherEdge[ie] = GatherEdge::gatherEdge(edgeCSC(ie));
+          m_cscPosition[edgeCSC(ie) - m_edgeData] = ie;
+        }
+      }
+      m_gatherTermsValid = true;
+    }
+    if( m_nEdges == 0 )
+    {
+      for( Int i = 0; i < m_active.size(); ++i )
+        m_gatherResults[i] = Program::gatherZero;
+      return;
+    }
+
+    const GatherResult *edge = GatherEdge::enabled ? &m_gatherEdge[0] : 0;
+    for( Int i = 0; i < m_active.size(); ++i )
+    {
+      Int dv = m_active[i];
+      m_gatherResults[i] = GatherSIMD::gather<typename VectorGather::Reduction>(
+        Program::gatherZero, &m_gatherSource[0], &m_srcs[0]
+        , edge, m_srcOffsets[dv], m_srcOffsets[dv + 1]);
+    }
+  }
+
+
+  //gather a segment at a time, see setGatherBlocking
+  void blockedGather()
+  {
+    needBlockedCSC();
+    //with every vertex active, vertex v is in slot v
+    bool allActive = m_active.size() == (size_t)m_nVertices;
+    if( !allActive )
+      m_activeSlot.assign(m_nVertices, -1);
+    for( Int i = 0; i < m_active.size(); ++i )
+    {
+      if( !allActive )
+        m_activeSlot[m_active[i]] = i;
+      m_gatherResults[i] = Program::gatherZero;
+    }
+
+    for( size_t s = 0; s + 1 < m_blockSegments.size(); ++s )
+    {
+      for( EdgeInt r = m_blockSegments[s]; r < m_blockSegments[s + 1]; ++r )
+      {
+        Int dv = m_blockDsts[r];
+        Int i  = allActive ? dv : m_activeSlot[dv];
+        if( i < 0 )
+          continue;
+        GatherResult sum = m_gatherResults[i];
+        for( EdgeInt ie = m_blockOffsets[r]; ie < m_blockOffsets[r + 1]; ++ie )
+        {
+          GatherResult tmp = Program::gatherMap(m_vertexData + dv
+            , m_vertexData + m_blockSrcs[ie]
+            , Phases::hasEdgeData ? m_edgeData + m_blockEdgeIndex[ie] : m_edgeData);
+          sum = Program::gatherReduce(sum, tmp);
+        }
+        m_gatherResults[i] = sum;
+      }
+    }
+  }
+
+
+  //With a vertex order set, the engine works on a renumbered copy of the
+  //vertex data.  Returns the vertex data the engine should use.
+  VertexData* orderVertexData(VertexData *vertexData)
+  {
+    m_unorderedVertexData = 0;
+    if( m_newId.empty() )
+      return vertexData;
+    if( (Int)m_newId.size() != m_nVertices )
+    {
+      printf("GASEngineRef: vertex order for %ld vertices, graph has %ld\n"
+        , (long)m_newId.size(), (long)m_nVertices);
+      exit(1);
+    }
+    m_unorderedVertexData = vertexData;
+    m_orderedVertexData.resize(m_nVertices);
+    for( Int v = 0; v < m_nVertices; ++v )
+      m_orderedVertexData[m_newId[v]] = vertexData[v];
+    return &m_orderedVertexData[0];
+  }
+
+
+  //a graph given as CSR or CSC in the engine's numbering, with the edge
+  //index from renumbered positions to the caller's
+  void orderCSR(const EdgeInt *offsets, const Int *verts
+    , std::vector<EdgeInt> &outOffsets, std::vector<Int> &outVerts
+    , std::vector<EdgeInt> &outEdgeIndex)
+  {
+    outOffsets.resize(m_nVertices + 1);
+    outVerts.resize(m_nEdges);
+    permuteCSR(m_nVertices, m_nEdges, offsets, verts, &m_newId[0]
+      , &outOffsets[0], m_nEdges ? &outVerts[0] : 0
+      , allocEdgeIndex(outEdgeIndex));
+  }
+
   public:
     GASEngineRef()
       : m_nVertices(0)
       , m_nEdges(0)
+      , m_directionOptimizing(false)
+      , m_blockVertices(0)
+      , m_gatherCache(false)
+      , m_vectorGather(false)
+      , m_gatherTermsValid(false)
+      , m_unorderedVertexData(0)
     {}
 
 
@@ -72,44 +415,121 @@ class GASEngineRef
     //may map directly into host memory
     //The Graph is provided here as an edge list.  We internally convert
     //to CSR/CSC representation.  This separates the implementation details
-    //from the vertex program.  Can easily add interfaces for graphs that
-    //are already in CSR or CSC format.
+    //from the vertex program.  Graphs that are already in CSR or CSC format
+    //can be given to setGraphCSR or setGraphCSC instead.
     //
     //This function is not optimized and at the moment, this initialization
     //is considered outside the scope of the core work on GAS.
     //We will have to revisit this assumption at some point.
     void setGraph(Int nVertices
       , VertexData* vertexData
-      , Int nEdges
+      , EdgeInt nEdges
       , EdgeData* edgeData
       , const Int *edgeListSrcs
       , const Int *edgeListDsts)
     {
       m_nVertices  = nVertices;
       m_nEdges     = nEdges;
-      m_vertexData = vertexData;
+      m_vertexData = orderVertexData(vertexData);
       m_edgeData   = edgeData;
 
-      //get CSR representation for activate/scatter
+      //the edge list in the engine's numbering
+      std::vector<Int> orderedSrcs, orderedDsts;
+      if( m_unorderedVertexData )
+      {
+        orderedSrcs.resize(m_nEdges);
+        orderedDsts.resize(m_nEdges);
+        for( EdgeInt i = 0; i < m_nEdges; ++i )
+        {
+          orderedSrcs[i] = m_newId[edgeListSrcs[i]];
+          orderedDsts[i] = m_newId[edgeListDsts[i]];
+        }
+        edgeListSrcs = &orderedSrcs[0];
+        edgeListDsts = &orderedDsts[0];
+      }
+
+      //get CSR representation for activate/scatter and CSC representation
+      //for gather/apply, in one pass over the edge list
       m_dstOffsets.resize(m_nVertices + 1);
       m_dsts.resize(m_nEdges);
-      m_edgeIndexCSR.resize(m_nEdges);
-      edgeListToCSR(m_nVertices, m_nEdges
-        , edgeListSrcs, edgeListDsts
-        , &m_dstOffsets[0], &m_dsts[0], &m_edgeIndexCSR[0]);
-
-      //get CSC representation for gather/apply
       m_srcOffsets.resize(m_nVertices + 1);
       m_srcs.resize(m_nEdges);
-      m_edgeIndexCSC.resize(m_nEdges);
-      edgeListToCSC(m_nVertices, m_nEdges
+      EdgeInt *edgeIndexCSR = allocEdgeIndex(m_edgeIndexCSR);
+      EdgeInt *edgeIndexCSC = allocEdgeIndex(m_edgeIndexCSC);
+      edgeListToCSRAndCSC(m_nVertices, m_nEdges
         , edgeListSrcs, edgeListDsts
-        , &m_srcOffsets[0], &m_srcs[0], &m_edgeIndexCSC[0]);
+        , &m_dstOffsets[0], &m_dsts[0], edgeIndexCSR
+        , &m_srcOffsets[0], &m_srcs[0], edgeIndexCSC);
 
-      m_active.reserve(m_nVertices);
-      m_applyRet.resize(m_nVertices);
-      m_activeFlags.resize(m_nVertices, false);
-      m_gatherResults.resize(m_nVertices);
+      allocTemporaries();
+    }
+
+
+    //Like setGraph, for a graph given as CSR: offsets has nVertices + 1
+    //entries and the out-edges of v are dsts[offsets[v]] ..
+    //dsts[offsets[v + 1] - 1].  edgeData is in the same order as dsts.
+    //The CSC representation is only built if it is needed.
+    void setGraphCSR(Int nVertices
+      , VertexData* vertexData
+      , EdgeInt nEdges
+      , EdgeData* edgeData
+      , const EdgeInt *offsets
+      , const Int *dsts)
+    {
+      m_nVertices  = nVertices;
+      m_nEdges     = nEdges;
+      m_vertexData = orderVertexData(vertexData);
+      m_edgeData   = edgeData;
+
+      if( m_unorderedVertexData )
+        orderCSR(offsets, dsts, m_dstOffsets, m_dsts, m_edgeIndexCSR);
+      else
+      {
+        m_dstOffsets.assign(offsets, offsets + m_nVertices + 1);
+        m_dsts.assign(dsts, dsts + m_nEdges);
+        allocEdgeIndex(m_edgeIndexCSR);
+        for( EdgeInt i = 0; i < (EdgeInt)m_edgeIndexCSR.size(); ++i )
+          m_edgeIndexCSR[i] = i;
+      }
+      m_srcOffsets.clear();
+      m_srcs.clear();
+      m_edgeIndexCSC.clear();
+
+      allocTemporaries();
+    }
+
+
+    //Like setGraphCSR, for a graph given as CSC: the in-edges of v are
+    //srcs[offsets[v]] .. srcs[offsets[v + 1] - 1] and edgeData is in the
+    //same order as srcs.  The CSR representation is only built if it is
+    //needed.
+    void setGraphCSC(Int nVertices
+      , VertexData* vertexData
+      , EdgeInt nEdges
+      , EdgeData* edgeData
+      , const EdgeInt *offsets
+      , const Int *srcs)
+    {
+      m_nVertices  = nVertices;
+      m_nEdges     = nEdges;
+      m_vertexData = orderVertexData(vertexData);
+      m_edgeData   = edgeData;
+
+      if( m_unorderedVertexData )
+        orderCSR(offsets, srcs, m_srcOffsets, m_srcs, m_edgeIndexCSC);
+      else
+      {
+        m_srcOffsets.assign(offsets, offsets + m_nVertices + 1);
+        m_srcs.assign(srcs, srcs + m_nEdges);
+        allocEdgeIndex(m_edgeIndexCSC);
+        for( EdgeInt i = 0; i < (EdgeInt)m_edgeIndexCSC.size(); ++i )
+          m_edgeIndexCSC[i] = i;
+      }
+      m_dstOffsets.clear();
+      m_dsts.clear();
+      m_edgeIndexCSR.clear();
+
+      allocTemporaries();
     }
 
 
@@ -119,7 +539,36 @@ class GASEngineRef
     //data is consistent with the engine's internal data
     void getResults()
     {
-      //do nothing.
+      //nothing to do unless the vertices were renumbered
+      if( !m_unorderedVertexData )
+        return;
+      for( Int v = 0; v < m_nVertices; ++v )
+        m_unorderedVertexData[v] = m_orderedVertexData[m_newId[v]];
+    }
+
+
+    //Renumber the vertices inside the engine, caller's vertex v becomes
+    //newId[v] (see reorder.h and loadVertexOrder in graphio.h), to improve
+    //the locality of gathers.  Takes effect at the next setGraph*; the
+    //engine then works on a copy of the vertex data, which getResults
+    //copies back.  A null newId turns renumbering off.
+    void setVertexOrder(Int nVertices, const Int *newId)
+    {
+      if( newId )
+        m_newId.assign(newId, newId + nVertices);
+      else
+        m_newId.clear();
+    }
+
+
+    //When enabled, scatterActivate(false) picks top-down (push over CSR) or
+    //bottom-up (pull over CSC) activation every iteration, see
+    //DirectionHeuristic.  Activation with a scatter is always top-down.
+    void setDirectionOptimizing(bool enable, int alpha = 15, int beta = 18)
+    {
+      m_directionOptimizing = enable;
+      m_direction.alpha = alpha;
+      m_direction.beta  = beta;
     }
 
 
@@ -127,7 +576,18 @@ class GASEngineRef
     //affects only the next gather step
     void setActive(Int vertexStart, Int vertexEnd)
     {
+      m_direction.reset(m_nEdges);
+      m_cacheValid.assign(m_nVertices, false);
+      m_gatherTermsValid = false;
       m_active.clear();
+      if( m_unorderedVertexData && (vertexStart > 0 || vertexEnd < m_nVertices) )
+      {
+        //the range is in the caller's numbering
+        for( Int i = vertexStart; i < vertexEnd; ++i )
+          m_active.push_back(m_newId[i]);
+        std::sort(m_active.begin(), m_active.end());
+        return;
+      }
       for( Int i = vertexStart; i < vertexEnd; ++i )
         m_active.push_back(i);
     }
@@ -140,19 +600,70 @@ class GASEngineRef
     }
 
 
+    //Cache blocked gather, see the notes at the top.  cacheBytes is the
+    //vertex data per source segment, e.g. half the last level cache; 0
+    //turns blocking off.  Used when at least a quarter of the vertices are
+    //active, as in PageRank: every pass visits all runs of its segment.
+    void setGatherBlocking(size_t cacheBytes)
+    {
+      m_blockVertices = cacheBytes ? (Int)std::max(cacheBytes / sizeof(VertexData), (size_t)1) : 0;
+      m_blockSegments.clear();
+    }
+
+
+    //Gather cache, see the notes at the top.  Has no effect for programs
+    //without Program::postDelta.
+    void setGatherCache(bool enable)
+    {
+      m_gatherCache = enable && DeltaCache::enabled;
+      m_cacheValid.assign(m_nVertices, false);
+    }
+
+
+    //Vectorized gather for programs with a GatherReduction, see the notes
+    //at the top.  Off by default.
+    void setVectorGather(bool enable)
+    {
+      m_vectorGather = enable;
+      m_gatherTermsValid = false;
+    }
+
+
     void gather(bool haveGather=true)
     {
+      if( !haveGather || !Phases::hasGather )
+      {
+        for( Int i = 0; i < m_active.size(); ++i )
+          m_gatherResults[i] = Program::gatherZero;
+        return;
+      }
+      if( m_gatherCache )
+      {
+        cachedGather();
+        return;
+      }
+      if( m_blockVertices && m_active.size() * 4 >= (size_t)m_nVertices )
+      {
+        blockedGather();
+        return;
+      }
+      if( VectorGather::enabled && m_vectorGather )
+      {
+        vectorGather();
+        return;
+      }
+      needCSC();
       for( Int i = 0; i < m_active.size(); ++i )
       {
         Int dv = m_active[i];
         GatherResult sum = Program::gatherZero;
-        Int edgeStart = m_srcOffsets[dv];
-        Int edgeEnd   = m_srcOffsets[dv + 1];
-        for( Int ie = edgeStart; ie < edgeEnd; ++ie )
+        EdgeInt edgeStart = m_srcOffsets[dv];
+        EdgeInt edgeEnd   = m_srcOffsets[dv + 1];
+        for( EdgeInt ie = edgeStart; ie < edgeEnd; ++ie )
         {
           Int src = m_srcs[ie];
           GatherResult tmp = Program::gatherMap(m_vertexData + dv
-            , m_vertexData + src, m_edgeData + m_edgeIndexCSC[ie]);
+            , m_vertexData + src, edgeCSC(ie));
           sum = Program::gatherReduce(sum, tmp);
         }
         m_gatherResults[i] = sum;
@@ -167,6 +678,8 @@ class GASEngineRef
       {
         Int dv = m_active[i];
         m_applyRet[i] = Program::apply(m_vertexData + dv, m_gatherResults[i]);
+        if( VectorGather::enabled && m_gatherTermsValid )
+          m_gatherSource[dv] = VectorGather::gatherSource(m_vertexData + dv);
       }
     }
 
@@ -174,8 +687,35 @@ class GASEngineRef
     //do the scatter operation
     void scatterActivate(bool haveScatter=true)
     {
+      haveScatter = haveScatter && Phases::hasScatter;
+      needCSR();
       m_activeFlags.clear();
       m_activeFlags.resize(m_nVertices, false);
+
+      //without scatter there are no deltas to keep the cache up to date
+      if( m_gatherCache && !haveScatter )
+        m_cacheValid.assign(m_nVertices, false);
+
+      if( m_directionOptimizing && !haveScatter )
+      {
+        int64_t frontierSize  = 0;
+        int64_t frontierEdges = 0;
+        for( Int i = 0; i < m_active.size(); ++i )
+        {
+          if( m_applyRet[i] )
+          {
+            Int sv = m_active[i];
+            ++frontierSize;
+            frontierEdges += m_dstOffsets[sv + 1] - m_dstOffsets[sv];
+          }
+        }
+        if( m_direction.choose(frontierSize, frontierEdges, m_nVertices) )
+        {
+          pullActivate();
+          return;
+        }
+      }
+
       for( Int i = 0; i < m_active.size(); ++i )
       {
         //only run scatter if the vertex has requested its nbd
@@ -183,17 +723,62 @@ class GASEngineRef
         if( m_applyRet[i] )
         {
           Int sv = m_active[i];
-          Int edgeStart = m_dstOffsets[sv];
-          Int edgeEnd   = m_dstOffsets[sv + 1];
-          for( Int ie = edgeStart; ie < edgeEnd; ++ie )
+          EdgeInt edgeStart = m_dstOffsets[sv];
+          EdgeInt edgeEnd   = m_dstOffsets[sv + 1];
+          for( EdgeInt ie = edgeStart; ie < edgeEnd; ++ie )
           {
             Int dv = m_dsts[ie];
-            m_activeFlags[dv] = true;
+            if( ActivateFilter::canActivate(m_vertexData + dv) )
+              m_activeFlags[dv] = true;
             if( haveScatter )
             {
                Program::scatter(m_vertexData + sv, m_vertexData + dv
-                , m_edgeData + m_edgeIndexCSR[ie]);
+                , edgeCSR(ie));
+               if( GatherEdge::enabled && m_gatherTermsValid )
+               {
+                 EdgeInt e = edgeCSR(ie) - m_edgeData;
+                 m_gatherEdge[m_cscPosition[e]] = GatherEdge::gatherEdge(m_edgeData + e);
+               }
             }
+            if( m_gatherCache && haveScatter && m_cacheValid[dv] )
+            {
+              GatherResult delta;
+              if( DeltaCache::postDelta(m_vertexData + sv, m_vertexData + dv
+                , edgeCSR(ie), &delta) )
+                m_cachedResults[dv] = Program::gatherReduce(m_cachedResults[dv], delta);
+              else
+                m_cacheValid[dv] = false;
+            }
+          }
+        }
+      }
+    }
+
+
+    //bottom-up activation: every vertex that can still be activated looks
+    //for an in-neighbor that is activating its nbd and stops at the first one
+    void pullActivate()
+    {
+      needCSC();
+      std::vector<bool> sources(m_nVertices, false);
+      for( Int i = 0; i < m_active.size(); ++i )
+      {
+        if( m_applyRet[i] )
+          sources[m_active[i]] = true;
+      }
+
+      for( Int dv = 0; dv < m_nVertices; ++dv )
+      {
+        if( !ActivateFilter::canActivate(m_vertexData + dv) )
+          continue;
+        EdgeInt edgeStart = m_srcOffsets[dv];
+        EdgeInt edgeEnd   = m_srcOffsets[dv + 1];
+        for( EdgeInt ie = edgeStart; ie < edgeEnd; ++ie )
+        {
+          if( sources[m_srcs[ie]] )
+          {
+            m_activeFlags[dv] = true;
+            break;
           }
         }
       }
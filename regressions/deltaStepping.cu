@@ -0,0 +1,159 @@
+/******************************************************************************
+Copyright 2013 Royal Caliber LLC. (http://www.royal-caliber.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************************/
+
+//Delta stepping in the CPU engine against the reference engine, on graphs
+//small enough to write down here.  Exits with 1 on a difference.
+
+#include "../util.cuh"
+#include "../refgas.h"
+#include "../cpugas.h"
+#include <climits>
+#include <cstdio>
+#include <vector>
+
+
+//shortest paths, as in sssp.cu
+struct SSSP
+{
+  typedef int VertexData;
+  typedef int EdgeData;
+  typedef int GatherResult;
+  static const int gatherZero = INT_MAX / 2;
+
+  static int gatherReduce(const int& left, const int& right)
+  {
+    return std::min(left, right);
+  }
+
+  static int gatherMap(const VertexData* dstDist, const VertexData *srcDist
+    , const EdgeData* edgeLen)
+  {
+    return *srcDist + *edgeLen;
+  }
+
+  static bool apply(VertexData* curDist, GatherResult dist)
+  {
+    bool changed = dist < *curDist;
+    *curDist = std::min(*curDist, dist);
+    return changed;
+  }
+
+  static void scatter(const VertexData* src, const VertexData *dst
+    , EdgeData* edge)
+  {
+  }
+
+  static double priority(const VertexData* dist)
+  {
+    return *dist;
+  }
+
+  static double edgeWeight(const EdgeData* edgeLen)
+  {
+    return *edgeLen;
+  }
+};
+
+
+//distances from vertex 0 with both engines, the CPU one delta stepping
+bool check(const char *name, int nVertices, const std::vector<int> &srcs
+  , const std::vector<int> &dsts, std::vector<int> edgeLen, double delta)
+{
+  int nEdges = (int)srcs.size();
+  std::vector<int> ref(nVertices, SSSP::gatherZero);
+  std::vector<int> cpu(nVertices, SSSP::gatherZero);
+  ref[0] = cpu[0] = 0;
+
+  GASEngineRef<SSSP> refEngine;
+  refEngine.setGraph(nVertices, &ref[0], nEdges, &edgeLen[0], &srcs[0], &dsts[0]);
+  refEngine.setActive(0, nVertices);
+  refEngine.run();
+  refEngine.getResults();
+
+  GASEngineCPU<SSSP> cpuEngine;
+  cpuEngine.setGraph(nVertices, &cpu[0], nEdges, &edgeLen[0], &srcs[0], &dsts[0]);
+  cpuEngine.setDeltaStepping(true, delta);
+  cpuEngine.activateNeighbors(0, 1);
+  while( cpuEngine.countActive() )
+  {
+    cpuEngine.gather();
+    cpuEngine.apply();
+    cpuEngine.scatterActivate();
+    cpuEngine.nextIter();
+  }
+  cpuEngine.getResults();
+
+  for( int v = 0; v < nVertices; ++v )
+  {
+    if( ref[v] != cpu[v] )
+    {
+      printf("%s: vertex %d has distance %d, reference %d\n", name, v
+        , cpu[v], ref[v]);
+      return false;
+    }
+  }
+  printf("%s: ok\n", name);
+  return true;
+}
+
+
+int main(int argc, char **argv)
+{
+  bool ok = true;
+
+  //a chain whose far end lies past the last bucket
+  {
+    int n = 16;
+    std::vector<int> srcs, dsts, edgeLen;
+    for( int v = 0; v + 1 < n; ++v )
+    {
+      srcs.push_back(v);
+      dsts.push_back(v + 1);
+      edgeLen.push_back(99999);
+    }
+    ok = check("long chain", n, srcs, dsts, edgeLen, 1.0) && ok;
+  }
+
+  //a grid with a shortcut, light and heavy edges in every bucket
+  {
+    int side = 32;
+    int n = side * side;
+    std::vector<int> srcs, dsts, edgeLen;
+    for( int v = 0; v < n; ++v )
+    {
+      int x = v % side;
+      int y = v / side;
+      if( x + 1 < side )
+      {
+        srcs.push_back(v);
+        dsts.push_back(v + 1);
+        edgeLen.push_back(1 + (v * 7) % 13);
+      }
+      if( y + 1 < side )
+      {
+        srcs.push_back(v);
+        dsts.push_back(v + side);
+        edgeLen.push_back(1 + (v * 11) % 17);
+      }
+    }
+    srcs.push_back(0);
+    dsts.push_back(n - 1);
+    edgeLen.push_back(150);
+    ok = check("grid", n, srcs, dsts, edgeLen, 4.0) && ok;
+  }
+
+  return ok ? 0 : 1;
+}
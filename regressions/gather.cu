@@ -0,0 +1,286 @@
+/******************************************************************************
+Copyright 2013 Royal Caliber LLC. (http://www.royal-caliber.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************************/
+
+//The gather variants of the reference and CPU engines (cache blocked,
+//vectorized, sorted edge data) against the reference engine's plain
+//gather loop, on a random graph with a few hubs.  Exits with 1 on a
+//difference.
+
+#include "../util.cuh"
+#include "../refgas.h"
+#include "../cpugas.h"
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+
+//shortest paths, gathered as a min of source term + edge term
+struct SSSP
+{
+  typedef int VertexData;
+  typedef int EdgeData;
+  typedef int GatherResult;
+  static const int gatherZero = INT_MAX / 2;
+
+  static int gatherReduce(const int& left, const int& right)
+  {
+    return std::min(left, right);
+  }
+
+  static int gatherMap(const VertexData* dstDist, const VertexData *srcDist
+    , const EdgeData* edgeLen)
+  {
+    return *srcDist + *edgeLen;
+  }
+
+  typedef GASTraits::MinReduction GatherReduction;
+
+  static int gatherSource(const VertexData* srcDist)
+  {
+    return *srcDist;
+  }
+
+  static int gatherEdge(const EdgeData* edgeLen)
+  {
+    return *edgeLen;
+  }
+
+  static bool apply(VertexData* curDist, GatherResult dist)
+  {
+    bool changed = dist < *curDist;
+    *curDist = std::min(*curDist, dist);
+    return changed;
+  }
+
+  static void scatter(const VertexData* src, const VertexData *dst
+    , EdgeData* edge)
+  {
+  }
+};
+
+
+//PageRank, gathered as a sum of source terms
+struct PageRank
+{
+  struct VertexData
+  {
+    float rank;
+    int   numOutEdges;
+  };
+  struct EdgeData {};
+  typedef float GatherResult;
+  static const float gatherZero;
+
+  static float gatherReduce(const float& left, const float& right)
+  {
+    return left + right;
+  }
+
+  static float gatherMap(const VertexData* dst, const VertexData* src
+    , const EdgeData* edge)
+  {
+    return src->rank / src->numOutEdges;
+  }
+
+  typedef GASTraits::PlusReduction GatherReduction;
+
+  static float gatherSource(const VertexData* src)
+  {
+    return src->rank / src->numOutEdges;
+  }
+
+  static bool apply(VertexData* cur, GatherResult sum)
+  {
+    float newRank = 0.15f + 0.85f * sum;
+    bool changed = std::fabs(newRank - cur->rank) >= 0.001f;
+    cur->rank = newRank;
+    return changed;
+  }
+
+  static void scatter(const VertexData* src, const VertexData *dst
+    , EdgeData* edge)
+  {
+  }
+
+  static const bool hasScatter = false;
+  static const bool hasEdgeData = false;
+};
+
+const float PageRank::gatherZero = 0.0f;
+
+
+//how a run configures its engine
+struct Variant
+{
+  const char *name;
+  bool        cpu;
+  bool        vector;
+  size_t      blockBytes; //0 for no blocking
+  bool        sorted;     //CPU engine only
+  bool        ordered;    //with a vertex order
+  bool        fused;      //CPU engine only
+};
+
+
+template<typename Program, typename Engine>
+void runEngine(Engine &engine, int nVertices
+  , typename Program::VertexData *vertexData, int nEdges
+  , typename Program::EdgeData *edgeData
+  , const std::vector<int> &srcs, const std::vector<int> &dsts
+  , const std::vector<int> &order, const Variant &variant)
+{
+  engine.setGatherBlocking(variant.blockBytes);
+  if( variant.ordered )
+    engine.setVertexOrder(nVertices, &order[0]);
+  engine.setGraph(nVertices, vertexData, nEdges, edgeData, &srcs[0], &dsts[0]);
+  engine.setActive(0, nVertices);
+  engine.run();
+  engine.getResults();
+}
+
+
+template<typename Program>
+void runVariant(int nVertices, typename Program::VertexData *vertexData
+  , int nEdges, typename Program::EdgeData *edgeData
+  , const std::vector<int> &srcs, const std::vector<int> &dsts
+  , const std::vector<int> &order, const Variant &variant)
+{
+  if( variant.cpu )
+  {
+    GASEngineCPU<Program> engine;
+    engine.setSortedEdgeData(variant.sorted);
+    engine.setVectorGather(variant.vector);
+    engine.setFused(variant.fused);
+    runEngine<Program>(engine, nVertices, vertexData, nEdges, edgeData
+      , srcs, dsts, order, variant);
+  }
+  else
+  {
+    GASEngineRef<Program> engine;
+    engine.setVectorGather(variant.vector);
+    runEngine<Program>(engine, nVertices, vertexData, nEdges, edgeData
+      , srcs, dsts, order, variant);
+  }
+}
+
+
+bool same(int a, int b)
+{
+  return a == b;
+}
+
+bool same(const PageRank::VertexData &a, const PageRank::VertexData &b)
+{
+  return std::fabs(a.rank - b.rank) <= 1.0e-3f * std::max(1.0f, a.rank);
+}
+
+
+//every variant against the plain reference gather, variants[0]
+template<typename Program>
+bool check(const char *name, int nVertices
+  , const std::vector<typename Program::VertexData> &init
+  , std::vector<typename Program::EdgeData> edgeData
+  , const std::vector<int> &srcs, const std::vector<int> &dsts
+  , const std::vector<int> &order, const Variant *variants, int nVariants)
+{
+  int nEdges = (int)srcs.size();
+  typename Program::EdgeData *edges = edgeData.empty() ? 0 : &edgeData[0];
+  std::vector<typename Program::VertexData> ref = init;
+  runVariant<Program>(nVertices, &ref[0], nEdges, edges, srcs, dsts, order
+    , variants[0]);
+
+  bool ok = true;
+  for( int k = 1; k < nVariants; ++k )
+  {
+    std::vector<typename Program::VertexData> result = init;
+    runVariant<Program>(nVertices, &result[0], nEdges, edges, srcs, dsts
+      , order, variants[k]);
+    int v = 0;
+    while( v < nVertices && same(ref[v], result[v]) )
+      ++v;
+    if( v < nVertices )
+    {
+      printf("%s, %s: vertex %d differs\n", name, variants[k].name, v);
+      ok = false;
+    }
+    else
+      printf("%s, %s: ok\n", name, variants[k].name);
+  }
+  return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+  //random graph, a third of the edges into and a fifth out of a few hubs
+  int nVertices = 20000;
+  int nEdges    = 200000;
+  std::vector<int> srcs(nEdges), dsts(nEdges), edgeLen(nEdges);
+  srand(7);
+  for( int i = 0; i < nEdges; ++i )
+  {
+    srcs[i]    = i % 5 == 0 ? rand() % 3 : rand() % nVertices;
+    dsts[i]    = i % 3 == 0 ? rand() % 4 : rand() % nVertices;
+    edgeLen[i] = 1 + rand() % 50;
+  }
+  std::vector<int> order(nVertices);
+  for( int v = 0; v < nVertices; ++v )
+    order[v] = (int)((v * 7919L) % nVertices);
+
+  //segments of a few hundred vertices, so there are many of them
+  const Variant variants[] = {
+    { "reference",                  false, false, 0,    false, false, false },
+    { "reference vector",           false, true,  0,    false, false, false },
+    { "reference blocked",          false, false, 4096, false, false, false },
+    { "reference blocked ordered",  false, false, 4096, false, true,  false },
+    { "cpu",                        true,  false, 0,    false, false, false },
+    { "cpu vector",                 true,  true,  0,    false, false, false },
+    { "cpu vector sorted",          true,  true,  0,    true,  false, false },
+    { "cpu vector ordered",         true,  true,  0,    false, true,  false },
+    { "cpu vector fused",           true,  true,  0,    false, false, true  },
+    { "cpu blocked",                true,  false, 4096, false, false, false },
+    { "cpu blocked sorted",         true,  false, 4096, true,  false, false },
+    { "cpu blocked ordered",        true,  false, 4096, false, true,  false },
+  };
+  int nVariants = sizeof(variants) / sizeof(variants[0]);
+
+  bool ok = true;
+  {
+    std::vector<int> init(nVertices, SSSP::gatherZero);
+    init[0] = 0;
+    ok = check<SSSP>("sssp", nVertices, init, edgeLen, srcs, dsts, order
+      , variants, nVariants) && ok;
+  }
+  {
+    std::vector<PageRank::VertexData> init(nVertices);
+    for( int v = 0; v < nVertices; ++v )
+    {
+      init[v].rank        = 0.15f;
+      init[v].numOutEdges = 0;
+    }
+    for( int i = 0; i < nEdges; ++i )
+      ++init[srcs[i]].numOutEdges;
+    for( int v = 0; v < nVertices; ++v )
+      init[v].numOutEdges = std::max(init[v].numOutEdges, 1);
+    ok = check<PageRank>("pagerank", nVertices, init
+      , std::vector<PageRank::EdgeData>(), srcs, dsts, order, variants
+      , nVariants) && ok;
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,394 @@
+/******************************************************************************
+Copyright 2013 Royal Caliber LLC. (http://www.royal-caliber.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************************/
+
+#ifndef REORDER_H__
+#define REORDER_H__
+
+//Vertex orderings that give graph traversals better locality.  Gather reads
+//the data of every in-neighbor, so numbering vertices that are read
+//together close to each other turns random reads into nearby ones.
+//
+//An ordering is returned as newId: vertex v of the input becomes vertex
+//newId[v].  The graph itself is given as CSR (offsets and dsts) and, where
+//an ordering also needs in-edges, as CSC; see transposeCSR in csr.h.
+//permuteCSR applies an ordering to a CSR or CSC graph.
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include "csr.h"
+
+
+//Helpers
+//orders vertices by decreasing degree, ties by id
+template<typename Int, typename EdgeInt>
+struct DegreeGreater
+{
+  const EdgeInt *offsets;
+
+  DegreeGreater(const EdgeInt *offsets) : offsets(offsets) {}
+
+  bool operator()(Int a, Int b) const
+  {
+    EdgeInt da = offsets[a + 1] - offsets[a];
+    EdgeInt db = offsets[b + 1] - offsets[b];
+    return da > db || (da == db && a < b);
+  }
+};
+
+
+//orders vertices by increasing degree (of in- plus out-edges), ties by id
+template<typename Int, typename EdgeInt>
+struct DegreeLess
+{
+  const EdgeInt *outOffsets;
+  const EdgeInt *inOffsets;
+
+  DegreeLess(const EdgeInt *outOffsets, const EdgeInt *inOffsets)
+    : outOffsets(outOffsets), inOffsets(inOffsets) {}
+
+  EdgeInt degree(Int v) const
+  {
+    return outOffsets[v + 1] - outOffsets[v] + inOffsets[v + 1] - inOffsets[v];
+  }
+
+  bool operator()(Int a, Int b) const
+  {
+    return degree(a) < degree(b) || (degree(a) == degree(b) && a < b);
+  }
+};
+
+
+//newId from the vertices listed in their new order
+template<typename Int>
+void orderToNewIds(Int nVertices, const Int *order, Int *newId)
+{
+  #pragma omp parallel for schedule(static)
+  for( Int i = 0; i < nVertices; ++i )
+    newId[order[i]] = i;
+}
+
+
+//Degree sort: vertices by decreasing degree in offsets.  With CSR offsets
+//these are out-degrees, so the vertices that gathers read most often end up
+//together at the front.  Cheap, and most of the benefit on power law graphs.
+template<typename Int, typename EdgeInt>
+void degreeSortOrder(Int nVertices, const EdgeInt *offsets, Int *newId)
+{
+  std::vector<Int> order(nVertices);
+  for( Int v = 0; v < nVertices; ++v )
+    order[v] = v;
+  std::sort(order.begin(), order.end(), DegreeGreater<Int, EdgeInt>(offsets));
+  orderToNewIds(nVertices, nVertices ? &order[0] : 0, newId);
+}
+
+
+//Reverse Cuthill-McKee on the graph with edge directions dropped: a
+//breadth first search from a low degree vertex of every component that
+//visits neighbors by increasing degree, numbered in reverse.  Neighbors end
+//up close together, which suits meshes and road networks best.
+template<typename Int, typename EdgeInt>
+void rcmOrder(Int nVertices
+  , const EdgeInt *outOffsets, const Int *dsts
+  , const EdgeInt *inOffsets, const Int *srcs
+  , Int *newId)
+{
+  DegreeLess<Int, EdgeInt> less(outOffsets, inOffsets);
+
+  //components are started from their lowest degree vertex
+  std::vector<Int> starts(nVertices);
+  for( Int v = 0; v < nVertices; ++v )
+    starts[v] = v;
+  std::sort(starts.begin(), starts.end(), less);
+
+  std::vector<Int> order;
+  order.reserve(nVertices);
+  std::vector<char> visited(nVertices, 0);
+  std::vector<Int> nbrs;
+  for( Int s = 0; s < nVertices; ++s )
+  {
+    if( visited[starts[s]] )
+      continue;
+    visited[starts[s]] = 1;
+    order.push_back(starts[s]);
+    for( size_t head = order.size() - 1; head < order.size(); ++head )
+    {
+      Int v = order[head];
+      nbrs.clear();
+      for( EdgeInt i = outOffsets[v]; i < outOffsets[v + 1]; ++i )
+      {
+        if( !visited[dsts[i]] )
+        {
+          visited[dsts[i]] = 1;
+          nbrs.push_back(dsts[i]);
+        }
+      }
+      for( EdgeInt i = inOffsets[v]; i < inOffsets[v + 1]; ++i )
+      {
+        if( !visited[srcs[i]] )
+        {
+          visited[srcs[i]] = 1;
+          nbrs.push_back(srcs[i]);
+        }
+      }
+      std::sort(nbrs.begin(), nbrs.end(), less);
+      order.insert(order.end(), nbrs.begin(), nbrs.end());
+    }
+  }
+
+  std::reverse(order.begin(), order.end());
+  orderToNewIds(nVertices, nVertices ? &order[0] : 0, newId);
+}
+
+
+//Priority queue of vertices with integer keys that only change by one,
+//for gorderOrder.  Vertices sit in one list per key, so every operation
+//is O(1) apart from popMax stepping down over empty keys.
+template<typename Int>
+class UnitHeap
+{
+public:
+  UnitHeap(Int n)
+    : m_key(n, 0), m_prev(n), m_next(n), m_head(1, n ? 0 : -1)
+    , m_removed(n, 0), m_top(0)
+  {
+    for( Int v = 0; v < n; ++v )
+    {
+      m_prev[v] = v - 1;
+      m_next[v] = v + 1 < n ? v + 1 : -1;
+    }
+  }
+
+  void increment(Int v)
+  {
+    if( m_removed[v] )
+      return;
+    unlink(v);
+    ++m_key[v];
+    if( m_key[v] >= (Int)m_head.size() )
+      m_head.push_back(-1);
+    link(v);
+    if( m_key[v] > m_top )
+      m_top = m_key[v];
+  }
+
+  void decrement(Int v)
+  {
+    if( m_removed[v] )
+      return;
+    unlink(v);
+    --m_key[v];
+    link(v);
+  }
+
+  void remove(Int v)
+  {
+    unlink(v);
+    m_removed[v] = 1;
+  }
+
+  //a vertex of the largest key, which is removed
+  Int popMax()
+  {
+    while( m_head[m_top] < 0 )
+      --m_top;
+    Int v = m_head[m_top];
+    remove(v);
+    return v;
+  }
+
+private:
+  std::vector<Int>  m_key;
+  std::vector<Int>  m_prev;
+  std::vector<Int>  m_next;
+  std::vector<Int>  m_head; //first vertex of every key, -1 if none
+  std::vector<char> m_removed;
+  Int               m_top;  //no key above this one is in use
+
+  void unlink(Int v)
+  {
+    if( m_prev[v] >= 0 )
+      m_next[m_prev[v]] = m_next[v];
+    else
+      m_head[m_key[v]] = m_next[v];
+    if( m_next[v] >= 0 )
+      m_prev[m_next[v]] = m_prev[v];
+  }
+
+  void link(Int v)
+  {
+    m_prev[v] = -1;
+    m_next[v] = m_head[m_key[v]];
+    if( m_next[v] >= 0 )
+      m_prev[m_next[v]] = v;
+    m_head[m_key[v]] = v;
+  }
+};
+
+
+//Locality optimizing order after Gorder (Wei et al., SIGMOD 2016).
+//Vertices are placed greedily, each time the one with the most in the
+//window of the last window placed vertices in common: an edge to or from
+//one of them, or a shared in-neighbor.  Shared in-neighbors are what
+//gather reads, so this packs the sources of nearby gathers together.
+//In-neighbors of degree above hubDegree (default sqrt(nVertices)) are not
+//counted as shared, they are read by so many vertices that placing them
+//well is hopeless and counting them is quadratic.  Sequential and the
+//slowest of the three by far, meant for offline preprocessing.
+template<typename Int, typename EdgeInt>
+void gorderOrder(Int nVertices
+  , const EdgeInt *outOffsets, const Int *dsts
+  , const EdgeInt *inOffsets, const Int *srcs
+  , Int *newId
+  , int window = 5
+  , EdgeInt hubDegree = 0)
+{
+  if( !nVertices )
+    return;
+  if( hubDegree <= 0 )
+    hubDegree = std::max((EdgeInt)16, (EdgeInt)sqrt((double)nVertices));
+
+  UnitHeap<Int> heap(nVertices);
+  std::vector<Int> order(nVertices);
+
+  //start from the vertex with the most in-edges
+  Int v = 0;
+  for( Int u = 1; u < nVertices; ++u )
+  {
+    if( inOffsets[u + 1] - inOffsets[u] > inOffsets[v + 1] - inOffsets[v] )
+      v = u;
+  }
+  heap.remove(v);
+
+  for( Int i = 0; i < nVertices; ++i )
+  {
+    order[i] = v;
+
+    //v enters the window and order[i - window] leaves it
+    for( int pass = 0; pass < 2; ++pass )
+    {
+      bool enter = pass == 0;
+      if( !enter && i < window )
+        break;
+      Int w = enter ? v : order[i - window];
+
+      for( EdgeInt e = outOffsets[w]; e < outOffsets[w + 1]; ++e )
+      {
+        if( enter )
+          heap.increment(dsts[e]);
+        else
+          heap.decrement(dsts[e]);
+      }
+      for( EdgeInt e = inOffsets[w]; e < inOffsets[w + 1]; ++e )
+      {
+        Int u = srcs[e];
+        if( enter )
+          heap.increment(u);
+        else
+          heap.decrement(u);
+        if( outOffsets[u + 1] - outOffsets[u] > hubDegree )
+          continue;
+        for( EdgeInt f = outOffsets[u]; f < outOffsets[u + 1]; ++f )
+        {
+          if( enter )
+            heap.increment(dsts[f]);
+          else
+            heap.decrement(dsts[f]);
+        }
+      }
+    }
+
+    if( i + 1 < nVertices )
+      v = heap.popMax();
+  }
+
+  orderToNewIds(nVertices, &order[0], newId);
+}
+
+
+//orders edge positions by the new id of their neighbor
+template<typename Int, typename EdgeInt>
+struct NewNeighborLess
+{
+  const Int *nbrs;
+  const Int *newId;
+
+  NewNeighborLess(const Int *nbrs, const Int *newId) : nbrs(nbrs), newId(newId) {}
+
+  bool operator()(EdgeInt a, EdgeInt b) const
+  {
+    return newId[nbrs[a]] < newId[nbrs[b]]
+      || (newId[nbrs[a]] == newId[nbrs[b]] && a < b);
+  }
+};
+
+
+//Renumber the vertices of a CSR (or CSC) graph: vertex v becomes newId[v]
+//and keeps its edges, with the neighbors renamed and sorted by their new
+//id.  outIndex[i], if not null, is the input position of output edge i, to
+//reorder edge data.  outOffsets has nVertices + 1 entries.
+template<typename Int, typename EdgeInt>
+void permuteCSR(Int nVertices, typename CSRNoDeduce<EdgeInt>::type nEdges
+  , const EdgeInt *offsets, const Int *nbrs, const Int *newId
+  , typename CSRNoDeduce<EdgeInt>::type *outOffsets, Int *outNbrs
+  , typename CSRNoDeduce<EdgeInt>::type *outIndex)
+{
+  outOffsets[0] = 0;
+  #pragma omp parallel for schedule(static)
+  for( Int v = 0; v < nVertices; ++v )
+    outOffsets[newId[v] + 1] = offsets[v + 1] - offsets[v];
+  scanCSROffsets(nVertices, outOffsets);
+
+  NewNeighborLess<Int, EdgeInt> less(nbrs, newId);
+  #pragma omp parallel
+  {
+    std::vector<EdgeInt> edges;
+    #pragma omp for schedule(dynamic, 1024)
+    for( Int v = 0; v < nVertices; ++v )
+    {
+      edges.clear();
+      for( EdgeInt i = offsets[v]; i < offsets[v + 1]; ++i )
+        edges.push_back(i);
+      std::sort(edges.begin(), edges.end(), less);
+      EdgeInt out = outOffsets[newId[v]];
+      for( size_t k = 0; k < edges.size(); ++k )
+      {
+        outNbrs[out + k] = newId[nbrs[edges[k]]];
+        if( outIndex )
+          outIndex[out + k] = edges[k];
+      }
+    }
+  }
+}
+
+
+//true if newId is a permutation of [0, nVertices)
+template<typename Int>
+bool isVertexOrder(Int nVertices, const Int *newId)
+{
+  std::vector<char> seen(nVertices, 0);
+  for( Int v = 0; v < nVertices; ++v )
+  {
+    if( newId[v] < 0 || newId[v] >= nVertices || seen[newId[v]] )
+      return false;
+    seen[newId[v]] = 1;
+  }
+  return true;
+}
+
+
+#endif
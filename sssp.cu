@@ -20,6 +20,8 @@ limitations under the License.
 #include "graphio.h"
 #include "refgas.h"
 #include "gpugas.h"
+#include "cpugas.h"
+#include "asyncgas.h"
 #include <climits>
 
 struct SSSP
@@ -28,6 +30,9 @@ struct SSSP
   typedef int VertexData;
   typedef int EdgeData;
 
+  //the engines leave out scatter, see gastraits.h
+  static const bool hasScatter = false;
+
   typedef int GatherResult;
   static const int maxLength = 100000;
   static const int gatherZero = INT_MAX - maxLength;
@@ -48,6 +53,22 @@ struct SSSP
   }
 
 
+  //gatherMap is a min of *srcDist + *edgeLen, see gastraits.h
+  typedef GASTraits::MinReduction GatherReduction;
+
+  __host__ __device__
+  static int gatherSource(const VertexData* srcDist)
+  {
+    return *srcDist;
+  }
+
+  __host__ __device__
+  static int gatherEdge(const EdgeData* edgeLen)
+  {
+    return *edgeLen;
+  }
+
+
   __host__ __device__
   static bool apply(VertexData* curDist, GatherResult dist)
   {
@@ -63,14 +84,71 @@ struct SSSP
   {
     //nothing
   }
+
+
+  //asynchronous engine and delta stepping work on the closest vertices first
+  __host__ __device__
+  static double priority(const VertexData* dist)
+  {
+    return *dist;
+  }
+
+
+  //light/heavy edge split for delta stepping
+  __host__ __device__
+  static double edgeWeight(const EdgeData* edgeLen)
+  {
+    return *edgeLen;
+  }
 };
 
 
+//Only the CPU engine has delta stepping.  It starts from the neighbors of
+//the source instead of from every vertex.
+template<typename Engine>
+void initActive(Engine &engine, int srcVertex, int nVertices, double delta)
+{
+  //TODO, setting all vertices to active for first step works, but it would
+  //be faster to instead set to neighbors of starting vertex
+  engine.setActive(0, nVertices);
+}
+
+
+void initActive(GASEngineCPU<SSSP> &engine, int srcVertex, int nVertices
+  , double delta)
+{
+  if( delta > 0 )
+  {
+    engine.setDeltaStepping(true, delta);
+    engine.activateNeighbors(srcVertex, srcVertex + 1);
+  }
+  else
+    engine.setActive(0, nVertices);
+}
+
+
+//Only the CPU engine can keep the edge lengths in CSC order.
+template<typename Engine>
+void setSortedEdgeData(Engine &engine, bool sortEdges)
+{
+}
+
+
+void setSortedEdgeData(GASEngineCPU<SSSP> &engine, bool sortEdges)
+{
+  engine.setSortedEdgeData(sortEdges);
+}
+
+
+//delta > 0 selects delta stepping with that bucket width, sortEdges keeps
+//the edge lengths in CSC order (CPU engine only)
 template<typename Engine>
 float run(int srcVertex, int nVertices, SSSP::VertexData* vertexData, int nEdges
-  , SSSP::EdgeData* edgeData, const int* srcs, const int* dsts)
+  , SSSP::EdgeData* edgeData, const int* offsets, const int* dsts
+  , double delta = 0, bool sortEdges = false)
 {
   Engine engine;
+  setSortedEdgeData(engine, sortEdges);
 
   GpuTimer gpu_timer;
   float elapsed = 0.0f;
@@ -82,11 +160,8 @@ float run(int srcVertex, int nVertices, SSSP::VertexData* vertexData, int nEdges
     // reset the graph
     for(int i = 0; i < nVertices; ++i) vertexData[i] = SSSP::gatherZero;
     vertexData[srcVertex] = 0;
-    engine.setGraph(nVertices, vertexData, nEdges, edgeData, srcs, dsts);
-
-    //TODO, setting all vertices to active for first step works, but it would
-    //be faster to instead set to neighbors of starting vertex
-    engine.setActive(0, nVertices);
+    engine.setGraphCSR(nVertices, vertexData, nEdges, edgeData, offsets, dsts);
+    initActive(engine, srcVertex, nVertices, delta);
 
     gpu_timer.Start();
 
@@ -111,6 +186,43 @@ float run(int srcVertex, int nVertices, SSSP::VertexData* vertexData, int nEdges
 }
 
 
+//The asynchronous engine has no iterations to step through, so it gets its
+//own driver.  Bucket width is the average edge length.
+float runAsync(int srcVertex, int nVertices, SSSP::VertexData* vertexData
+  , int nEdges, SSSP::EdgeData* edgeData, const int* offsets, const int* dsts)
+{
+  GASEngineAsync<SSSP> engine;
+  double totalLength = 0;
+  for( int i = 0; i < nEdges; ++i )
+    totalLength += edgeData[i];
+  engine.setPriorityDelta(nEdges ? totalLength / nEdges : 1.0);
+
+  GpuTimer gpu_timer;
+  float elapsed = 0.0f;
+
+  // average elapsed time of 10 runs
+  for (int itr = 0; itr < 10; ++itr)
+  {
+    // reset the graph
+    for(int i = 0; i < nVertices; ++i) vertexData[i] = SSSP::gatherZero;
+    vertexData[srcVertex] = 0;
+    engine.setGraphCSR(nVertices, vertexData, nEdges, edgeData, offsets, dsts);
+    engine.setActive(0, nVertices);
+
+    gpu_timer.Start();
+    engine.run();
+    engine.getResults();
+    gpu_timer.Stop();
+    elapsed += gpu_timer.ElapsedMillis();
+  }
+
+  elapsed /= 10;
+  printf("number of vertex updates: %ld, edges gathered: %ld\n"
+    , (long)engine.numUpdates(), (long)engine.numEdgeVisits());
+  return elapsed;
+}
+
+
 void outputDists(int nVertices, int* dists, FILE* f = stdout)
 {
   for (int i = 0; i < nVertices; ++i)
@@ -126,32 +238,37 @@ int main(int argc, char** argv)
   bool runTest;
   bool dumpResults;
   bool useMaxOutDegreeStart;
-  if(!parseCmdLineSimple(argc, argv, "si-t-d-m|s", &inputFilename, &sourceVertex
-    , &runTest, &dumpResults, &useMaxOutDegreeStart, &outputFilename) )
+  bool useCPU;
+  bool useAsync;
+  bool useDeltaStepping;
+  bool useSortedEdges;
+  if(!parseCmdLineSimple(argc, argv, "si-t-d-m-c-a-b-s|s", &inputFilename, &sourceVertex
+    , &runTest, &dumpResults, &useMaxOutDegreeStart, &useCPU, &useAsync
+    , &useDeltaStepping, &useSortedEdges, &outputFilename) )
   {
-    printf("Usage: sssp [-t] [-d] [-m] inputfile source [outputfile]\n");
+    printf("Usage: sssp [-t] [-d] [-m] [-c] [-a] [-b] [-s] inputfile source [outputfile]\n");
     exit(1);
   }
 
-  //load the graph
-  int nVertices;
-  std::vector<int> srcs;
-  std::vector<int> dsts;
-  std::vector<int> edgeData;
-  loadGraph(inputFilename, nVertices, srcs, dsts, &edgeData);
-  if( edgeData.size() == 0 )
+  //load the graph as CSR, which text files come as from their cache (see
+  //loadGraph_cached), so the engines need not sort the edges again.  The
+  //edge lengths are stored in edge list order.
+  CachedGraph graph;
+  loadGraph_cached(inputFilename, graph, true);
+  if( !graph.edgeValues )
   {
     printf("No edge data available in input file\n");
     exit(1);
   }
+  int nVertices = graph.nVertices;
+  int nEdges = graph.nEdges;
+  const int *srcOffsets = graph.csrOffsets;
+  std::vector<int> edgeData(nEdges);
+  for( int i = 0; i < nEdges; ++i )
+    edgeData[i] = graph.edgeValues[graph.csrIndex[i]];
 
   if( useMaxOutDegreeStart )
   {
-    //convert to CSR layout to find source vertex
-    std::vector<int> srcOffsets(nVertices + 1);
-    std::vector<int> csrSrcs(srcs.size());
-    edgeListToCSR<int>(
-      nVertices, srcs.size(), &srcs[0], &dsts[0], &srcOffsets[0], 0, 0);
     int maxDegree = -1;
     sourceVertex = -1;
     for(int i = 0; i < nVertices; ++i)
@@ -180,7 +297,7 @@ int main(int argc, char** argv)
     printf("Running reference calculation\n");
     refVertexData = vertexData;
     float elapsed = run< GASEngineRef<SSSP> >(sourceVertex, nVertices
-      , &refVertexData[0], (int)srcs.size(), &edgeData[0], &srcs[0], &dsts[0]);
+      , &refVertexData[0], nEdges, &edgeData[0], srcOffsets, graph.csrDsts);
     if( dumpResults )
     {
       printf("Reference:\n");
@@ -188,23 +305,48 @@ int main(int argc, char** argv)
     }
   }
 
-  float elapsed = run< GASEngineGPU<SSSP> >(sourceVertex, nVertices
-    , &vertexData[0], (int)srcs.size(), &edgeData[0], &srcs[0], &dsts[0]);
+  //-b runs the CPU engine with delta stepping.  Bucket width is the usual
+  //maximum edge length / average degree.
+  double delta = 0;
+  if( useDeltaStepping )
+  {
+    useCPU = true;
+    int maxLength = 1;
+    for( size_t i = 0; i < edgeData.size(); ++i )
+      maxLength = std::max(maxLength, edgeData[i]);
+    double avgDegree = nVertices ? (double)nEdges / nVertices : 1.0;
+    delta = std::max(1.0, maxLength / std::max(1.0, avgDegree));
+    printf("delta stepping with delta %.1f\n", delta);
+  }
+
+  //-s runs the CPU engine with the edge lengths in CSC order
+  if( useSortedEdges )
+    useCPU = true;
+
+  //-c runs the multithreaded CPU engine in place of the GPU one,
+  //-a the asynchronous CPU engine
+  float elapsed;
+  if( useAsync )
+    elapsed = runAsync(sourceVertex, nVertices
+      , &vertexData[0], nEdges, &edgeData[0], srcOffsets, graph.csrDsts);
+  else if( useCPU )
+    elapsed = run< GASEngineCPU<SSSP> >(sourceVertex, nVertices
+      , &vertexData[0], nEdges, &edgeData[0], srcOffsets, graph.csrDsts
+      , delta, useSortedEdges);
+  else
+    elapsed = run< GASEngineGPU<SSSP> >(sourceVertex, nVertices
+      , &vertexData[0], nEdges, &edgeData[0], srcOffsets, graph.csrDsts);
 
   // compute stats
   long int nodes_visited = 0;
   long int edges_visited = 0;
-  std::vector<int> srcOffsets(nVertices + 1);
-  std::vector<int> csrSrcs(srcs.size());
-  edgeListToCSR<int>(
-    nVertices, srcs.size(), &srcs[0], &dsts[0], &srcOffsets[0], 0, 0);
 
   for (int itr = 0; itr < nVertices; ++itr)
   {
     if (vertexData.at(itr) < SSSP::gatherZero)
     {
       nodes_visited += 1;
-      edges_visited += srcOffsets.at(itr+1) - srcOffsets.at(itr);
+      edges_visited += srcOffsets[itr+1] - srcOffsets[itr];
     }
   }
 
@@ -214,7 +356,7 @@ int main(int argc, char** argv)
 
   if( dumpResults )
   {
-    printf("GPU:\n");
+    printf(useAsync ? "Async:\n" : useCPU ? "CPU:\n" : "GPU:\n");
     outputDists(nVertices, &vertexData[0]);
   }
 
@@ -243,6 +385,7 @@ int main(int argc, char** argv)
     fclose(f);
   }
 
+  unmapGraph(graph);
   free(inputFilename);
   free(outputFilename);
 
@@ -30,6 +30,17 @@ int64_t currentTime()
 }
 
 
+int checkedEdgeCount(size_t nEdges)
+{
+  if( nEdges > 0x7fffffff )
+  {
+    printf("graph has %zu edges, too many for 32 bit edge offsets\n", nEdges);
+    exit(1);
+  }
+  return (int)nEdges;
+}
+
+
 int parseCmdLineSimple(int argc, char** argv, const char* fmt, ...)
 {
   std::map<char, bool> optChars;
@@ -21,6 +21,7 @@ limitations under the License.
 #include <vector>
 #include <algorithm>
 #include <stdio.h>
+#include "csr.h"
 
 //some simple utility routines to avoid duplication across test programs
 
@@ -40,85 +41,11 @@ int64_t currentTime();
 int parseCmdLineSimple(int argc, char **argv, const char*fmt, ...);
 
 
+//nEdges as an int for the test programs, whose engines use 32-bit edge
+//offsets.  Exits for graphs of 2^31 edges or more, which need an engine
+//with a 64-bit EdgeInt.
+int checkedEdgeCount(size_t nEdges);
 
-//Helper function for edgeListToCS*()
-//this is a quick and dirty implementation because we are no concerned at this
-//point with how a CSC or CSR representation is obtained.
-//Return sortedIdx such that inData[sortedIdx] is sorted ascending
-template<typename Int>
-void indSort(int n, const Int* inData, Int* sortedIdx)
-{
-  typedef std::pair<Int, Int> Pair;
-
-  struct PairCmp
-  {
-    static bool lt(const Pair &p1, const Pair &p2)
-    {
-      return p1.first < p2.first;
-    }
-  };
-
-  std::vector<Pair> pairs(n);
-  for( Int i = 0; i < n; ++i )
-  {
-    pairs[i].first  = inData[i];
-    pairs[i].second = i;
-  }
-
-  std::sort(pairs.begin(), pairs.end(), PairCmp::lt);
-
-  for( Int i = 0; i < n; ++i )
-    sortedIdx[i] = pairs[i].second;
-}
-
-
-//convert a list of edges into a CSR representation of the adjacency matrix
-//again, this is not intended to be efficient, since this is outside the
-//scope of the present work.
-//Note: offsets should have nVertices + 1 elements.
-template<typename Int>
-void edgeListToCSR(Int nVertices, Int nEdges
-  , const Int *srcs, const Int *dsts
-  , Int *offsets, Int *outDsts, Int* sortIndices)
-{
-  Int* ind;
-  std::vector<Int> tmpIndices;
-  if( sortIndices )
-    ind = sortIndices;
-  else
-  {
-    tmpIndices.resize(nEdges);
-    ind = &tmpIndices[0];
-  }
-  indSort(nEdges, srcs, ind);
-
-  if( outDsts )
-  {
-    for( Int i = 0; i < nEdges; ++i )
-      outDsts[i] = dsts[ ind[i] ];
-  }
-
-  Int curSrc = 0;
-  for( Int i = 0; i < nEdges; ++i )
-  {
-    Int src = srcs[ind[i]];
-    while( curSrc <= src )
-      offsets[curSrc++] = i;
-  }
-  while(curSrc <= nVertices)
-    offsets[curSrc++] = nEdges;
-}
-
-
-//convert a list of edges into a CSC representation of the adjacency matrix
-template<typename Int>
-void edgeListToCSC(Int nVertices, Int nEdges
-  , const Int *srcs, const Int *dsts
-  , Int *offsets, Int *outSrcs, Int* sortIndices)
-{
-  edgeListToCSR<Int>(nVertices, nEdges, dsts, srcs
-    , offsets, outSrcs, sortIndices);
-};
 
 //use gpu timer
 struct GpuTimer